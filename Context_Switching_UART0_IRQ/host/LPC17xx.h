@@ -0,0 +1,125 @@
+/**
+ * @file:   LPC17xx.h
+ * @brief:  host stand-in for the CMSIS device header, only the UART0/UART1,
+ *          pin connect, NVIC and SysTick pieces the console pipeline uses,
+ *          and the core registers and intrinsics k_task.c uses
+ * NOTE: The UART register blocks are mapped at their LPC1768 addresses by
+ *       host_uart_map() and every access traps into the emulator in
+ *       host_uart.c, so the driver code runs unchanged.
+ *       Interrupt masking is a no-op: the host port has a single thread, the
+ *       tasks are contexts of it (host_ctx.c) and interrupts are only taken
+ *       at the points host_irq.c picks.
+ */
+
+#ifndef HOST_LPC17XX_H_
+#define HOST_LPC17XX_H_
+
+#include <stdint.h>
+
+/* ----- UART, the layout of LPC_UART_TypeDef in the CMSIS header ----- */
+typedef struct {
+    union {
+        volatile const uint8_t RBR;
+        volatile uint8_t  THR;
+        volatile uint8_t  DLL;
+        uint32_t RESERVED0;
+    };
+    union {
+        volatile uint8_t  DLM;
+        volatile uint32_t IER;
+    };
+    union {
+        volatile const uint32_t IIR;
+        volatile uint8_t  FCR;
+    };
+    volatile uint8_t  LCR;
+    uint8_t  RESERVED1[7];
+    volatile const uint8_t LSR;
+    uint8_t  RESERVED2[7];
+    volatile uint8_t  SCR;
+    uint8_t  RESERVED3[3];
+    volatile uint32_t ACR;
+    volatile uint8_t  ICR;
+    uint8_t  RESERVED4[3];
+    volatile uint8_t  FDR;
+    uint8_t  RESERVED5[7];
+    volatile uint8_t  TER;
+    uint8_t  RESERVED6[39];
+    volatile const uint8_t FIFOLVL;
+} LPC_UART_TypeDef;
+
+#define LPC_UART0_BASE  0x4000C000
+#define LPC_UART1_BASE  0x40010000
+#define LPC_UART0       ((LPC_UART_TypeDef *) LPC_UART0_BASE)
+#define LPC_UART1       ((LPC_UART_TypeDef *) LPC_UART1_BASE)
+
+/* ----- Pin connect block, plain memory on the host ----- */
+typedef struct {
+    volatile uint32_t PINSEL0;
+    volatile uint32_t PINSEL1;
+    volatile uint32_t PINSEL2;
+    volatile uint32_t PINSEL3;
+    volatile uint32_t PINSEL4;
+} LPC_PINCON_TypeDef;
+
+extern LPC_PINCON_TypeDef g_host_pincon;
+#define LPC_PINCON      (&g_host_pincon)
+
+/* ----- NVIC ----- */
+typedef enum {
+    UART0_IRQn = 5,
+    UART1_IRQn = 6,
+} IRQn_Type;
+
+void NVIC_EnableIRQ(IRQn_Type irq);
+void NVIC_DisableIRQ(IRQn_Type irq);
+
+/* ----- SysTick, it counts on the host clock (host_clock.c) ----- */
+extern uint32_t SystemCoreClock;
+uint32_t SysTick_Config(uint32_t ticks);
+
+#define __disable_irq()
+#define __enable_irq()
+
+/* ----- DWT cycle counter and CoreDebug, plain memory (host_hal.c) ----- */
+typedef struct {
+    volatile uint32_t CTRL;
+    volatile uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct {
+    volatile uint32_t DHCSR;
+    volatile uint32_t DCRSR;
+    volatile uint32_t DCRDR;
+    volatile uint32_t DEMCR;
+} CoreDebug_Type;
+
+extern DWT_Type g_host_dwt;
+extern CoreDebug_Type g_host_coredebug;
+#define DWT                         (&g_host_dwt)
+#define CoreDebug                   (&g_host_coredebug)
+#define DWT_CTRL_CYCCNTENA_Msk      (1UL << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk  (1UL << 24)
+
+/* ----- Core registers, MSP and PSP are variables of host_hal.c ----- */
+uint32_t __get_MSP(void);
+void __set_MSP(uint32_t msp);
+uint32_t __get_PSP(void);
+void __set_PSP(uint32_t psp);
+
+static inline uint32_t __RBIT(uint32_t v) {
+    uint32_t r = 0;
+
+    for (int i = 0; i < 32; i++, v >>= 1) {
+        r = (r << 1) | (v & 1);
+    }
+    return r;
+}
+
+static inline uint32_t __CLZ(uint32_t v) {
+    return v == 0 ? 32 : (uint32_t) __builtin_clz(v);
+}
+
+#define __weak __attribute__((weak))
+
+#endif /* ! HOST_LPC17XX_H_ */
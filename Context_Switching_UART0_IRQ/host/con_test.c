@@ -0,0 +1,424 @@
+/**
+ * @file:   con_test.c
+ * @brief:  console pipeline on the host: keystrokes into the emulated UART0,
+ *          through the UART0 interrupt, the KCD and the display task, and
+ *          back out of the TX FIFO
+ * NOTE: Runs uart_irq.c, kcd_task.c, kcd_parse.c, lcd_task.c, console.c,
+ *       printf.c and circular_buffer.c unchanged on the kernel itself:
+ *       k_rtx_init.c boots it, k_task.c schedules through host_hal.c and
+ *       host_ctx.c, and the tasks' RTX calls enter k_msg.c, k_evt.c,
+ *       k_mem.c and the rest through host_rtx.c. The UART is emulated
+ *       (host_uart.c). The null task is the interrupt controller and the
+ *       terminal: it moves bytes between the line and the FIFOs, runs the
+ *       UART0 handler while the interrupt is asserted and SysTick when it is
+ *       due, types the next command once the last one is answered. By
+ *       default interrupts are only taken there, and the HIGH priority KCD
+ *       and display tasks they wake run until they block. -f floods instead,
+ *       interrupts are also taken at the tasks' kernel calls as soon as they
+ *       are pending (host_irq.c), and counts the keystrokes the KCD mailbox
+ *       had no room for (k_send_msg_isr). The virtual clock always works
+ *       that way.
+ *
+ *       -m runs on the virtual clock (host_clock.c) at that many MHz: the
+ *       line runs at the baud rate uart_irq_init programs, or -b, and the
+ *       report is in target-equivalent time, including the CPU the
+ *       per-character interrupts take. -k sets the cost model in cycles.
+ *
+ *       -R file records where every interrupt landed. -r file replays such a
+ *       recording without the terminal: the console output goes to stdout
+ *       and the run stops at the first interrupt that lands differently, so
+ *       an interleaving that broke something can be rerun under a debugger
+ *       or a profiler. Replays of virtual clock runs match to the cycle.
+ *
+ *       Build and run from this directory:
+ *         gcc -O2 -no-pie -DHOST_PORT -D'__svc(n)=' -I. -o con_test \
+ *             con_test.c host_rtx.c host_hal.c host_ctx.c host_clock.c host_irq.c \
+ *             host_uart.c host_port.c host_kernel.c ../src/k_rtx_init.c ../src/k_task.c \
+ *             ../src/k_wait.c ../src/linked_list.c ../src/k_msg.c ../src/k_sync.c \
+ *             ../src/k_evt.c ../src/k_mem_wait.c ../src/k_mem.c ../src/circular_buffer.c \
+ *             ../src/uart_irq.c ../src/console.c ../src/kcd_task.c ../src/kcd_parse.c \
+ *             ../src/lcd_task.c ../src/printf.c
+ *         ./con_test                   (1000 x "%ZZ" over a socketpair, latency report)
+ *         ./con_test -n 5000 -c "%LT"  (any command, -e is the end of its reply)
+ *         ./con_test -m 100            (the same on a 100 MHz target at 115200 baud)
+ *         ./con_test -p                (interactive, attach a terminal to the pty it prints)
+ *         ./con_test -m 100 -R irq.log && ./con_test -r irq.log
+ *
+ *       -I. picks the LPC17xx.h stand-in in this directory for the kernel sources.
+ *       x86-64 Linux only, see host_uart.c.
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "host_port.h"
+
+/* ----- Definitions ----- */
+#define DEF_CMDS      1000
+#define DEF_CMD       "%ZZ"                     /* not registered, a one line reply */
+#define DEF_REPLY_END "processed.\r\n"
+#define DEF_MHZ       100
+#define REPLY_TIMEOUT 2000000000ULL             /* ns without output before a command is lost */
+#define RX_BUF        4096
+#define CON_BLK_SIZE  4                         /* blk_size passed to rtx_init_cfg */
+
+/* the terminal on the other end of the line */
+typedef struct con_term {
+    int fd;
+    int num_cmds;
+    const char *cmd;
+    const char *reply_end;
+    char line[72];              /* cmd and CR, what is typed */
+    char echo[72];              /* cmd and CR LF, the end of the echo */
+    char buf[RX_BUF];           /* output of the current command */
+    int len;
+    int stage;                  /* 0 ready to type, 1 waiting for the echo, 2 for the reply */
+    int sent;
+    int done;                   /* commands answered */
+    int lost;                   /* commands that timed out */
+    int finished;
+    unsigned long long t0;      /* clock cycles when the command was typed */
+    unsigned long long start;
+    unsigned long long end;
+    unsigned long long busy;    /* host_clk_busy at start */
+    unsigned long long last_ns; /* host time of the last output, for the timeout */
+    unsigned long long *echo_cyc;
+    unsigned long long *reply_cyc;
+} CON_TERM_T;
+
+static int cmp_ull(const void *a, const void *b) {
+    unsigned long long x = *(const unsigned long long *) a;
+    unsigned long long y = *(const unsigned long long *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* take the output since the last call, type the next command when the last one is answered */
+static void term_step(CON_TERM_T *t) {
+    unsigned long long now = host_clk_now();
+    char in[RX_BUF];
+    ssize_t r;
+    char *hit;
+
+    while ((r = read(t->fd, in, sizeof(in))) > 0) {
+        /* the line may carry NULs (uart_irq_init sends one), drop them */
+        for (ssize_t i = 0; i < r; i++) {
+            if (in[i] != '\0' && t->len < RX_BUF - 1) {
+                t->buf[t->len++] = in[i];
+            }
+        }
+        t->buf[t->len] = '\0';
+        t->last_ns = host_time_ns();
+    }
+
+    if (t->stage == 1 && (hit = strstr(t->buf, t->echo)) != NULL) {
+        t->echo_cyc[t->done] = now - t->t0;
+        hit += strlen(t->echo);
+        t->len -= hit - t->buf;
+        memmove(t->buf, hit, t->len + 1);
+        t->stage = 2;
+    }
+    if (t->stage == 2 && strstr(t->buf, t->reply_end) != NULL) {
+        t->reply_cyc[t->done++] = now - t->t0;
+        t->stage = 0;
+    }
+    if (t->stage != 0 && host_time_ns() - t->last_ns > REPLY_TIMEOUT) {
+        t->lost++;
+        t->stage = 0;
+    }
+
+    if (t->stage == 0) {
+        if (t->sent == t->num_cmds) {
+            t->finished = 1;
+            t->end = now;
+            return;
+        }
+        t->len = 0;
+        t->buf[0] = '\0';
+        if (write(t->fd, t->line, strlen(t->line)) < 0) {
+            t->finished = 1;
+            return;
+        }
+        t->sent++;
+        t->stage = 1;
+        t->t0 = now;
+        t->last_ns = host_time_ns();
+    }
+}
+
+static void print_dist(const char *name, unsigned long long *cyc, int n) {
+    unsigned long long sum = 0;
+
+    if (n == 0) {
+        return;
+    }
+    qsort(cyc, n, sizeof(cyc[0]), cmp_ull);
+    for (int i = 0; i < n; i++) {
+        sum += cyc[i];
+    }
+    printf("%-8s min %8.1f  avg %8.1f  p50 %8.1f  p99 %8.1f  max %8.1f us\n", name,
+           host_clk_ns(cyc[0]) / 1e3, host_clk_ns(sum / n) / 1e3, host_clk_ns(cyc[n / 2]) / 1e3,
+           host_clk_ns(cyc[n * 99 / 100]) / 1e3, host_clk_ns(cyc[n - 1]) / 1e3);
+}
+
+/**
+ * @brief: the interrupt controller, returns when the terminal is done or a
+ *         replay is over, runs forever without either
+ * NOTE: it runs as the null task, so every other task is blocked. On the
+ *       virtual clock, when the line has nothing new, the clock jumps to the
+ *       next character or, while a task waits with a timeout, to the next
+ *       SysTick. With neither the system is idle until the line brings
+ *       input, like a tickless null task.
+ */
+static void irq_loop(CON_TERM_T *term, int line_fd) {
+    struct pollfd pfd[2] = {
+        {line_fd, POLLIN, 0},
+        {host_uart_wake_fd(), POLLIN, 0},
+    };
+
+    while (term == NULL || !term->finished) {
+        unsigned long long next;
+        int taken;
+
+        taken = host_irq_idle();
+        if (taken < 0) {
+            break;
+        }
+        if (taken > 0) {
+            continue;           /* the tasks they woke have run, look again */
+        }
+        if (term != NULL) {
+            term_step(term);
+        }
+
+        if (poll(pfd, 2, 0) > 0) {
+            continue;           /* new input or a register write, pump again */
+        }
+        next = host_irq_next();
+        if (host_clk_virtual() && next != HOST_CLK_NEVER) {
+            host_clk_idle_until(next);
+            continue;
+        }
+
+        poll(pfd, 2, 1);        /* 1 ms, the SysTick of the real-time clock */
+    }
+}
+
+/* what the null task does once the kernel is up, see con_idle */
+typedef struct con_run {
+    CON_TERM_T *term;           /* NULL for -p and -r */
+    int line_fd;
+    int replay;
+    unsigned int mhz;           /* 0 for the real-time clock */
+    unsigned int baud;
+    int flood;
+} CON_RUN_T;
+
+static CON_RUN_T g_run;
+
+static int replay_report(void) {
+    HOST_UART_STATS st;
+    unsigned long events;
+    int diverged;
+
+    events = host_irq_replayed(&diverged);
+    host_uart_stats(0, &st);
+    fprintf(stderr, "replayed %lu interrupt events%s, UART0: %lu bytes in, %lu bytes out, "
+            "%lu interrupts\n", events, diverged ? " then diverged" : "",
+            st.rx_bytes, st.tx_bytes, st.irqs);
+    host_irq_close();
+    return diverged;
+}
+
+static int term_report(CON_TERM_T *term) {
+    HOST_UART_STATS st;
+
+    host_irq_close();
+    host_uart_stats(0, &st);
+    if (g_run.mhz != 0) {
+        printf("virtual %u MHz, UART0 at %u baud\n", g_run.mhz, host_uart_baud(0, g_run.baud));
+    }
+    printf("%d x \"%s\"%s: %d answered, %d lost, %.1f cmds/s\n", term->num_cmds, term->cmd,
+           g_run.flood ? " (flood)" : "", term->done, term->lost,
+           term->done / (host_clk_ns(term->end - term->start) / 1e9));
+    print_dist("echo", term->echo_cyc, term->done);
+    print_dist("reply", term->reply_cyc, term->done);
+    printf("UART0: %lu bytes in, %lu bytes out, %lu interrupts, %lu RX overruns, "
+           "%lu TX overruns, %lu KEY_IN dropped\n", st.rx_bytes, st.tx_bytes, st.irqs,
+           st.rx_overruns, st.tx_overruns, host_rtx_isr_drops());
+    if (g_run.mhz != 0) {
+        printf("CPU busy %.2f%% of %.3f s\n",
+               100.0 * (host_clk_busy() - term->busy) / (term->end - term->start),
+               host_clk_ns(term->end - term->start) / 1e9);
+    }
+    return term->lost != 0;
+}
+
+/* the null task: the display and KCD tasks are up and blocked, run the interrupt loop, report and exit */
+static void con_idle(void) {
+    CON_TERM_T *term = g_run.term;
+
+    if (term != NULL) {
+        term->start = host_clk_now();
+        term->busy = host_clk_busy();
+    }
+    /* a replay's line is stdout, output only, poll would find a file always readable */
+    irq_loop(term, g_run.replay ? -1 : g_run.line_fd);
+    fflush(stdout);
+    exit(g_run.replay ? replay_report() : term_report(term));
+}
+
+/* attach the line and boot the kernel, con_idle takes over, returns only if the boot fails */
+static void start_console(int line_fd) {
+    g_run.line_fd = line_fd;
+    host_uart_attach(0, line_fd);
+    if (g_run.replay) {
+        host_irq_replay_start();
+    }
+    host_hal_init(con_idle);
+    host_rtx_init(CON_BLK_SIZE);
+    fprintf(stderr, "cannot start the console tasks\n");
+}
+
+/* -k svc,switch,irq,bus,work in cycles, empty fields keep the default */
+static int set_costs(char *arg) {
+    for (int what = 0; what < HOST_CLK_NUM_COSTS && arg != NULL; what++) {
+        char *comma = strchr(arg, ',');
+
+        if (*arg != ',' && *arg != '\0') {
+            host_clk_set_cost(what, (unsigned int) strtoul(arg, NULL, 0));
+        }
+        arg = comma != NULL ? comma + 1 : NULL;
+    }
+    return arg == NULL ? 0 : -1;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [-p] [-f] [-n cmds] [-c cmd] [-e reply_end] [-m mhz [-b baud] [-k costs]]\n"
+            "          [-R log]\n"
+            "       %s -r log\n"
+            "  -p  serve the console on a pty until killed\n"
+            "  -f  flood, interrupts land in the tasks' kernel calls (real-time clock only)\n"
+            "  -m  virtual clock at mhz, report target-equivalent times\n"
+            "  -k  svc,switch,irq,bus,work cycles for the virtual clock\n"
+            "  -R  record where the interrupts land\n"
+            "  -r  replay a recording, the console output goes to stdout\n", prog, prog);
+}
+
+int main(int argc, char *argv[]) {
+    static CON_TERM_T term;
+    unsigned int mhz = 0;
+    unsigned int baud = 0;
+    char *costs = NULL;
+    const char *record = NULL;
+    const char *replay = NULL;
+    int pty = 0;
+    int flood = 0;
+    int sv[2];
+    int i;
+
+    term.num_cmds = DEF_CMDS;
+    term.cmd = DEF_CMD;
+    term.reply_end = DEF_REPLY_END;
+
+    for (i = 1; i < argc; i++) {
+        if (argv[i][0] != '-' || argv[i][1] == '\0' || argv[i][2] != '\0') {
+            usage(argv[0]);
+            return 1;
+        }
+        if (argv[i][1] == 'p' || argv[i][1] == 'f') {
+            pty |= argv[i][1] == 'p';
+            flood |= argv[i][1] == 'f';
+            continue;
+        }
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        switch (argv[i][1]) {
+            case 'n': term.num_cmds = atoi(argv[++i]); break;
+            case 'c': term.cmd = argv[++i]; break;
+            case 'e': term.reply_end = argv[++i]; break;
+            case 'm': mhz = (unsigned int) atoi(argv[++i]); break;
+            case 'b': baud = (unsigned int) atoi(argv[++i]); break;
+            case 'k': costs = argv[++i]; break;
+            case 'R': record = argv[++i]; break;
+            case 'r': replay = argv[++i]; break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (term.num_cmds <= 0 || strlen(term.cmd) > 64 || (mhz != 0 && flood)
+        || ((baud != 0 || costs != NULL) && mhz == 0)
+        || (replay != NULL && (mhz != 0 || flood || pty || record != NULL))) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (replay != NULL && host_irq_replay(replay, &mhz, &baud) != 0) {
+        return 1;
+    }
+    host_clk_init(mhz != 0 ? mhz : DEF_MHZ, mhz != 0);
+    if (costs != NULL && set_costs(costs) != 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (replay == NULL) {
+        host_irq_init(flood || mhz != 0);
+    }
+    if (record != NULL && host_irq_record(record, mhz, baud) != 0) {
+        return 1;
+    }
+    /* k_mpu_init installs the guard's SIGSEGV handler, it must come before the UART's */
+    if (host_iram_map() != 0 || host_guard_protect(0, 0, 0) != 0 || host_uart_map() != 0) {
+        return 1;
+    }
+    host_uart_baud(0, baud);
+    g_run.mhz = mhz;
+    g_run.baud = baud;
+    g_run.flood = flood;
+
+    if (replay != NULL) {
+        g_run.replay = 1;
+        start_console(STDOUT_FILENO);
+        return 1;
+    }
+
+    if (pty) {
+        int master = posix_openpt(O_RDWR | O_NOCTTY);
+
+        if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+            perror("posix_openpt");
+            return 1;
+        }
+        printf("UART0 on %s\n", ptsname(master));
+        fflush(stdout);
+        start_console(master);
+        return 1;
+    }
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+        perror("socketpair");
+        return 1;
+    }
+    fcntl(sv[1], F_SETFL, O_NONBLOCK);
+    term.fd = sv[1];
+    snprintf(term.line, sizeof(term.line), "%s\r", term.cmd);
+    snprintf(term.echo, sizeof(term.echo), "%s\r\n", term.cmd);
+    term.echo_cyc = calloc(term.num_cmds, sizeof(term.echo_cyc[0]));
+    term.reply_cyc = calloc(term.num_cmds, sizeof(term.reply_cyc[0]));
+    if (term.echo_cyc == NULL || term.reply_cyc == NULL) {
+        return 1;
+    }
+    g_run.term = &term;
+    start_console(sv[0]);
+    return 1;
+}
@@ -0,0 +1,70 @@
+/**
+ * @file:   guard_check.c
+ * @brief:  check that a runaway user stack hits its guard region instead of
+ *          the block below it
+ * NOTE: The host guard is mprotect based and only traps with page sized
+ *       guards, so this tool is built with a 4KB guard and a larger IRAM1:
+ *         gcc -O2 -no-pie -DMPU_GUARD_SIZE=4096 -DIRAM1_END=0x10020000 \
+ *             -o guard_check guard_check.c host_port.c host_kernel.c ../src/k_mem.c
+ *         ./guard_check
+ *
+ *       Each case runs in a child process because a guard hit ends the task.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "host_port.h"
+
+#define STACK_SIZE 0x400
+#define GUARD_HIT  3        /* exit status of the host MemManage report */
+
+/* push `depth` bytes onto a full descending stack, one word at a time */
+static void stack_push(char *stack_hi, unsigned int depth) {
+    volatile unsigned int *sp = (volatile unsigned int *) stack_hi;
+
+    while (depth >= sizeof(*sp)) {
+        *--sp = 0xDEADBEEF;
+        depth -= sizeof(*sp);
+    }
+}
+
+static int run_case(const char *name, unsigned int depth, int expect) {
+    pid_t pid = fork();
+    int status;
+    int got;
+
+    if (pid == 0) {
+        char *neighbour;
+        char *stack_lo;
+
+        k_mem_init(4, g_host_mem_algos[0]);     /* FIRST_FIT */
+        neighbour = k_mem_alloc(64);            /* the block a runaway stack would corrupt */
+        stack_lo = host_user_stack(1, STACK_SIZE);
+        if (neighbour == NULL || stack_lo == NULL) {
+            _exit(1);
+        }
+        stack_push(stack_lo + STACK_SIZE, depth);
+        _exit(0);
+    }
+
+    waitpid(pid, &status, 0);
+    got = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    printf("%-26s depth %5u: %s\n", name, depth, got == expect ? "ok" : "FAILED");
+    return got == expect ? 0 : 1;
+}
+
+int main(void) {
+    int failed = 0;
+
+    if (host_iram_map() != 0) {
+        return 1;
+    }
+
+    failed += run_case("stack within its size", STACK_SIZE, 0);
+    failed += run_case("overflow into the guard", STACK_SIZE + 2 * 4096, GUARD_HIT);
+
+    return failed ? 1 : 0;
+}
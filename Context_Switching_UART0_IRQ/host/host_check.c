@@ -0,0 +1,336 @@
+/**
+ * @file:   host_check.c
+ * @brief:  kernel side of rtx_stress.c: the invariant checks over the
+ *          scheduler's and the allocator's data, and the kernel calls whose
+ *          arguments are kernel types
+ * NOTE: The checks read the kernel's globals directly and change nothing, so
+ *       they can run between any two kernel calls. Each failed check returns
+ *       a fixed reason string and the TID it is about.
+ */
+
+#include <LPC17xx.h>
+#include "../src/k_rtx.h"
+#include "../src/k_task.h"
+#include "../src/k_mem.h"
+#include "../src/k_wait.h"
+#include "host_port.h"
+
+#define CHECK_OWNERS 256    /* owner_tid of a heap block is a U8 TID or TID_KERNEL */
+
+extern TCB *gp_current_task;
+extern TCB *g_tcbs;
+extern U16 g_max_tasks;
+extern U32 g_tid_map[];
+extern TCB *ready_queue_head;
+extern TCB *null_task;
+extern TCB *g_timer_head;
+extern TCB *g_tsk_zombies;
+extern WAIT_QUEUE_T g_mem_wait;
+
+static U8 g_seen[CHECK_OWNERS];     /* places a TCB was found in */
+static U8 g_timed[CHECK_OWNERS];    /* times a TCB is on the timeout list */
+static U8 g_zombie[CHECK_OWNERS];   /* times a TCB is on the zombie list */
+static int g_blocks[CHECK_OWNERS];  /* heap blocks per owner */
+static int g_stray_owner;           /* owner of a block that is not TID_KERNEL or a TID, -1 if none */
+static const char *g_why;
+static int g_why_tid;
+
+static int check_fail(const char *why, int tid) {
+    g_why = why;
+    g_why_tid = tid;
+    return RTX_ERR;
+}
+
+static int check_tcb(TCB *task) {
+    return task >= g_tcbs && task < g_tcbs + g_max_tasks && task == &g_tcbs[task->tid];
+}
+
+static void check_block(U32 owner_tid, void *ptr, int size) {
+    (void) ptr;
+    (void) size;
+    if (owner_tid < CHECK_OWNERS) {
+        g_blocks[owner_tid]++;
+    } else {
+        g_stray_owner = (int) owner_tid;
+    }
+}
+
+/* ready queue: READY or NEW tasks, sorted by priority, no cycle */
+static int check_ready(void) {
+    TCB *task = ready_queue_head;
+    int n = 0;
+
+    for (; task != NULL; task = task->next) {
+        if (!check_tcb(task) || ++n > g_max_tasks) {
+            return check_fail("ready queue links a foreign TCB or has a cycle", -1);
+        }
+        if (task->state != READY && task->state != NEW) {
+            return check_fail("task on the ready queue is neither READY nor NEW", task->tid);
+        }
+        if (task->next != NULL && task->next->prio < task->prio) {
+            return check_fail("ready queue not sorted by priority", task->tid);
+        }
+        g_seen[task->tid]++;
+    }
+    return RTX_OK;
+}
+
+/* the FIFOs of a wait queue agree with their tails, back links and mask */
+static int check_wait_queue(WAIT_QUEUE_T *wq, U8 state) {
+    for (int p = 0; p < NUM_PRIO; p++) {
+        TCB *prev = NULL;
+        int n = 0;
+
+        if (((wq->mask >> p) & 1) != (wq->head[p] != NULL)) {
+            return check_fail("wait queue mask disagrees with its FIFOs", -1);
+        }
+        for (TCB *task = wq->head[p]; task != NULL; prev = task, task = task->next) {
+            if (!check_tcb(task) || ++n > g_max_tasks) {
+                return check_fail("wait queue links a foreign TCB or has a cycle", -1);
+            }
+            if (task->wait_prev != prev || task->prio != p || task->wait_q != wq || task->state != state) {
+                return check_fail("task in a wait queue FIFO with a wrong link, priority or state", task->tid);
+            }
+        }
+        if (wq->tail[p] != prev) {
+            return check_fail("wait queue tail is not its last task", -1);
+        }
+    }
+    return RTX_OK;
+}
+
+/* a parked task is on its own queue's FIFO, tasks that wait alone have none */
+static int check_parked(TCB *task) {
+    TCB *p;
+
+    if (task->state == BLK_MSG || task->state == BLK_DELAY || task->state == BLK_EVT) {
+        return task->wait_q == NULL ? RTX_OK : check_fail("lone waiter on a wait queue", task->tid);
+    }
+    if (task->wait_q == NULL || (task->state == BLK_MEM && task->wait_q != &g_mem_wait)) {
+        return check_fail("blocked task is not on its wait queue", task->tid);
+    }
+    for (p = task->wait_q->head[task->prio]; p != NULL && p != task; p = p->next) {
+    }
+    return p == task ? RTX_OK : check_fail("blocked task missing from its wait queue FIFO", task->tid);
+}
+
+/* timeout list: sorted by deadline, only blocked tasks with wait_timed set */
+static int check_timers(void) {
+    TCB *task = g_timer_head;
+    int n = 0;
+
+    for (; task != NULL; task = task->timer_next) {
+        if (!check_tcb(task) || ++n > g_max_tasks) {
+            return check_fail("timeout list links a foreign TCB or has a cycle", -1);
+        }
+        if (!TSK_BLOCKED(task->state) || !task->wait_timed) {
+            return check_fail("task on the timeout list is not in a timed wait", task->tid);
+        }
+        if (task->timer_next != NULL && (S32) (task->timer_next->wait_until - task->wait_until) < 0) {
+            return check_fail("timeout list not sorted by deadline", task->tid);
+        }
+        g_timed[task->tid]++;
+    }
+    return RTX_OK;
+}
+
+/* zombie list: exited tasks whose stacks and TID tsk_reap has not freed yet */
+static int check_zombies(void) {
+    TCB *task = g_tsk_zombies;
+    int n = 0;
+
+    for (; task != NULL; task = task->next) {
+        if (!check_tcb(task) || ++n > g_max_tasks) {
+            return check_fail("zombie list links a foreign TCB or has a cycle", -1);
+        }
+        if (task->state != DORMANT) {
+            return check_fail("task on the zombie list is not DORMANT", task->tid);
+        }
+        g_zombie[task->tid]++;
+    }
+    return RTX_OK;
+}
+
+/**
+ * @brief: every task is in exactly one place, the TID map and the heap agree
+ *         with the TCBs
+ * @param: user_blocks[tid], heap blocks the tool holds for task tid
+ * @param: alloc_wait[tid], 1 while task tid is inside k_mem_alloc_wait
+ */
+static int check_tasks(const int *user_blocks, const unsigned char *alloc_wait) {
+    int kernel_blocks = 1;      /* the TCB table */
+
+    if (null_task != &g_tcbs[0] || null_task->state == DORMANT || null_task->prio != PRIO_NULL) {
+        return check_fail("the null task is gone", PID_NULL);
+    }
+    for (int tid = 0; tid < g_max_tasks; tid++) {
+        TCB *task = &g_tcbs[tid];
+        int is_free = (g_tid_map[tid >> 5] >> (tid & 31)) & 1;
+
+        if (task->tid != tid) {
+            return check_fail("TCB holds a different TID than its slot", tid);
+        }
+        if (task->state == DORMANT) {
+            if (g_seen[tid] != 0 || g_timed[tid] != 0 || task->wait_timed) {
+                return check_fail("DORMANT task still queued", tid);
+            }
+            if (task->has_mailbox || g_blocks[tid] != 0) {
+                return check_fail("DORMANT task still owns heap blocks", tid);
+            }
+            if (g_zombie[tid]) {
+                /* exited, the TID and the TID_KERNEL stacks go once another task runs */
+                if (is_free) {
+                    return check_fail("TID of a zombie is free before its stacks", tid);
+                }
+                kernel_blocks += task->static_def ? 0 : 1 + (task->priv == 0);
+            } else if (!is_free) {
+                return check_fail("TID of a DORMANT task is not free, it leaked", tid);
+            }
+            continue;
+        }
+
+        if (TSK_BLOCKED(task->state)) {
+            if (check_parked(task) != RTX_OK) {
+                return RTX_ERR;
+            }
+            g_seen[tid]++;
+        } else if (task->wait_q != NULL || task->wait_timed) {
+            return check_fail("task that is not blocked still waits", tid);
+        }
+        if (g_seen[tid] != 1) {
+            return check_fail("task is not in exactly one of running, ready or blocked", tid);
+        }
+        if (g_timed[tid] != task->wait_timed) {
+            return check_fail("wait_timed disagrees with the timeout list", tid);
+        }
+        if (is_free) {
+            return check_fail("TID of a live task is marked free", tid);
+        }
+
+        kernel_blocks += task->static_def ? 0 : 1 + (task->priv == 0);
+        if (tid != PID_NULL) {
+            int expect = user_blocks[tid] + task->has_mailbox;
+
+            /* woken by a free, the block is the task's before k_mem_alloc_wait returns */
+            if (alloc_wait[tid] && task->state != BLK_MEM && task->wait_ret == RTX_OK) {
+                expect++;
+            }
+            if (g_blocks[tid] != expect) {
+                return check_fail("task owns more or fewer heap blocks than it allocated", tid);
+            }
+        }
+    }
+    for (int tid = g_max_tasks; tid < TID_MAP_WORDS * 32; tid++) {
+        if ((g_tid_map[tid >> 5] >> (tid & 31)) & 1) {
+            return check_fail("TID beyond the TCB table marked free", tid);
+        }
+    }
+    if (g_stray_owner >= 0) {
+        return check_fail("heap block owned by a TID that cannot exist", g_stray_owner);
+    }
+    for (int tid = g_max_tasks; tid < CHECK_OWNERS; tid++) {
+        if (tid != TID_KERNEL && g_blocks[tid] != 0) {
+            return check_fail("heap block owned by a TID beyond the TCB table", tid);
+        }
+    }
+    if (g_blocks[TID_KERNEL] != kernel_blocks) {
+        return check_fail("kernel owns more or fewer heap blocks than the TCB table and stacks", TID_KERNEL);
+    }
+    return RTX_OK;
+}
+
+static int check_all(const int *user_blocks, const unsigned char *alloc_wait) {
+    if (!check_tcb(gp_current_task) || gp_current_task->state != RUNNING) {
+        return check_fail("the running task is not a RUNNING task of the TCB table", -1);
+    }
+    g_seen[gp_current_task->tid]++;
+
+    if (check_ready() != RTX_OK || check_wait_queue(&g_mem_wait, BLK_MEM) != RTX_OK
+        || check_timers() != RTX_OK || check_zombies() != RTX_OK) {
+        return RTX_ERR;
+    }
+    if (k_mem_check(check_block) != RTX_OK) {
+        return check_fail("heap does not tile IRAM1, or its free list is unordered or not coalesced", -1);
+    }
+    return check_tasks(user_blocks, alloc_wait);
+}
+
+/**
+ * @brief: check the kernel invariants
+ * @return: NULL if they hold, otherwise the first violation, *tid the task
+ *          it is about or -1
+ */
+const char *host_check_kernel(const int *user_blocks, const unsigned char *alloc_wait, int *tid) {
+    g_why = NULL;
+    g_why_tid = -1;
+    g_stray_owner = -1;
+    for (int i = 0; i < CHECK_OWNERS; i++) {
+        g_seen[i] = 0;
+        g_timed[i] = 0;
+        g_zombie[i] = 0;
+        g_blocks[i] = 0;
+    }
+
+    check_all(user_blocks, alloc_wait);
+    *tid = g_why_tid;
+    return g_why;
+}
+
+/* ----- the running task and kernel calls with kernel types ----- */
+
+/* start the kernel with one unprivileged task, does not return */
+int host_tsk_boot(void (*entry)(void), int prio, int u_stack_size, int max_tasks) {
+    RTX_TASK_INFO info = {0};
+
+    info.ptask = entry;
+    info.prio = prio;
+    info.priv = 0;
+    info.u_stack_size = u_stack_size;
+    if (k_tsk_init(&info, 1, max_tasks) != RTX_OK) {
+        return RTX_ERR;
+    }
+    k_tsk_yield();
+    return RTX_ERR;
+}
+
+int host_tsk_create_ex(unsigned char *tid, void (*entry)(void), int prio, int u_stack_size, int k_stack_size) {
+    RTX_TASK_INFO info = {0};
+
+    info.ptask = entry;
+    info.prio = prio;
+    info.u_stack_size = u_stack_size;
+    info.k_stack_size = k_stack_size;
+    return k_tsk_create_ex(tid, &info);
+}
+
+int host_tsk_current(void) {
+    return gp_current_task->tid;
+}
+
+int host_tsk_max(void) {
+    return g_max_tasks;
+}
+
+/* state of task tid, -1 if the TID is outside the TCB table */
+int host_tsk_state(int tid) {
+    return tid >= 0 && tid < g_max_tasks ? g_tcbs[tid].state : -1;
+}
+
+int host_tsk_has_mailbox(int tid) {
+    return tid >= 0 && tid < g_max_tasks && g_tcbs[tid].state != DORMANT && g_tcbs[tid].has_mailbox;
+}
+
+/* tasks that are not DORMANT, the null task included */
+int host_tsk_live(void) {
+    int n = 0;
+
+    for (int tid = 0; tid < g_max_tasks; tid++) {
+        n += g_tcbs[tid].state != DORMANT;
+    }
+    return n;
+}
+
+/* advance the DWT cycle counter the run-time statistics read */
+void host_tsk_cycles(unsigned int cycles) {
+    DWT->CYCCNT += cycles;
+}
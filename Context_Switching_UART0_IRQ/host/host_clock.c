@@ -0,0 +1,128 @@
+/**
+ * @file:   host_clock.c
+ * @brief:  clock of the host port: CPU cycles at a configurable core clock,
+ *          SysTick, and the cost model that makes host runs report
+ *          target-equivalent times
+ * NOTE: In real-time mode the cycle count follows the host's monotonic clock
+ *       scaled to the configured MHz, so the host's speed shows through.
+ *       In virtual mode nothing advances the clock but the simulation: every
+ *       kernel call (host_rtx.c), context switch (host_hal.c), interrupt
+ *       (host_irq.c) and peripheral register access (host_uart.c) is charged
+ *       its cost in target cycles, and when
+ *       every task is blocked the interrupt loop jumps the clock to the next
+ *       peripheral event (a UART character finishing, a SysTick), the way
+ *       the null task would wait for it. The same inputs then give the same
+ *       cycle counts on any host.
+ *       The default costs are rough Cortex-M3 numbers at zero wait states.
+ *       Replace them with what SVC_BENCH (svc_bench.c) measures on the board.
+ */
+
+#include <stdint.h>
+#include "LPC17xx.h"
+#include "host_port.h"
+
+/* target cycles per event, indexed by HOST_CLK_ */
+static unsigned int g_cost[HOST_CLK_NUM_COSTS] = {
+    60,     /* HOST_CLK_SVC:    SVC entry, table dispatch and return           */
+    180,    /* HOST_CLK_SWITCH: save one task's context, restore another's     */
+    40,     /* HOST_CLK_IRQ:    exception entry, register push/pop, exit       */
+    4,      /* HOST_CLK_BUS:    one peripheral register access over the APB    */
+    300,    /* HOST_CLK_WORK:   task code between two kernel calls             */
+};
+
+static int g_virtual;
+static unsigned long long g_hz = 100000000ULL;
+static unsigned long long g_now;            /* virtual mode: cycles since host_clk_init */
+static unsigned long long g_busy;           /* virtual mode: cycles charged, the rest was idle */
+static unsigned long long g_start_ns;       /* real-time mode: host time at host_clk_init */
+static unsigned long long g_tick_reload;    /* SysTick period in cycles, 0 if off */
+static unsigned long long g_tick_next;
+
+uint32_t SystemCoreClock = 100000000;
+
+/**
+ * @brief: set the core clock and the mode
+ * @param: virt, 1 for the simulated clock, 0 to follow the host's clock
+ */
+void host_clk_init(unsigned int cpu_mhz, int virt) {
+    g_hz = cpu_mhz * 1000000ULL;
+    SystemCoreClock = (uint32_t) g_hz;
+    g_virtual = virt;
+    g_now = 0;
+    g_busy = 0;
+    g_start_ns = host_time_ns();
+    g_tick_reload = 0;
+}
+
+int host_clk_virtual(void) {
+    return g_virtual;
+}
+
+unsigned long long host_clk_hz(void) {
+    return g_hz;
+}
+
+/* cycles since host_clk_init */
+unsigned long long host_clk_now(void) {
+    if (g_virtual) {
+        return g_now;
+    }
+    return (host_time_ns() - g_start_ns) * (g_hz / 1000000ULL) / 1000ULL;
+}
+
+unsigned long long host_clk_ns(unsigned long long cycles) {
+    return cycles * 1000ULL / (g_hz / 1000000ULL);
+}
+
+/* cycles the CPU was busy, virtual mode only */
+unsigned long long host_clk_busy(void) {
+    return g_busy;
+}
+
+unsigned int host_clk_cost(int what) {
+    return what >= 0 && what < HOST_CLK_NUM_COSTS ? g_cost[what] : 0;
+}
+
+void host_clk_set_cost(int what, unsigned int cycles) {
+    if (what >= 0 && what < HOST_CLK_NUM_COSTS) {
+        g_cost[what] = cycles;
+    }
+}
+
+/* the CPU spent the cost of what */
+void host_clk_charge(int what) {
+    if (g_virtual) {
+        g_now += g_cost[what];
+        g_busy += g_cost[what];
+    }
+}
+
+/* nothing is runnable until cycle */
+void host_clk_idle_until(unsigned long long cycle) {
+    if (g_virtual && cycle != HOST_CLK_NEVER && cycle > g_now) {
+        g_now = cycle;
+    }
+}
+
+/* ----- SysTick ----- */
+uint32_t SysTick_Config(uint32_t ticks) {
+    if (ticks == 0 || ticks > 0x1000000) {
+        return 1;           /* the reload register is 24 bits */
+    }
+    g_tick_reload = ticks;
+    g_tick_next = host_clk_now() + ticks;
+    return 0;
+}
+
+/* 1 if a SysTick interrupt is due, each call consumes one */
+int host_systick_due(void) {
+    if (g_tick_reload == 0 || host_clk_now() < g_tick_next) {
+        return 0;
+    }
+    g_tick_next += g_tick_reload;
+    return 1;
+}
+
+unsigned long long host_systick_next(void) {
+    return g_tick_reload == 0 ? HOST_CLK_NEVER : g_tick_next;
+}
@@ -0,0 +1,60 @@
+/**
+ * @file:   host_ctx.c
+ * @brief:  C library side of host_hal.c: one ucontext per task, indexed by TID
+ * NOTE: This is the task model of the tools that run k_task.c's scheduler,
+ *       rtx_stress.c and con_test.c. There are no threads: a switch is a
+ *       swapcontext, so a run depends only on the order of the kernel calls
+ *       and of the interrupts. Each context has a C library stack of its
+ *       own. A task that exits never runs again, its stack is freed when the
+ *       TID starts a new context.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ucontext.h>
+#include "host_port.h"
+
+#define HOST_CTX_MAX        256
+#define HOST_CTX_STACK_SIZE (64 * 1024)
+
+typedef struct host_ctx {
+    ucontext_t uc;
+    void *stack;                        /* NULL until the TID first starts */
+} HOST_CTX_T;
+
+static HOST_CTX_T g_ctx[HOST_CTX_MAX];
+
+/* a fresh context for tid running start(), the previous one of tid is gone */
+static ucontext_t *host_ctx_new(int tid, void (*start)(void)) {
+    HOST_CTX_T *ctx = &g_ctx[tid];
+
+    free(ctx->stack);
+    ctx->stack = malloc(HOST_CTX_STACK_SIZE);
+    if (ctx->stack == NULL || getcontext(&ctx->uc) != 0) {
+        perror("host_ctx");
+        exit(2);
+    }
+    ctx->uc.uc_stack.ss_sp = ctx->stack;
+    ctx->uc.uc_stack.ss_size = HOST_CTX_STACK_SIZE;
+    ctx->uc.uc_link = NULL;
+    makecontext(&ctx->uc, start, 0);
+    return &ctx->uc;
+}
+
+/**
+ * @brief: park the caller as old_tid and run new_tid, from start() if start
+ *         is not NULL, else where it was parked
+ * NOTE: returns when old_tid is switched back in
+ */
+void host_ctx_switch(int old_tid, int new_tid, void (*start)(void)) {
+    ucontext_t *next = start != NULL ? host_ctx_new(new_tid, start) : &g_ctx[new_tid].uc;
+
+    swapcontext(&g_ctx[old_tid].uc, next);
+}
+
+/* run tid from start(), the caller's context is abandoned */
+void host_ctx_start(int tid, void (*start)(void)) {
+    setcontext(host_ctx_new(tid, start));
+    perror("host_ctx_start");
+    exit(2);
+}
@@ -0,0 +1,90 @@
+/**
+ * @file:   host_hal.c
+ * @brief:  HAL.c for the host: MSP/PSP, the DWT cycle counter and the
+ *          context switch, so k_task.c's scheduler runs unchanged
+ * NOTE: Every task runs on a context of its own (host_ctx.c), its kernel and
+ *       user stacks in IRAM1 are only bookkeeping: stack checks and
+ *       high-water marks. MSP and PSP are variables that hold whatever the
+ *       kernel last set, so tsk_stack_check sees the task's own stack
+ *       pointers. __ctx_switch finds the outgoing TCB through p_old_msp, the
+ *       incoming one is gp_current_task.
+ *       A NEW task starts at the PC of its initial exception stack frame,
+ *       except the null task: null_task_func would spin forever, so the host
+ *       runs the idle function given to host_hal_init instead.
+ *       Every switch charges HOST_CLK_SWITCH to the clock (host_clock.c).
+ */
+
+#include <LPC17xx.h>
+#include "../src/k_rtx.h"
+#include "../src/k_task.h"
+#include "host_port.h"
+
+#define TCB_MSP_OFFSET ((char *) &((TCB *) 0)->msp - (char *) 0)
+
+extern TCB *gp_current_task;
+
+DWT_Type g_host_dwt;
+CoreDebug_Type g_host_coredebug;
+
+static U32 g_msp;
+static U32 g_psp;
+static void (*g_idle)(void);
+
+uint32_t __get_MSP(void) {
+    return g_msp;
+}
+
+void __set_MSP(uint32_t msp) {
+    g_msp = msp;
+}
+
+uint32_t __get_PSP(void) {
+    return g_psp;
+}
+
+void __set_PSP(uint32_t psp) {
+    g_psp = psp;
+}
+
+/* DWT->CYCCNT catches up with the clock, before the kernel reads it */
+void host_dwt_sync(void) {
+    g_host_dwt.CYCCNT = (uint32_t) host_clk_now();
+}
+
+/* what the null task runs instead of null_task_func, it must not return */
+void host_hal_init(void (*idle)(void)) {
+    g_idle = idle;
+}
+
+/* a NEW task starts at the PC of its exception stack frame, see tsk_create */
+static void hal_task_start(void) {
+    TCB *task = gp_current_task;
+    U32 *frame = task->priv ? task->msp : task->psp;
+    void (*entry)(void) = (void (*)(void)) (unsigned long) frame[6];
+
+    if (task->prio == PRIO_NULL && g_idle != NULL) {
+        entry = g_idle;
+    }
+    entry();
+    k_tsk_exit();       /* the task returned instead of calling tsk_exit */
+}
+
+/**
+ * @brief: park the running task under the TCB that owns p_old_msp and run
+ *         gp_current_task, from its start if is_new
+ * NOTE: returns when the old task is switched back in
+ */
+void __ctx_switch(U32 **p_old_msp, U32 *new_msp, U32 is_new) {
+    TCB *old = (TCB *) ((char *) p_old_msp - TCB_MSP_OFFSET);
+
+    *p_old_msp = (U32 *) (unsigned long) g_msp;
+    g_msp = (U32) (unsigned long) new_msp;
+    host_clk_charge(HOST_CLK_SWITCH);
+    host_ctx_switch(old->tid, gp_current_task->tid, is_new ? hal_task_start : NULL);
+}
+
+/* pop the first task's exception stack frame, the caller never resumes */
+void __rte(void) {
+    host_clk_charge(HOST_CLK_SWITCH);
+    host_ctx_start(gp_current_task->tid, hal_task_start);
+}
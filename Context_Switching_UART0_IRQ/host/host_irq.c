@@ -0,0 +1,301 @@
+/**
+ * @file:   host_irq.c
+ * @brief:  interrupt controller of the host port, and the record/replay of
+ *          where every interrupt lands
+ * NOTE: Interrupts are taken at two kinds of points. When every task is
+ *       blocked (host_irq_idle, the null task's loop) and, if at_calls is
+ *       on, at every kernel call a task makes (host_irq_kernel_call from the
+ *       SVC entry in host_rtx.c), which is where an interrupt that became
+ *       pending while the task ran would get in on the target. The handlers
+ *       are the kernel's own, k_wait_tick and c_UART0_IRQHandler, followed
+ *       by k_tsk_preempt when they ask for it, on the running task's context.
+ *       The kernel calls are counted and the count is the position of an
+ *       interrupt: the host has no instruction count of the target, but
+ *       between two kernel calls a task only touches its own data, so the
+ *       call count pins down every interleaving that matters.
+ *
+ *       Recording writes one line per event:
+ *         <pos> <k|i> r <byte> <cycle>   a byte entered the UART0 RX FIFO
+ *         <pos> <k|i> t 0 <cycle>        the SysTick handler ran
+ *         <pos> <k|i> u 0 <cycle>        c_UART0_IRQHandler ran
+ *       k means at kernel call number pos, i when idle after it. The first
+ *       line records the clock the run used. A replay takes the line input
+ *       and SysTick from the log, lets the UART raise its interrupts itself,
+ *       and stops at the first interrupt that does not match the log,
+ *       position, kind and, on the virtual clock, cycle.
+ */
+
+#include <stdio.h>
+#include "host_port.h"
+
+#define IRQ_LIVE    0
+#define IRQ_RECORD  1
+#define IRQ_REPLAY  2
+
+typedef struct irq_event {
+    unsigned long long pos;
+    char where;                 /* k or i */
+    char kind;                  /* r, t or u */
+    int arg;
+    unsigned long long cycle;
+} IRQ_EVENT_T;
+
+static int g_mode;
+static int g_at_calls;
+static int g_in_irq;            /* no nested interrupts, no positions inside a handler */
+static unsigned long long g_pos;
+static char g_where = 'i';
+static FILE *g_log;
+static IRQ_EVENT_T g_next;      /* replay: the next event of the log */
+static int g_have_next;
+static unsigned long g_events;  /* replay: events matched so far */
+static int g_diverged;
+
+/* take interrupts at kernel calls as well as when idle */
+void host_irq_init(int at_calls) {
+    g_at_calls = at_calls;
+}
+
+static void irq_log(char kind, int arg) {
+    fprintf(g_log, "%llu %c %c %d %llu\n", g_pos, g_where, kind, arg, host_clk_now());
+}
+
+static void irq_rx_hook(int n, int c) {
+    if (n == 0 && g_mode == IRQ_RECORD) {
+        irq_log('r', c);
+    }
+}
+
+static void irq_read_next(void) {
+    g_have_next = fscanf(g_log, "%llu %c %c %d %llu", &g_next.pos, &g_next.where,
+                         &g_next.kind, &g_next.arg, &g_next.cycle) == 5;
+}
+
+/**
+ * @brief: record every interrupt of this run to path
+ * @return: 0 on success, -1 if path cannot be written
+ */
+int host_irq_record(const char *path, unsigned int mhz, unsigned int baud) {
+    g_log = fopen(path, "w");
+    if (g_log == NULL) {
+        perror(path);
+        return -1;
+    }
+    setvbuf(g_log, NULL, _IOLBF, 0);     /* a run that crashes keeps its log */
+    fprintf(g_log, "# host_irq mhz %u baud %u at_calls %d costs", mhz, baud, g_at_calls);
+    for (int what = 0; what < HOST_CLK_NUM_COSTS; what++) {
+        fprintf(g_log, " %u", host_clk_cost(what));
+    }
+    fprintf(g_log, "\n");
+    g_mode = IRQ_RECORD;
+    host_uart_rx_hook(irq_rx_hook);
+    return 0;
+}
+
+/**
+ * @brief: open a log to replay, the clock settings of the recording come back
+ *         in *mhz (0 for the real-time clock) and *baud
+ * @return: 0 on success, -1 if path cannot be read or is not a log
+ * NOTE: call host_irq_replay_start once the clock is set up
+ */
+int host_irq_replay(const char *path, unsigned int *mhz, unsigned int *baud) {
+    g_log = fopen(path, "r");
+    if (g_log == NULL) {
+        perror(path);
+        return -1;
+    }
+    if (fscanf(g_log, "# host_irq mhz %u baud %u at_calls %d costs", mhz, baud, &g_at_calls) != 3) {
+        fprintf(stderr, "%s: not an interrupt log\n", path);
+        return -1;
+    }
+    for (int what = 0; what < HOST_CLK_NUM_COSTS; what++) {
+        unsigned int cycles;
+
+        if (fscanf(g_log, "%u", &cycles) == 1) {
+            host_clk_set_cost(what, cycles);
+        }
+    }
+    g_mode = IRQ_REPLAY;
+    return 0;
+}
+
+/* from here on the line input and SysTick come from the log */
+void host_irq_replay_start(void) {
+    host_uart_line_in(0, 0);
+    irq_read_next();
+}
+
+static void irq_diverge(const char *got) {
+    if (!g_diverged) {
+        fprintf(stderr, "replay diverged after %lu events: at %llu %c got %s, the log has ",
+                g_events, g_pos, g_where, got);
+        if (g_have_next) {
+            fprintf(stderr, "%c at %llu %c (cycle %llu)\n", g_next.kind, g_next.pos,
+                    g_next.where, g_next.cycle);
+        } else {
+            fprintf(stderr, "nothing more\n");
+        }
+    }
+    g_diverged = 1;
+}
+
+/* the logged event that is due here, NULL if none */
+static IRQ_EVENT_T *irq_due(void) {
+    if (!g_have_next || g_diverged || g_next.pos != g_pos || g_next.where != g_where) {
+        return NULL;
+    }
+    if (g_where == 'i') {
+        host_clk_idle_until(g_next.cycle);
+    }
+    if (host_clk_virtual() && g_next.cycle != host_clk_now()) {
+        char got[40];
+
+        snprintf(got, sizeof(got), "cycle %llu", host_clk_now());
+        irq_diverge(got);
+        return NULL;
+    }
+    return &g_next;
+}
+
+/* the C part of SysTick_Handler in k_wait.c, 1 if it has to preempt */
+static int irq_systick(void) {
+    return k_wait_tick();
+}
+
+/* the C part of UART0_IRQHandler in uart_irq.c */
+static int irq_uart0(void) {
+    c_UART0_IRQHandler();
+    return g_switch_flag != 0;
+}
+
+/* exception entry on the running task, then the handler, 1 if it has to preempt */
+static int irq_take(int (*handler)(void)) {
+    host_clk_charge(HOST_CLK_IRQ);
+    host_dwt_sync();
+    return handler();
+}
+
+/* replay: run what the log has for this point, *preempt if the last one asks to */
+static int irq_replay_here(int *preempt) {
+    IRQ_EVENT_T *ev;
+    int taken = 0;
+
+    while (!*preempt && (ev = irq_due()) != NULL) {
+        if (ev->kind == 'r') {
+            host_uart_rx_inject(0, ev->arg);
+        } else if (ev->kind == 't') {
+            *preempt = irq_take(irq_systick);
+        } else if (host_uart_pump(0)) {
+            *preempt = irq_take(irq_uart0);
+        } else {
+            irq_diverge("no UART0 interrupt");
+            return taken;
+        }
+        g_events++;
+        taken++;
+        irq_read_next();
+    }
+    if (!*preempt && host_uart_pump(0) && g_have_next) {
+        irq_diverge("a UART0 interrupt");   /* past the end of the log it is not in the recording */
+    }
+    return taken;
+}
+
+/* live or recording: take whatever is pending, SysTick first, until one asks to preempt */
+static int irq_live_here(int *preempt) {
+    int taken = 0;
+
+    while (!*preempt && host_systick_due()) {
+        if (g_mode == IRQ_RECORD) {
+            irq_log('t', 0);
+        }
+        *preempt = irq_take(irq_systick);
+        taken++;
+    }
+    while (!*preempt && host_uart_pump(0)) {
+        if (g_mode == IRQ_RECORD) {
+            irq_log('u', 0);
+        }
+        *preempt = irq_take(irq_uart0);
+        taken++;
+    }
+    return taken;
+}
+
+/**
+ * @brief: take the interrupts due at this point on the running task
+ * NOTE: A handler that asks to preempt ends the point. Like the target
+ *       handlers it calls k_tsk_preempt last, here outside g_in_irq, since
+ *       the task switched in makes kernel calls of its own before this one
+ *       resumes. The interrupts still pending are taken at the next point.
+ */
+static int irq_here(char where) {
+    int preempt = 0;
+    int taken;
+
+    g_where = where;
+    g_in_irq = 1;
+    taken = g_mode == IRQ_REPLAY ? irq_replay_here(&preempt) : irq_live_here(&preempt);
+    g_in_irq = 0;
+    if (preempt) {
+        k_tsk_preempt();
+    }
+    return taken;
+}
+
+/* a task is entering the kernel, see host_rtx_svc */
+void host_irq_kernel_call(void) {
+    if (g_in_irq) {
+        return;
+    }
+    g_pos++;
+    if (g_at_calls) {
+        irq_here('k');
+    }
+}
+
+/**
+ * @brief: every task is blocked, take the interrupts that are pending now
+ * @return: interrupts taken, -1 when a replay is over or diverged
+ * NOTE: the caller is the null task, which runs the interrupt loop
+ */
+int host_irq_idle(void) {
+    int taken = irq_here('i');
+
+    if (g_mode != IRQ_REPLAY || taken > 0) {
+        return taken;
+    }
+    if (!g_have_next && !g_diverged && host_uart_next(0) != HOST_CLK_NEVER) {
+        return 0;           /* the log is over, let the line drain */
+    }
+    if (g_have_next && !g_diverged) {
+        irq_diverge("every task blocked");
+    }
+    return -1;
+}
+
+/* the cycle of the next interrupt the idle loop can wait for, HOST_CLK_NEVER if none */
+unsigned long long host_irq_next(void) {
+    unsigned long long next = host_uart_next(0);
+
+    if (g_mode == IRQ_REPLAY) {
+        return g_have_next ? g_next.cycle : next;    /* every interrupt is in the log */
+    }
+    if (host_rtx_timed_waiters() > 0 && host_systick_next() < next) {
+        next = host_systick_next();
+    }
+    return next;
+}
+
+/* replay: events matched, and whether the run left the log */
+unsigned long host_irq_replayed(int *diverged) {
+    *diverged = g_diverged;
+    return g_events;
+}
+
+void host_irq_close(void) {
+    if (g_log != NULL) {
+        fclose(g_log);
+        g_log = NULL;
+    }
+}
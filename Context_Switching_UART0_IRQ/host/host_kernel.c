@@ -0,0 +1,61 @@
+/**
+ * @file:   host_kernel.c
+ * @brief:  kernel side of the host port: symbols the kernel sources expect
+ *          from the ARM linker, k_task.c and k_mpu.c
+ */
+
+#include "../src/k_rtx.h"
+#include "../src/k_mpu.h"
+#include "host_port.h"
+
+#define HOST_STR_(x) #x
+#define HOST_STR(x)  HOST_STR_(x)
+
+/* The ARM linker defines the end of the RW/ZI image, k_mem.c starts the heap right after it */
+__asm__(".globl Image$$RW_IRAM1$$ZI$$Limit\n\t"
+        ".set Image$$RW_IRAM1$$ZI$$Limit, " HOST_STR(HOST_IMAGE_LIMIT));
+
+TCB g_host_task;
+/* weak, tools that link k_task.c (rtx_stress.c) get the kernel's own */
+__attribute__((weak)) TCB *gp_current_task = &g_host_task;
+
+/* only the algorithms k_mem.c implements, common.h also names FIXED_POOL, BEST_FIT, WORST_FIT */
+const int g_host_mem_algos[] = {FIRST_FIT};
+const char *g_host_mem_algo_names[] = {"FIRST_FIT"};
+const int g_host_num_mem_algos = sizeof(g_host_mem_algos) / sizeof(g_host_mem_algos[0]);
+
+void host_set_current_tid(int tid) {
+    g_host_task.tid = tid;
+}
+
+/**
+ * @brief: give the current task an unprivileged stack laid out the way
+ *         alloc_user_stack does it and switch its guard on
+ * @return: low end of the stack, NULL if the heap is exhausted
+ */
+void *host_user_stack(int tid, unsigned int size) {
+    char *block = k_mem_alloc(size + MPU_STACK_PAD);
+
+    if (block == NULL) {
+        return NULL;
+    }
+    g_host_task.tid = tid;
+    g_host_task.priv = 0;
+    g_host_task.psp_size = size;
+    g_host_task.psp_hi = (U32 *) (block + MPU_STACK_PAD + size);
+    k_mpu_guard_set(&g_host_task);
+    return block + MPU_STACK_PAD;
+}
+
+/* k_mpu.c for the host, the guard region becomes mprotect'd pages */
+void k_mpu_init(void) {
+    host_guard_protect(0, 0, 0);
+}
+
+void k_mpu_guard_set(TCB *task) {
+    if (task->priv == 0 && task->psp_hi != NULL) {
+        host_guard_protect(MPU_GUARD_BASE(TCB_PSP_LO(task)), MPU_GUARD_SIZE, task->tid);
+    } else {
+        host_guard_protect(0, 0, 0);
+    }
+}
@@ -0,0 +1,127 @@
+/**
+ * @file:   host_port.c
+ * @brief:  C library side of the host port: IRAM1 mapping, timing, the
+ *          mprotect based stand-in for the MPU stack guard and UART1
+ * NOTE: Kernel headers are not included here, see host_port.h.
+ */
+
+#define _GNU_SOURCE
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "host_port.h"
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE MAP_FIXED
+#endif /* ! MAP_FIXED_NOREPLACE */
+
+/**
+ * @brief: map IRAM1 at 0x10000000 so the kernel sees the same addresses as on
+ *         the LPC1768. k_mem.c stores addresses in U32, which is only lossless
+ *         on a 64-bit host because the whole region sits below 4 GB.
+ * @return: 0 on success, -1 if the range is already taken
+ */
+int host_iram_map(void) {
+    static int mapped = 0;
+    void *p;
+
+    if (mapped) {
+        return 0;
+    }
+
+    p = mmap((void *) HOST_IRAM1_BASE, HOST_IRAM1_END - HOST_IRAM1_BASE,
+             PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if (p != (void *) HOST_IRAM1_BASE) {
+        fprintf(stderr, "host_iram_map: cannot map IRAM1 at 0x%x\n", HOST_IRAM1_BASE);
+        return -1;
+    }
+
+    mapped = 1;
+    return 0;
+}
+
+unsigned long long host_time_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ *  MPU guard emulation. mprotect works on whole pages, so a guard only traps
+ *  if it covers at least one page: build with -DMPU_GUARD_SIZE=4096 and an
+ *  IRAM1_END that leaves room for page sized guards. Smaller guards are
+ *  accepted but protect nothing.
+ */
+static unsigned long g_guard_lo;     /* protected pages, [lo, hi) */
+static unsigned long g_guard_hi;
+static int g_guard_tid;
+
+static void host_guard_fault(int sig, siginfo_t *info, void *ctx) {
+    unsigned long addr = (unsigned long) info->si_addr;
+    char msg[96];
+    int len;
+
+    (void) ctx;
+    if (addr >= g_guard_lo && addr < g_guard_hi) {
+        len = snprintf(msg, sizeof(msg), "MemManage fault: task %d hit its stack guard at 0x%lx\n",
+                       g_guard_tid, addr);
+        write(STDERR_FILENO, msg, len);
+        _exit(3);
+    }
+
+    /* an ordinary crash, let it take the default action */
+    signal(sig, SIG_DFL);
+}
+
+/**
+ * @brief: make the pages inside [base, base + len) inaccessible and drop the
+ *         previous guard, like reprogramming the MPU guard region
+ * @return: 0 on success, -1 if mprotect failed
+ */
+int host_guard_protect(unsigned long base, unsigned long len, int tid) {
+    static int installed = 0;
+    unsigned long page = (unsigned long) sysconf(_SC_PAGESIZE);
+    unsigned long lo = (base + page - 1) & ~(page - 1);
+    unsigned long hi = (base + len) & ~(page - 1);
+
+    if (!installed) {
+        struct sigaction sa;
+
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_sigaction = host_guard_fault;
+        sa.sa_flags = SA_SIGINFO;
+        sigaction(SIGSEGV, &sa, NULL);
+        installed = 1;
+    }
+
+    if (g_guard_hi > g_guard_lo) {
+        mprotect((void *) g_guard_lo, g_guard_hi - g_guard_lo, PROT_READ | PROT_WRITE);
+    }
+    g_guard_lo = g_guard_hi = 0;
+
+    if (len == 0 || hi <= lo) {
+        return 0;
+    }
+    if (mprotect((void *) lo, hi - lo, PROT_NONE) != 0) {
+        perror("host_guard_protect");
+        return -1;
+    }
+    g_guard_lo = lo;
+    g_guard_hi = hi;
+    g_guard_tid = tid;
+    return 0;
+}
+
+/* uart_polling.c: UART1 carries the kernel's fault lines, stderr here */
+int uart_put_char(int n_uart, char c) {
+    return fputc(c, stderr);
+}
+
+int uart_put_string(int n_uart, char *s) {
+    fputs(s, stderr);
+    return 0;
+}
@@ -0,0 +1,154 @@
+/**
+ * @file:   host_port.h
+ * @brief:  host (Linux) port of the kernel, shared by the host tools in this directory
+ * NOTE: This header must not include common.h. The kernel typedefs size_t and
+ *       defines NULL itself, which clashes with the C library the host tools use.
+ *       Kernel entry points the tools need are redeclared here with plain C types.
+ */
+
+#ifndef HOST_PORT_H_
+#define HOST_PORT_H_
+
+/* ----- Definitions ----- */
+#define HOST_IRAM1_BASE  0x10000000   /* IRAM1 is mapped at its target address   */
+#ifdef IRAM1_END
+#define HOST_IRAM1_END   IRAM1_END    /* same -D the kernel sources see          */
+#else
+#define HOST_IRAM1_END   0x10008000   /* must match IRAM1_END in k_mem.h         */
+#endif /* IRAM1_END */
+
+#ifndef HOST_IMAGE_LIMIT
+#define HOST_IMAGE_LIMIT 0x10002588   /* Image$$RW_IRAM1$$ZI$$Limit of the CS SIM build */
+#endif /* ! HOST_IMAGE_LIMIT */
+
+/* ----- Host services ----- */
+int host_iram_map(void);                 /* map IRAM1, returns 0 on success */
+unsigned long long host_time_ns(void);   /* monotonic clock in ns           */
+void host_set_current_tid(int tid);      /* task the kernel sees as running */
+int host_guard_protect(unsigned long base, unsigned long len, int tid);
+                                         /* MPU guard emulation, len 0 clears */
+void *host_user_stack(int tid, unsigned int size);
+                                         /* guarded stack for the current task */
+
+/* ----- Task model of host_hal.c, host_ctx.c: a ucontext per task, no threads ----- */
+void host_ctx_switch(int old_tid, int new_tid, void (*start)(void));
+                                         /* start != NULL: new_tid starts afresh */
+void host_ctx_start(int tid, void (*start)(void));
+                                         /* the caller's context is abandoned  */
+void host_hal_init(void (*idle)(void));  /* what the null task runs            */
+void host_dwt_sync(void);                /* DWT->CYCCNT = host_clk_now()       */
+
+/* ----- Clock, host_clock.c: CPU cycles, SysTick and the cost model ----- */
+#define HOST_CLK_NEVER     (~0ULL)       /* no event pending                     */
+
+#define HOST_CLK_SVC       0             /* what host_clk_charge charges for     */
+#define HOST_CLK_SWITCH    1
+#define HOST_CLK_IRQ       2
+#define HOST_CLK_BUS       3
+#define HOST_CLK_WORK      4
+#define HOST_CLK_NUM_COSTS 5
+
+void host_clk_init(unsigned int cpu_mhz, int virt);
+int  host_clk_virtual(void);
+unsigned long long host_clk_hz(void);
+unsigned long long host_clk_now(void);   /* cycles since host_clk_init           */
+unsigned long long host_clk_ns(unsigned long long cycles);
+unsigned long long host_clk_busy(void);
+unsigned int host_clk_cost(int what);
+void host_clk_set_cost(int what, unsigned int cycles);
+void host_clk_charge(int what);
+void host_clk_idle_until(unsigned long long cycle);
+int  host_systick_due(void);             /* consumes one due SysTick interrupt   */
+unsigned long long host_systick_next(void);
+
+/* ----- UART0/UART1 emulation, host_uart.c ----- */
+typedef struct host_uart_stats {
+    unsigned long rx_bytes;              /* moved from the line into the RX FIFO */
+    unsigned long tx_bytes;              /* moved from the TX FIFO to the line   */
+    unsigned long tx_overruns;           /* THR writes with the TX FIFO full     */
+    unsigned long rx_overruns;           /* characters lost to a full RX FIFO    */
+    unsigned long irqs;                  /* host_uart_pump returned 1            */
+} HOST_UART_STATS;
+
+int  host_uart_map(void);                /* map the registers, 0 on success      */
+void host_uart_attach(int n, int fd);    /* the line of UART n, -1 detaches      */
+int  host_uart_wake_fd(void);            /* readable when a pump is due          */
+int  host_uart_pump(int n);              /* 1 if UART n's interrupt is asserted  */
+unsigned long long host_uart_next(int n);/* cycle of the next line event         */
+unsigned int host_uart_baud(int n, unsigned int baud);
+                                         /* 0 keeps the divisor's rate, returns it */
+void host_uart_stats(int n, HOST_UART_STATS *st);
+void host_uart_rx_hook(void (*hook)(int n, int c));
+                                         /* called as each byte enters an RX FIFO */
+void host_uart_rx_inject(int n, int c);  /* put c into the RX FIFO now           */
+void host_uart_line_in(int n, int on);   /* 0: stop reading UART n's line        */
+
+/* ----- Interrupts, host_irq.c: where they are taken, record and replay ----- */
+void host_irq_init(int at_calls);        /* 1: also at every kernel call         */
+int  host_irq_record(const char *path, unsigned int mhz, unsigned int baud);
+int  host_irq_replay(const char *path, unsigned int *mhz, unsigned int *baud);
+void host_irq_replay_start(void);
+void host_irq_kernel_call(void);         /* a task enters the kernel             */
+int  host_irq_idle(void);                /* every task blocked, -1: replay over  */
+unsigned long long host_irq_next(void);  /* cycle the idle loop can wait for     */
+unsigned long host_irq_replayed(int *diverged);
+void host_irq_close(void);
+
+/* ----- Kernel invariants and calls with kernel types, host_check.c ----- */
+const char *host_check_kernel(const int *user_blocks, const unsigned char *alloc_wait, int *tid);
+                                         /* NULL if they hold, else the violation */
+int  host_tsk_boot(void (*entry)(void), int prio, int u_stack_size, int max_tasks);
+int  host_tsk_create_ex(unsigned char *tid, void (*entry)(void), int prio,
+                        int u_stack_size, int k_stack_size);
+int  host_tsk_current(void);             /* TID of the running task              */
+int  host_tsk_max(void);                 /* size of the TCB table                */
+int  host_tsk_state(int tid);            /* -1 outside the TCB table             */
+int  host_tsk_has_mailbox(int tid);
+int  host_tsk_live(void);                /* tasks not DORMANT, null task included */
+void host_tsk_cycles(unsigned int cycles);
+                                         /* advance DWT->CYCCNT                  */
+
+/* ----- Memory algorithms implemented by k_mem_init, FIRST_FIT first ----- */
+extern const int g_host_mem_algos[];
+extern const char *g_host_mem_algo_names[];
+extern const int g_host_num_mem_algos;
+
+/* ----- Kernel entry points ----- */
+int k_mem_init(unsigned int blk_size, int algo);
+void *k_mem_alloc(unsigned int size);
+int k_mem_dealloc(void *ptr);
+int k_mem_count_extfrag(unsigned int size);
+void *k_mem_alloc_wait(unsigned int size, unsigned int timeout);
+void *k_mem_alloc_fair(unsigned int size);
+int k_mem_dealloc_wake(void *ptr);
+
+/* k_task.c, k_msg.c, k_evt.c, k_wait.c: the scheduler itself, see rtx_stress.c */
+int  k_tsk_create(unsigned char *tid, void (*entry)(void), unsigned char prio, unsigned short stack_size);
+void k_tsk_exit(void);
+int  k_tsk_yield(void);
+int  k_tsk_preempt(void);
+int  k_tsk_set_prio(unsigned char tid, unsigned char prio);
+int  k_tsk_delay(unsigned int ticks);
+int  k_mbx_create(unsigned int size);
+int  k_send_msg(unsigned char tid, const void *buf);
+int  k_send_msg_isr(unsigned char tid, const void *buf);
+int  k_recv_msg(unsigned char *sender_tid, void *buf, unsigned int len);
+int  k_evt_set(unsigned char tid, unsigned int flags);
+int  k_evt_set_isr(unsigned char tid, unsigned int flags);
+int  k_evt_wait(unsigned int flags, unsigned char opt, unsigned int timeout, unsigned int *got);
+int  k_wait_tick(void);
+
+/* host_rtx.c, the SVC entry of the console pipeline's RTX calls */
+int  host_rtx_init(unsigned int blk_size);
+                                         /* boots the display and KCD tasks, never returns on success */
+unsigned long host_rtx_isr_drops(void);  /* g_msg_isr_drops                      */
+int  host_rtx_timed_waiters(void);
+
+/* the console pipeline itself, built from ../src */
+extern unsigned int g_switch_flag;       /* uart_irq.c, UART0_IRQHandler preempts if set */
+int  uart_irq_init(int n_uart);
+void c_UART0_IRQHandler(void);
+void kcd_task(void);
+void lcd_task(void);
+
+#endif /* ! HOST_PORT_H_ */
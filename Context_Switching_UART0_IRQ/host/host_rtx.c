@@ -0,0 +1,136 @@
+/**
+ * @file:   host_rtx.c
+ * @brief:  SVC entry of the host port: the RTX calls the console pipeline
+ *          (kcd_task.c, lcd_task.c, console.c) makes, and its boot
+ * NOTE: On the target every call traps into SVC_Handler, which dispatches
+ *       through g_svc_table. Here each call runs the same kernel function
+ *       directly, on the real scheduler (k_task.c through host_hal.c and
+ *       host_ctx.c), so nothing of the kernel is modelled in this file.
+ *       The svc_ptr_ok checks of k_svc.c are left out: task buffers live on
+ *       C library stacks outside IRAM1, which the target memory map has no
+ *       place for. Before the call the entry charges the task's work and
+ *       the SVC to the clock (host_clock.c) and takes the interrupts
+ *       pending by then (host_irq.c), which may switch tasks, exactly as an
+ *       interrupt taken just before the SVC instruction would.
+ */
+
+#include "../src/rtx.h"
+#include "../src/k_rtx.h"
+#include "../src/k_rtx_init.h"
+#include "../src/k_mem.h"
+#include "../src/k_task.h"
+#include "../src/k_msg.h"
+#include "../src/k_evt.h"
+#include "host_port.h"
+
+extern TCB *g_timer_head;
+extern U32 g_msg_isr_drops;
+
+/* SVC_Handler: the task code since the last call, pending interrupts, the trap */
+static void host_rtx_svc(void) {
+    host_clk_charge(HOST_CLK_WORK);
+    host_irq_kernel_call();
+    host_clk_charge(HOST_CLK_SVC);
+    host_dwt_sync();
+}
+
+/**
+ * @brief: rtx_init_cfg with the display and KCD tasks of main_svc.c, the
+ *         null task runs host_hal_init's idle function
+ * @return: RTX_ERR if the kernel did not start, on success it never returns
+ */
+int host_rtx_init(unsigned int blk_size) {
+    RTX_TASK_INFO tasks[2] = {{0}};
+    RTX_CONFIG cfg;
+
+    tasks[0].ptask = &lcd_task;
+    tasks[0].prio = HIGH;
+    tasks[0].priv = 1;
+    tasks[1].ptask = &kcd_task;
+    tasks[1].u_stack_size = 0x100;
+    tasks[1].prio = HIGH;
+    tasks[1].priv = 0;
+
+    cfg.blk_size = blk_size;
+    cfg.algo = FIRST_FIT;
+    cfg.max_tasks = MAX_TASKS;
+    host_dwt_sync();
+    return k_rtx_init_cfg(&cfg, tasks, 2);
+}
+
+/* a task waits with a timeout, the clock must not stop while there are any */
+int host_rtx_timed_waiters(void) {
+    return g_timer_head != NULL;
+}
+
+/* KEY_INs the UART0 IRQ could not queue, see k_send_msg_isr */
+unsigned long host_rtx_isr_drops(void) {
+    return g_msg_isr_drops;
+}
+
+/* ----- the user API, the g_svc_table entries ----- */
+void *mem_alloc(size_t size) {
+    host_rtx_svc();
+    return k_mem_alloc_fair(size);
+}
+
+int mem_dealloc(void *ptr) {
+    host_rtx_svc();
+    return k_mem_dealloc_wake(ptr);
+}
+
+/* the host builds k_mem.c without MEM_TRACE, SVC_Handler returns RTX_ERR for the empty slot */
+int mem_trace_dump(void) {
+    host_rtx_svc();
+    return RTX_ERR;
+}
+
+void tsk_exit(void) {
+    host_rtx_svc();
+    k_tsk_exit();
+}
+
+int tsk_delay(U32 ticks) {
+    host_rtx_svc();
+    return k_tsk_delay(ticks);
+}
+
+int tsk_stats(RTX_TASK_STATS *buf, int count) {
+    host_rtx_svc();
+    return k_tsk_stats(buf, count);
+}
+
+int mbx_create(size_t size) {
+    host_rtx_svc();
+    return k_mbx_create(size);
+}
+
+int send_msg(task_t tid, const void *buf) {
+    host_rtx_svc();
+    return k_send_msg(tid, buf);
+}
+
+int recv_msg(task_t *sender_tid, void *buf, size_t len) {
+    host_rtx_svc();
+    return k_recv_msg(sender_tid, buf, len);
+}
+
+int mbx_stats(RTX_MBX_STATS *buf, int count) {
+    host_rtx_svc();
+    return k_mbx_stats(buf, count);
+}
+
+int evt_set(task_t tid, U32 flags) {
+    host_rtx_svc();
+    return k_evt_set(tid, flags);
+}
+
+int evt_clear(U32 flags) {
+    host_rtx_svc();
+    return k_evt_clear(flags);
+}
+
+int evt_wait(U32 flags, U8 opt, U32 timeout, U32 *got) {
+    host_rtx_svc();
+    return k_evt_wait(flags, opt, timeout, got);
+}
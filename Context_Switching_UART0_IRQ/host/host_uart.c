@@ -0,0 +1,517 @@
+/**
+ * @file:   host_uart.c
+ * @brief:  UART0/UART1 emulation for the host port, the registers behave like
+ *          the LPC1768's 16550 compatible UARTs and the line is a file
+ *          descriptor (a pty master or one end of a socketpair)
+ * NOTE: The register blocks are mapped at their target addresses with no
+ *       access. Every driver access faults, the SIGSEGV handler applies the
+ *       register's side effect (RBR pops the RX FIFO, reading IIR clears a
+ *       THRE interrupt, THR pushes the TX FIFO, ...), opens the page and sets
+ *       the trap flag, and the SIGTRAP after that one instruction closes it
+ *       again. So uart_irq.c and console.c run unchanged. x86-64 Linux only.
+ *       With the real-time clock the line runs at full speed, a pump moves
+ *       the whole TX FIFO out and tops the RX FIFO up. With the virtual clock
+ *       (host_clock.c) each character takes its time on the wire at the baud
+ *       rate the driver programmed into DLL/DLM/FDR: TX bytes go through the
+ *       shift register one by one and raise THRE as the FIFO empties, RX
+ *       bytes arrive one per character time and are lost to a full FIFO.
+ *       Registers are only touched from the one host thread, the tasks are
+ *       contexts of it (host_ctx.c).
+ *       Under gdb: handle SIGSEGV nostop noprint pass.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "LPC17xx.h"
+#include "../src/uart_def.h"
+#include "host_port.h"
+
+#ifndef __x86_64__
+#error "host_uart.c single-steps register accesses with the x86-64 trap flag"
+#endif /* ! __x86_64__ */
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE MAP_FIXED
+#endif /* ! MAP_FIXED_NOREPLACE */
+
+/* ----- Definitions ----- */
+#define UART_FIFO      16
+#define UART_LINE      256         /* bytes read from the line ahead of the receiver */
+#define UART_PAGE      0x1000
+#define UART_FDR_RESET 0x10        /* MulVal 1, DivAddVal 0 */
+#define UART_IER_MASK  (IER_RBR | IER_THRE | IER_RLS)
+#define UART_LCR_DLAB  0x80
+#define UART_FCR_RXRST 0x02
+#define UART_FCR_TXRST 0x04
+#define UART_IIR_FIFO  0xC0        /* FIFOs enabled */
+#define X86_EFL_TF     0x100
+#define X86_PF_WRITE   0x2         /* page fault error code: write access */
+
+#define REG(name) offsetof(LPC_UART_TypeDef, name)
+
+typedef struct host_uart {
+    unsigned long base;             /* target address of the register block */
+    volatile uint8_t *page;
+    uint8_t  rx[UART_FIFO];
+    int      rx_head;
+    int      rx_count;
+    uint8_t  tx[UART_FIFO];
+    int      tx_count;
+    uint8_t  ier;
+    uint8_t  lcr;
+    uint8_t  dll;
+    uint8_t  dlm;
+    uint8_t  fdr;
+    /* virtual clock only */
+    unsigned int baud;              /* set by host_uart_baud, 0 to follow the divisor */
+    uint8_t  tx_shift;              /* byte in the transmit shift register */
+    int      tx_busy;
+    unsigned long long tx_due;      /* cycle tx_shift is out */
+    uint8_t  line[UART_LINE];       /* read from the fd, not yet received */
+    int      line_head;
+    int      line_count;
+    int      rx_active;
+    unsigned long long rx_due;      /* cycle the next line byte is received */
+    int      thre_pending;          /* THRE interrupt raised and not yet acknowledged */
+    int      nvic;                  /* NVIC_EnableIRQ was called */
+    int      fd;                    /* the line, -1 if nothing is attached */
+    int      no_line_in;            /* host_uart_line_in(n, 0): the fd is output only */
+    HOST_UART_STATS st;
+} HOST_UART_T;
+
+LPC_PINCON_TypeDef g_host_pincon;
+
+static HOST_UART_T g_uart[2] = {
+    { .base = LPC_UART0_BASE, .fd = -1, .fdr = UART_FDR_RESET },
+    { .base = LPC_UART1_BASE, .fd = -1, .fdr = UART_FDR_RESET },
+};
+static int g_wake[2] = {-1, -1};    /* pipe, readable after a register write that needs a pump */
+
+/* the access being single-stepped */
+static HOST_UART_T *g_step_uart;
+static unsigned long g_step_off;
+static int g_step_write;
+
+static struct sigaction g_prev_segv;
+static void (*g_rx_hook)(int n, int c);
+
+static HOST_UART_T *uart_at(unsigned long addr) {
+    for (int n = 0; n < 2; n++) {
+        if (addr >= g_uart[n].base && addr < g_uart[n].base + UART_PAGE) {
+            return &g_uart[n];
+        }
+    }
+    return NULL;
+}
+
+static void uart_wake(void) {
+    if (g_wake[1] >= 0) {
+        (void) !write(g_wake[1], "", 1);
+    }
+}
+
+/* cycles one character (start, 8 data, stop) takes on the wire */
+static unsigned long long uart_char_cycles(HOST_UART_T *u) {
+    unsigned int div = (u->dlm << 8) | u->dll;
+    unsigned int mul = u->fdr >> 4;
+    unsigned int add = u->fdr & 0x0F;
+
+    if (u->baud != 0) {
+        return host_clk_hz() * 10 / u->baud;
+    }
+    if (div == 0) {
+        div = 1;
+    }
+    if (mul == 0) {
+        mul = 1;
+        add = 0;
+    }
+    /* baud = PCLK / (16 * div * (1 + add / mul)) with PCLK = CCLK / 4 */
+    return 10ULL * 4 * 16 * div * (mul + add) / mul;
+}
+
+/* move the oldest TX FIFO byte into the shift register at cycle start */
+static void uart_tx_shift(HOST_UART_T *u, unsigned long long start) {
+    u->tx_shift = u->tx[0];
+    memmove(u->tx, u->tx + 1, --u->tx_count);
+    u->tx_busy = 1;
+    u->tx_due = start + uart_char_cycles(u);
+    if (u->tx_count == 0) {
+        u->thre_pending = 1;
+    }
+}
+
+static uint32_t uart_iir(HOST_UART_T *u) {
+    if ((u->ier & IER_RBR) && u->rx_count > 0) {
+        return UART_IIR_FIFO | IIR_RDA << 1;
+    }
+    if ((u->ier & IER_THRE) && u->thre_pending) {
+        return UART_IIR_FIFO | IIR_THRE << 1;
+    }
+    return UART_IIR_FIFO | IIR_PEND;     /* bit 0 set: nothing pending */
+}
+
+static void reg_put32(HOST_UART_T *u, unsigned long off, uint32_t val) {
+    memcpy((void *) (u->page + off), &val, sizeof(val));
+}
+
+/* before the access: put the value a read must see into the page */
+static void uart_prepare(HOST_UART_T *u, unsigned long off, int write) {
+    int dlab = u->lcr & UART_LCR_DLAB;
+
+    if (off == REG(RBR)) {
+        uint32_t val = dlab ? u->dll : 0;
+
+        if (!dlab && !write && u->rx_count > 0) {
+            val = u->rx[u->rx_head];
+            u->rx_head = (u->rx_head + 1) % UART_FIFO;
+            u->rx_count--;
+        }
+        reg_put32(u, off, val);
+    } else if (off == REG(IER)) {
+        reg_put32(u, off, dlab ? u->dlm : u->ier);     /* IER |= x reads it first */
+    } else if (off == REG(IIR) && !write) {
+        uint32_t iir = uart_iir(u);
+
+        if ((iir & 0x0F) == IIR_THRE << 1) {
+            u->thre_pending = 0;    /* reading IIR acknowledges a THRE interrupt */
+        }
+        reg_put32(u, off, iir);
+    } else if (off == REG(LSR) && !write) {
+        uint8_t lsr = 0;
+
+        if (u->rx_count > 0) {
+            lsr |= LSR_RDR;
+        }
+        if (u->tx_count == 0) {
+            lsr |= u->tx_busy ? LSR_THRE : LSR_THRE | LSR_TEMT;
+        }
+        u->page[off] = lsr;
+    } else if (off == REG(FIFOLVL) && !write) {
+        u->page[off] = (uint8_t) u->rx_count;
+    }
+}
+
+/* after a write: apply what the driver stored in the page */
+static void uart_commit(HOST_UART_T *u, unsigned long off) {
+    int dlab = u->lcr & UART_LCR_DLAB;
+    uint8_t val = u->page[off];
+
+    if (off == REG(THR)) {
+        if (dlab) {
+            u->dll = val;
+        } else if (u->tx_count < UART_FIFO) {
+            u->tx[u->tx_count++] = val;
+            u->thre_pending = 0;
+            if (host_clk_virtual() && !u->tx_busy) {
+                uart_tx_shift(u, host_clk_now());
+            }
+            uart_wake();
+        } else {
+            u->st.tx_overruns++;
+        }
+    } else if (off == REG(IER)) {
+        if (dlab) {
+            u->dlm = val;
+        } else {
+            uint8_t old = u->ier;
+
+            u->ier = val & UART_IER_MASK;
+            if (!(old & IER_THRE) && (u->ier & IER_THRE) && u->tx_count == 0) {
+                u->thre_pending = 1;    /* enabling THRE with the FIFO empty raises it */
+            }
+            uart_wake();
+        }
+    } else if (off == REG(FCR)) {
+        if (val & UART_FCR_RXRST) {
+            u->rx_count = 0;
+        }
+        if (val & UART_FCR_TXRST) {
+            u->tx_count = 0;
+        }
+    } else if (off == REG(LCR)) {
+        u->lcr = val;
+    } else if (off == REG(FDR)) {
+        u->fdr = val;
+    }
+}
+
+static void uart_fault(int sig, siginfo_t *info, void *ctx) {
+    ucontext_t *uc = ctx;
+    unsigned long addr = (unsigned long) info->si_addr;
+    HOST_UART_T *u = uart_at(addr);
+
+    if (u == NULL || g_step_uart != NULL) {
+        /* not ours, hand it to whoever was there before (the stack guard) */
+        if (g_prev_segv.sa_flags & SA_SIGINFO) {
+            g_prev_segv.sa_sigaction(sig, info, ctx);
+        } else {
+            signal(sig, SIG_DFL);
+        }
+        return;
+    }
+
+    host_clk_charge(HOST_CLK_BUS);
+    g_step_uart = u;
+    g_step_off = (addr - u->base) & ~3UL;
+    g_step_write = (uc->uc_mcontext.gregs[REG_ERR] & X86_PF_WRITE) != 0;
+    mprotect((void *) u->page, UART_PAGE, PROT_READ | PROT_WRITE);
+    uart_prepare(u, g_step_off, g_step_write);
+    uc->uc_mcontext.gregs[REG_EFL] |= X86_EFL_TF;
+}
+
+static void uart_step(int sig, siginfo_t *info, void *ctx) {
+    ucontext_t *uc = ctx;
+    HOST_UART_T *u = g_step_uart;
+
+    (void) sig;
+    (void) info;
+    uc->uc_mcontext.gregs[REG_EFL] &= ~X86_EFL_TF;
+    if (u == NULL) {
+        return;
+    }
+    if (g_step_write) {
+        uart_commit(u, g_step_off);
+    }
+    mprotect((void *) u->page, UART_PAGE, PROT_NONE);
+    g_step_uart = NULL;
+}
+
+/**
+ * @brief: map the UART0 and UART1 register blocks and install the trap handlers
+ * @return: 0 on success, -1 on failure
+ * NOTE: call it after anything else that installs a SIGSEGV handler, the
+ *       handler here passes faults outside the registers on.
+ */
+int host_uart_map(void) {
+    struct sigaction sa;
+
+    if (g_uart[0].page != NULL) {
+        return 0;
+    }
+
+    for (int n = 0; n < 2; n++) {
+        void *p = mmap((void *) g_uart[n].base, UART_PAGE, PROT_NONE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+        if (p != (void *) g_uart[n].base) {
+            fprintf(stderr, "host_uart_map: cannot map UART%d at 0x%lx\n", n, g_uart[n].base);
+            return -1;
+        }
+        g_uart[n].page = p;
+    }
+
+    if (pipe2(g_wake, O_NONBLOCK | O_CLOEXEC) != 0) {
+        perror("host_uart_map");
+        return -1;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = uart_fault;
+    sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sigaction(SIGSEGV, &sa, &g_prev_segv);
+    sa.sa_sigaction = uart_step;
+    sigaction(SIGTRAP, &sa, NULL);
+    return 0;
+}
+
+/* connect UART n to the line fd, which is switched to non-blocking */
+void host_uart_attach(int n, int fd) {
+    if (fd >= 0) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+    g_uart[n].fd = fd;
+}
+
+/* readable when a register write asks for host_uart_pump */
+int host_uart_wake_fd(void) {
+    return g_wake[0];
+}
+
+static void uart_line_out(HOST_UART_T *u, const uint8_t *buf, int len) {
+    int off = 0;
+
+    while (u->fd >= 0 && off < len) {
+        ssize_t w = write(u->fd, buf + off, len - off);
+        if (w < 0 && errno == EAGAIN) {
+            continue;           /* the reader is slow, the line waits for it */
+        }
+        if (w <= 0) {
+            break;
+        }
+        off += w;
+    }
+    u->st.tx_bytes += len;
+}
+
+/* a byte received off the line, PRE: the RX FIFO has room */
+static void uart_rx_put(HOST_UART_T *u, uint8_t c) {
+    u->rx[(u->rx_head + u->rx_count++) % UART_FIFO] = c;
+    if (g_rx_hook != NULL) {
+        g_rx_hook((int) (u - g_uart), c);
+    }
+}
+
+/* full line rate: the whole TX FIFO goes out, the RX FIFO is topped up */
+static void uart_pump_now(HOST_UART_T *u) {
+    if (u->tx_count > 0) {
+        uart_line_out(u, u->tx, u->tx_count);
+        u->tx_count = 0;
+        u->thre_pending = 1;
+    }
+
+    if (u->fd >= 0 && !u->no_line_in && u->rx_count < UART_FIFO) {
+        uint8_t buf[UART_FIFO];
+        ssize_t r = read(u->fd, buf, UART_FIFO - u->rx_count);
+
+        for (ssize_t i = 0; i < r; i++) {
+            uart_rx_put(u, buf[i]);
+        }
+        if (r > 0) {
+            u->st.rx_bytes += r;
+        }
+    }
+}
+
+/* virtual clock: every character that finished by now, on either wire */
+static void uart_pump_timed(HOST_UART_T *u) {
+    unsigned long long now = host_clk_now();
+
+    while (u->tx_busy && u->tx_due <= now) {
+        uart_line_out(u, &u->tx_shift, 1);
+        u->tx_busy = 0;
+        if (u->tx_count > 0) {
+            uart_tx_shift(u, u->tx_due);
+        }
+    }
+    if (!u->tx_busy && u->tx_count > 0) {
+        uart_tx_shift(u, now);
+    }
+
+    if (u->fd >= 0 && !u->no_line_in && u->line_count < UART_LINE) {
+        uint8_t buf[UART_LINE];
+        ssize_t r = read(u->fd, buf, UART_LINE - u->line_count);
+
+        for (ssize_t i = 0; i < r; i++) {
+            u->line[(u->line_head + u->line_count++) % UART_LINE] = buf[i];
+        }
+    }
+    if (!u->rx_active && u->line_count > 0) {
+        u->rx_active = 1;
+        u->rx_due = now + uart_char_cycles(u);
+    }
+    while (u->rx_active && u->rx_due <= now) {
+        uint8_t c = u->line[u->line_head];
+
+        u->line_head = (u->line_head + 1) % UART_LINE;
+        u->line_count--;
+        u->st.rx_bytes++;
+        if (u->rx_count < UART_FIFO) {
+            uart_rx_put(u, c);
+        } else {
+            u->st.rx_overruns++;
+        }
+        if (u->line_count == 0) {
+            u->rx_active = 0;
+        } else {
+            u->rx_due += uart_char_cycles(u);
+        }
+    }
+}
+
+/**
+ * @brief: move bytes between the FIFOs and the line, see the NOTE at the top
+ * @return: 1 if UART n's interrupt is asserted and enabled in the NVIC
+ * NOTE: the caller is the interrupt loop or a task's kernel call
+ */
+int host_uart_pump(int n) {
+    HOST_UART_T *u = &g_uart[n];
+    char drain[64];
+
+    while (read(g_wake[0], drain, sizeof(drain)) > 0) {
+        ;
+    }
+
+    if (host_clk_virtual()) {
+        uart_pump_timed(u);
+    } else {
+        uart_pump_now(u);
+    }
+
+    if (u->nvic && (uart_iir(u) & IIR_PEND) == 0) {
+        u->st.irqs++;
+        return 1;
+    }
+    return 0;
+}
+
+/* virtual clock: the cycle of UART n's next character, HOST_CLK_NEVER if the line is quiet */
+unsigned long long host_uart_next(int n) {
+    HOST_UART_T *u = &g_uart[n];
+    unsigned long long next = HOST_CLK_NEVER;
+
+    if (!host_clk_virtual()) {
+        return HOST_CLK_NEVER;
+    }
+    if (u->tx_busy) {
+        next = u->tx_due;
+    }
+    if (u->rx_active && u->rx_due < next) {
+        next = u->rx_due;
+    }
+    return next;
+}
+
+/**
+ * @brief: run UART n's line at baud instead of the rate its divisor gives
+ * @return: the baud rate the line runs at, virtual clock only
+ */
+unsigned int host_uart_baud(int n, unsigned int baud) {
+    g_uart[n].baud = baud;
+    return (unsigned int) (host_clk_hz() * 10 / uart_char_cycles(&g_uart[n]));
+}
+
+void host_uart_stats(int n, HOST_UART_STATS *st) {
+    *st = g_uart[n].st;
+}
+
+/* hook(n, c) runs as byte c enters UART n's RX FIFO from the line, NULL removes it */
+void host_uart_rx_hook(void (*hook)(int n, int c)) {
+    g_rx_hook = hook;
+}
+
+/* byte c arrives in UART n's RX FIFO now, lost if the FIFO is full */
+void host_uart_rx_inject(int n, int c) {
+    HOST_UART_T *u = &g_uart[n];
+
+    u->st.rx_bytes++;
+    if (u->rx_count < UART_FIFO) {
+        u->rx[(u->rx_head + u->rx_count++) % UART_FIFO] = (uint8_t) c;
+    } else {
+        u->st.rx_overruns++;
+    }
+}
+
+/* on 0: UART n only writes its line, input comes from host_uart_rx_inject */
+void host_uart_line_in(int n, int on) {
+    g_uart[n].no_line_in = !on;
+}
+
+void NVIC_EnableIRQ(IRQn_Type irq) {
+    if (irq == UART0_IRQn || irq == UART1_IRQn) {
+        g_uart[irq - UART0_IRQn].nvic = 1;
+    }
+}
+
+void NVIC_DisableIRQ(IRQn_Type irq) {
+    if (irq == UART0_IRQn || irq == UART1_IRQn) {
+        g_uart[irq - UART0_IRQn].nvic = 0;
+    }
+}
@@ -0,0 +1,371 @@
+/**
+ * @file:   mem_bench.c
+ * @brief:  allocator micro-benchmark and fragmentation stress harness
+ * NOTE: Replays synthetic or recorded alloc/dealloc traces against every
+ *       algorithm k_mem_init implements and reports ops/sec, worst-case op
+ *       time, peak external fragmentation and time to first failure.
+ *
+ *       Build and run from this directory:
+ *         gcc -O2 -no-pie -o mem_bench mem_bench.c host_port.c host_kernel.c ../src/k_mem.c
+ *         ./mem_bench                      (all synthetic workloads)
+ *         ./mem_bench -t trace.txt         (recorded trace)
+ *
+ *       -no-pie is needed because Image$$RW_IRAM1$$ZI$$Limit is an absolute symbol.
+ *
+ *       Trace file format, one operation per line, '#' starts a comment:
+ *         a <slot> <size>    allocate size bytes and remember it in slot
+ *         d <slot>           deallocate the block remembered in slot
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host_port.h"
+
+/* ----- Definitions ----- */
+#define MAX_SLOTS     1024      /* live blocks a trace can reference   */
+#define MAX_OPS       1000000   /* longest trace the harness will hold */
+#define DEF_OPS       20000     /* synthetic trace length              */
+#define DEF_BLK_SIZE  4         /* blk_size passed to k_mem_init       */
+#define DEF_FRAG_SIZE 256       /* free blocks below this are fragments */
+
+typedef struct trace_op {
+    char op;                    /* 'a' or 'd' */
+    int  slot;
+    unsigned int size;
+} TRACE_OP_T;
+
+typedef struct bench_result {
+    int    ops;                 /* operations actually issued          */
+    int    failed_allocs;
+    unsigned long long total_ns;
+    unsigned long long worst_ns;
+    int    worst_op;
+    int    peak_extfrag;
+    int    first_fail_op;       /* -1 if nothing failed                */
+    unsigned long long first_fail_ns;
+} BENCH_RESULT_T;
+
+static TRACE_OP_T g_trace[MAX_OPS];
+static int g_num_ops;
+static void *g_slots[MAX_SLOTS];
+static unsigned int g_rand_state;
+
+/* xorshift32, so synthetic traces are identical on every libc */
+static unsigned int rand_next(void) {
+    unsigned int x = g_rand_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    g_rand_state = x;
+    return x;
+}
+
+static unsigned int rand_range(unsigned int lo, unsigned int hi) {
+    return lo + rand_next() % (hi - lo + 1);
+}
+
+static void trace_push(char op, int slot, unsigned int size) {
+    if (g_num_ops < MAX_OPS) {
+        g_trace[g_num_ops].op = op;
+        g_trace[g_num_ops].slot = slot;
+        g_trace[g_num_ops].size = size;
+        g_num_ops++;
+    }
+}
+
+/*
+ *  Synthetic workloads. Each generator tracks which slots are live so the
+ *  trace it produces never frees a slot twice.
+ */
+
+/* uniformly random sizes, random alloc/free mix around a live-set target */
+static void gen_random(int num_ops) {
+    char live[MAX_SLOTS] = {0};
+    int num_live = 0;
+
+    while (g_num_ops < num_ops) {
+        int slot = rand_next() % MAX_SLOTS;
+        if (!live[slot] && (num_live < 64 || rand_next() % 2)) {
+            trace_push('a', slot, rand_range(1, 512));
+            live[slot] = 1;
+            num_live++;
+        } else if (live[slot]) {
+            trace_push('d', slot, 0);
+            live[slot] = 0;
+            num_live--;
+        }
+    }
+}
+
+/* LIFO: nested scratch buffers released in reverse order */
+static void gen_lifo(int num_ops) {
+    int depth = 0;
+
+    while (g_num_ops < num_ops) {
+        if (depth == 0 || (depth < MAX_SLOTS && rand_next() % 3 != 0)) {
+            trace_push('a', depth, rand_range(8, 256));
+            depth++;
+        } else {
+            depth--;
+            trace_push('d', depth, 0);
+        }
+    }
+}
+
+/* FIFO: message-buffer style, released in allocation order */
+static void gen_fifo(int num_ops) {
+    int head = 0;
+    int tail = 0;
+
+    while (g_num_ops < num_ops) {
+        if (tail - head < 48 && (tail == head || rand_next() % 2)) {
+            trace_push('a', tail % MAX_SLOTS, rand_range(8, 128));
+            tail++;
+        } else {
+            trace_push('d', head % MAX_SLOTS, 0);
+            head++;
+        }
+    }
+}
+
+/* bimodal: small mailbox messages interleaved with long-lived task stacks */
+static void gen_stacks(int num_ops) {
+    char live[MAX_SLOTS] = {0};
+    int slot;
+
+    while (g_num_ops < num_ops) {
+        if (rand_next() % 8 == 0) {
+            slot = rand_next() % 16;                 /* stacks live in slots 0..15 */
+            if (live[slot]) {
+                trace_push('d', slot, 0);
+            } else {
+                trace_push('a', slot, 0x100 << (rand_next() % 3));
+            }
+        } else {
+            slot = 16 + rand_next() % (MAX_SLOTS - 16);
+            if (live[slot]) {
+                trace_push('d', slot, 0);
+            } else {
+                trace_push('a', slot, rand_range(9, 72));
+            }
+        }
+        live[slot] = !live[slot];
+    }
+}
+
+typedef struct workload {
+    const char *name;
+    void (*gen)(int num_ops);
+} WORKLOAD_T;
+
+static const WORKLOAD_T g_workloads[] = {
+    {"random", gen_random},
+    {"lifo",   gen_lifo},
+    {"fifo",   gen_fifo},
+    {"stacks", gen_stacks},
+};
+static const int g_num_workloads = sizeof(g_workloads) / sizeof(g_workloads[0]);
+
+static int load_trace(const char *path) {
+    char line[128];
+    FILE *fp = fopen(path, "r");
+    int lineno = 0;
+
+    if (fp == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    g_num_ops = 0;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        char op;
+        int slot;
+        unsigned int size = 0;
+        int n;
+
+        lineno++;
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+
+        n = sscanf(line, " %c %d %u", &op, &slot, &size);
+        if (n < 2 || (op != 'a' && op != 'd') || (op == 'a' && n < 3) || slot < 0 || slot >= MAX_SLOTS) {
+            fprintf(stderr, "%s:%d: malformed trace line\n", path, lineno);
+            fclose(fp);
+            return -1;
+        }
+        trace_push(op, slot, size);
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+/**
+ * @brief: replay g_trace against one algorithm
+ * @return: 0 if the algorithm ran, -1 if k_mem_init failed
+ */
+static int run_trace(int algo, unsigned int blk_size, unsigned int frag_size, BENCH_RESULT_T *res) {
+    int i;
+
+    memset(g_slots, 0, sizeof(g_slots));
+    memset(res, 0, sizeof(*res));
+    res->first_fail_op = -1;
+
+    if (k_mem_init(blk_size, algo) != 0) {
+        return -1;
+    }
+
+    for (i = 0; i < g_num_ops; i++) {
+        TRACE_OP_T *op = &g_trace[i];
+        unsigned long long t0;
+        unsigned long long dt;
+        int frag;
+
+        if (op->op == 'a') {
+            if (g_slots[op->slot] != NULL) {
+                continue;           /* slot is still live, the trace is malformed */
+            }
+            t0 = host_time_ns();
+            g_slots[op->slot] = k_mem_alloc(op->size);
+            dt = host_time_ns() - t0;
+
+            if (g_slots[op->slot] == NULL) {
+                res->failed_allocs++;
+                if (res->first_fail_op < 0) {
+                    res->first_fail_op = i;
+                    res->first_fail_ns = res->total_ns + dt;
+                }
+            }
+        } else {
+            if (g_slots[op->slot] == NULL) {
+                continue;           /* its alloc failed, nothing to free */
+            }
+            t0 = host_time_ns();
+            k_mem_dealloc(g_slots[op->slot]);
+            dt = host_time_ns() - t0;
+            g_slots[op->slot] = NULL;
+        }
+
+        res->ops++;
+        res->total_ns += dt;
+        if (dt > res->worst_ns) {
+            res->worst_ns = dt;
+            res->worst_op = i;
+        }
+
+        /* outside the timed region, the free-list walk is not part of the op */
+        frag = k_mem_count_extfrag(frag_size);
+        if (frag > res->peak_extfrag) {
+            res->peak_extfrag = frag;
+        }
+    }
+
+    return 0;
+}
+
+static void print_header(void) {
+    printf("%-10s %-11s %8s %12s %10s %9s %9s %7s %10s %12s\n",
+           "workload", "algo", "ops", "ops/sec", "worst_ns", "worst_op", "peak_frag", "failed", "first_fail", "fail_at_us");
+}
+
+static void print_result(const char *workload, const char *algo, BENCH_RESULT_T *res) {
+    double ops_per_sec = res->total_ns ? res->ops * 1e9 / res->total_ns : 0.0;
+
+    printf("%-10s %-11s %8d %12.0f %10llu %9d %9d %7d ",
+           workload, algo, res->ops, ops_per_sec, res->worst_ns, res->worst_op, res->peak_extfrag, res->failed_allocs);
+    if (res->first_fail_op < 0) {
+        printf("%10s %12s\n", "-", "-");
+    } else {
+        printf("%10d %12.1f\n", res->first_fail_op, res->first_fail_ns / 1e3);
+    }
+}
+
+static void bench_all_algos(const char *workload, unsigned int blk_size, unsigned int frag_size) {
+    BENCH_RESULT_T res;
+    int a;
+
+    for (a = 0; a < g_host_num_mem_algos; a++) {
+        if (run_trace(g_host_mem_algos[a], blk_size, frag_size, &res) != 0) {
+            fprintf(stderr, "%s: k_mem_init failed\n", g_host_mem_algo_names[a]);
+            continue;
+        }
+        print_result(workload, g_host_mem_algo_names[a], &res);
+    }
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [-t trace] [-w workload] [-n ops] [-b blk_size] [-f frag_size] [-s seed]\n"
+            "  workloads: random lifo fifo stacks (default: all)\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    const char *trace_path = NULL;
+    const char *workload = NULL;
+    int num_ops = DEF_OPS;
+    unsigned int blk_size = DEF_BLK_SIZE;
+    unsigned int frag_size = DEF_FRAG_SIZE;
+    unsigned int seed = 350;
+    int ran = 0;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (i + 1 >= argc || argv[i][0] != '-' || argv[i][2] != '\0') {
+            usage(argv[0]);
+            return 1;
+        }
+        switch (argv[i][1]) {
+            case 't': trace_path = argv[++i]; break;
+            case 'w': workload = argv[++i]; break;
+            case 'n': num_ops = atoi(argv[++i]); break;
+            case 'b': blk_size = (unsigned int) atoi(argv[++i]); break;
+            case 'f': frag_size = (unsigned int) atoi(argv[++i]); break;
+            case 's': seed = (unsigned int) strtoul(argv[++i], NULL, 0); break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (num_ops <= 0 || num_ops > MAX_OPS || blk_size == 0 || seed == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (host_iram_map() != 0) {
+        return 1;
+    }
+    host_set_current_tid(1);
+
+    printf("heap 0x%x-0x%x, blk_size %u, fragment threshold %u bytes\n",
+           HOST_IMAGE_LIMIT + 4, HOST_IRAM1_END, blk_size, frag_size);
+    print_header();
+
+    if (trace_path != NULL) {
+        if (load_trace(trace_path) != 0) {
+            return 1;
+        }
+        bench_all_algos(trace_path, blk_size, frag_size);
+        return 0;
+    }
+
+    for (i = 0; i < g_num_workloads; i++) {
+        if (workload != NULL && strcmp(workload, g_workloads[i].name) != 0) {
+            continue;
+        }
+        g_rand_state = seed;
+        g_num_ops = 0;
+        g_workloads[i].gen(num_ops);
+        bench_all_algos(g_workloads[i].name, blk_size, frag_size);
+        ran++;
+    }
+
+    if (ran == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,273 @@
+/**
+ * @file:   mem_replay.c
+ * @brief:  replay an allocation trace captured from the target through the
+ *          host build of the allocator
+ * NOTE: Build the target with MEM_TRACE defined and capture UART1 to a
+ *       file. Type %MT on the console whenever the trace should be drained
+ *       (the ring holds MEM_TRACE_LEN records, later ones are dropped and
+ *       only counted until the next dump), or call mem_trace_dump() from a task, for example after a
+ *       failed allocation. Every "MT ..." line in the capture is replayed in
+ *       order, other console output is ignored.
+ *
+ *       Build and run from this directory:
+ *         gcc -O2 -no-pie -o mem_replay mem_replay.c host_port.c host_kernel.c ../src/k_mem.c
+ *         ./mem_replay uart1.log                (replay, check addresses match)
+ *         ./mem_replay -b 8 uart1.log           (same sequence, different blk_size)
+ *         ./mem_replay -o trace.txt uart1.log   (also write a mem_bench trace)
+ *
+ *       With the recorded blk_size and algorithm the host allocator must hand
+ *       out exactly the addresses the target did. Any mismatch means the heap
+ *       start (HOST_IMAGE_LIMIT) differs from the image that was traced.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host_port.h"
+
+/* ----- Definitions ----- */
+#define MAX_LIVE 1024           /* blocks live at the same time in the trace */
+
+typedef struct live_block {
+    unsigned int target_addr;   /* address the target returned */
+    void *host_ptr;             /* address the host allocator returned, may be NULL */
+    int  slot;                  /* slot number in the exported mem_bench trace */
+} LIVE_BLOCK_T;
+
+typedef struct replay_stats {
+    int ops;
+    int mismatches;             /* host and target returned different addresses */
+    int target_failures;
+    int reproduced_failures;    /* target failure that also failed on the host */
+    int host_failures;
+    int dealloc_errors;         /* dealloc return value differs from the target */
+    int dropped;                /* records the target ring could not hold */
+    int unknown_frees;          /* freed address never seen allocated */
+    int peak_extfrag;
+} REPLAY_STATS_T;
+
+static LIVE_BLOCK_T g_live[MAX_LIVE];
+static int g_num_live;
+static char g_slot_used[MAX_LIVE];
+
+static LIVE_BLOCK_T *live_find(unsigned int target_addr) {
+    int i;
+
+    for (i = 0; i < g_num_live; i++) {
+        if (g_live[i].target_addr == target_addr) {
+            return &g_live[i];
+        }
+    }
+    return NULL;
+}
+
+static int slot_alloc(void) {
+    int i;
+
+    for (i = 0; i < MAX_LIVE; i++) {
+        if (!g_slot_used[i]) {
+            g_slot_used[i] = 1;
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void live_remove(LIVE_BLOCK_T *blk) {
+    g_slot_used[blk->slot] = 0;
+    *blk = g_live[--g_num_live];
+}
+
+static void print_stats(REPLAY_STATS_T *st, int check_addrs) {
+    printf("replayed %d ops, %d records dropped on the target\n", st->ops, st->dropped);
+    if (check_addrs) {
+        printf("address mismatches:    %d\n", st->mismatches);
+    }
+    printf("target alloc failures: %d (%d reproduced on host)\n", st->target_failures, st->reproduced_failures);
+    printf("host alloc failures:   %d\n", st->host_failures);
+    printf("dealloc mismatches:    %d\n", st->dealloc_errors);
+    printf("unknown frees:         %d\n", st->unknown_frees);
+    printf("peak extfrag:          %d\n", st->peak_extfrag);
+}
+
+int main(int argc, char *argv[]) {
+    const char *in_path = NULL;
+    const char *out_path = NULL;
+    unsigned int blk_override = 0;
+    unsigned int frag_size = 256;
+    int check_addrs = 1;
+    FILE *in;
+    FILE *out = NULL;
+    char line[256];
+    REPLAY_STATS_T st;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            blk_override = (unsigned int) atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            frag_size = (unsigned int) atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (argv[i][0] != '-' && in_path == NULL) {
+            in_path = argv[i];
+        } else {
+            in_path = NULL;
+            break;
+        }
+    }
+
+    if (in_path == NULL) {
+        fprintf(stderr, "usage: %s [-b blk_size] [-f frag_size] [-o bench_trace] uart1.log\n", argv[0]);
+        return 1;
+    }
+
+    in = fopen(in_path, "r");
+    if (in == NULL) {
+        perror(in_path);
+        return 1;
+    }
+
+    if (out_path != NULL) {
+        out = fopen(out_path, "w");
+        if (out == NULL) {
+            perror(out_path);
+            return 1;
+        }
+        fprintf(out, "# converted from %s by mem_replay\n", in_path);
+    }
+
+    if (host_iram_map() != 0) {
+        return 1;
+    }
+
+    memset(&st, 0, sizeof(st));
+
+    while (fgets(line, sizeof(line), in) != NULL) {
+        char *rec = strstr(line, "MT ");
+        char op;
+        unsigned int tick, tid, a, b;
+        int ret;
+        int n;
+
+        if (rec == NULL) {
+            continue;
+        }
+
+        if (sscanf(rec, "MT begin %u", &a) == 1) {
+            st.dropped += a;
+            if (a != 0) {
+                fprintf(stderr, "warning: target dropped %u records, replay is not exact\n", a);
+            }
+            continue;
+        }
+
+        n = sscanf(rec, "MT %c %u %u %i %i", &op, &tick, &tid, &a, &b);
+        if (n != 5) {
+            continue;   /* "MT end" or a line garbled on the wire */
+        }
+
+        switch (op) {
+            case 'i':   /* a = blk_size, b = heap start */
+                if (b != HOST_IMAGE_LIMIT + 4) {
+                    fprintf(stderr, "warning: target heap starts at 0x%x, host at 0x%x; rebuild with -DHOST_IMAGE_LIMIT=0x%x\n",
+                            b, HOST_IMAGE_LIMIT + 4, b - 4);
+                    check_addrs = 0;
+                }
+                if (blk_override != 0 && blk_override != a) {
+                    check_addrs = 0;
+                    a = blk_override;
+                }
+                if (k_mem_init(a, (int) tid) != 0) {
+                    fprintf(stderr, "k_mem_init(%u, %u) failed on host\n", a, tid);
+                    return 1;
+                }
+                g_num_live = 0;
+                memset(g_slot_used, 0, sizeof(g_slot_used));
+                printf("tick %u: mem_init blk_size %u algo %u\n", tick, a, tid);
+                break;
+
+            case 'a': { /* a = size, b = returned address */
+                void *p;
+                LIVE_BLOCK_T *blk;
+
+                host_set_current_tid(tid);
+                p = k_mem_alloc(a);
+                st.ops++;
+
+                if (b == 0) {
+                    st.target_failures++;
+                    if (p == NULL) {
+                        st.reproduced_failures++;
+                    } else {
+                        k_mem_dealloc(p);   /* keep the host heap in the target's state */
+                    }
+                    printf("tick %u: tid %u alloc(%u) failed on target, %s on host\n",
+                           tick, tid, a, p == NULL ? "fails" : "succeeds");
+                    break;
+                }
+
+                if (p == NULL) {
+                    st.host_failures++;
+                    printf("tick %u: tid %u alloc(%u) failed on host only\n", tick, tid, a);
+                } else if (check_addrs && (unsigned int) (unsigned long) p != b) {
+                    st.mismatches++;
+                }
+
+                if (g_num_live >= MAX_LIVE) {
+                    fprintf(stderr, "more than %d live blocks, raise MAX_LIVE\n", MAX_LIVE);
+                    return 1;
+                }
+                blk = &g_live[g_num_live++];
+                blk->target_addr = b;
+                blk->host_ptr = p;
+                blk->slot = slot_alloc();
+                if (out != NULL) {
+                    fprintf(out, "a %d %u\n", blk->slot, a);
+                }
+                break;
+            }
+
+            case 'd': { /* a = freed address, b = return value */
+                LIVE_BLOCK_T *blk = live_find(a);
+
+                st.ops++;
+                if (blk == NULL) {
+                    st.unknown_frees++;
+                    break;
+                }
+
+                host_set_current_tid(tid);
+                if (blk->host_ptr != NULL) {
+                    ret = k_mem_dealloc(blk->host_ptr);
+                    if (ret != (int) b) {
+                        st.dealloc_errors++;
+                    }
+                }
+                if (out != NULL) {
+                    fprintf(out, "d %d\n", blk->slot);
+                }
+                if ((int) b == 0) {
+                    live_remove(blk);
+                }
+                break;
+            }
+
+            default:
+                continue;
+        }
+
+        n = k_mem_count_extfrag(frag_size);
+        if (n > st.peak_extfrag) {
+            st.peak_extfrag = n;
+        }
+    }
+
+    fclose(in);
+    if (out != NULL) {
+        fclose(out);
+    }
+
+    print_stats(&st, check_addrs);
+    return (check_addrs && st.mismatches) ? 2 : 0;
+}
@@ -0,0 +1,561 @@
+/**
+ * @file:   rtx_stress.c
+ * @brief:  randomized stress test of the scheduler and the allocator, with
+ *          timer and UART interrupts injected at random points
+ * NOTE: Runs k_task.c, k_wait.c, k_msg.c, k_evt.c, k_mem_wait.c and k_mem.c
+ *       unchanged on the host. The context switch is host_hal.c, each task a
+ *       ucontext (host_ctx.c), and the tasks call the k_ functions directly
+ *       where the target would trap into them through an SVC.
+ *
+ *       Every task runs the same loop: it may take an interrupt, then does
+ *       one random operation: create, create_ex, exit, yield, set_prio,
+ *       send, recv, alloc, alloc_wait, free, delay, evt_set or evt_wait,
+ *       invalid arguments included. The interrupts are the SysTick handler
+ *       (k_wait_tick, then k_tsk_preempt if it woke a more urgent task), a
+ *       received character (a KEY_IN message to a random task through
+ *       k_send_msg_isr, then k_tsk_preempt if it asks for it) and a UART
+ *       transmit interrupt (k_evt_set_isr). The null task only takes
+ *       interrupts, so blocked tasks always wake up eventually.
+ *       After every operation (-c sets how often) the kernel invariants are
+ *       checked (host_check.c): ready queue sorted, every task not DORMANT
+ *       in exactly one of running, ready or blocked, wait queues and the
+ *       timeout list consistent, heap blocks tiling IRAM1 with the free list
+ *       address-ordered and coalesced, no TID and no heap block leaked.
+ *       The contents of every block and message are checked as well.
+ *
+ *       A run is a function of its seed. On the first violation it prints
+ *       the seed, the operation number and the task and exits with status 1,
+ *       rerun with the same -s and -n under a debugger to look at it. A
+ *       kernel that fail-stops (tsk_stack_overflow) is caught by a watchdog.
+ *
+ *       Build and run from this directory:
+ *         gcc -O2 -no-pie -DHOST_PORT -DMEM_CHECK -D'__svc(n)=' -I. -o rtx_stress \
+ *             rtx_stress.c host_check.c host_hal.c host_ctx.c host_clock.c host_port.c \
+ *             host_kernel.c ../src/k_task.c ../src/k_wait.c ../src/linked_list.c \
+ *             ../src/k_msg.c ../src/k_sync.c ../src/k_evt.c ../src/k_mem_wait.c \
+ *             ../src/k_mem.c ../src/circular_buffer.c
+ *         ./rtx_stress                 (1M operations, seed 350)
+ *         ./rtx_stress -n 20 -s 7      (20M operations, another seed)
+ *         ./rtx_stress -c 100 -i 30    (check every 100 ops, 30% interrupts)
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "host_port.h"
+
+/* ----- Definitions ----- */
+#define DEF_MOPS       1            /* -n, millions of operations           */
+#define DEF_IRQ_PCT    10           /* -i, operations preceded by an interrupt */
+#define DEF_MAX_TASKS  16           /* -t, TCB table size                   */
+#define WATCHDOG_SECS  5            /* no operation for this long is a hang */
+
+#define STRESS_PRIO    2            /* LOW, the first task                  */
+#define STRESS_STACK   0x200
+#define MAX_BLOCKS     8            /* heap blocks a task holds at a time   */
+#define MAX_BLOCK_SIZE 512
+#define MSG_MAX        64           /* bytes, header included               */
+#define NUM_TIDS       256
+
+/* same values as the kernel headers, which the C library side cannot include */
+#define S_DORMANT      0
+#define KEY_IN         4
+#define EVT_ALL        1
+#define RTX_OK         0
+#define RTX_ERR        (-1)
+#define KERN_STACK_MIN 0x180
+#define TID_KCD        15
+#define TID_UART_IRQ   0xFF
+
+/* the layout of RTX_MSG_HDR */
+typedef struct msg_hdr {
+    unsigned int length;            /* header included */
+    unsigned int type;
+} MSG_HDR_T;
+
+enum {
+    OP_CREATE, OP_CREATE_EX, OP_EXIT, OP_YIELD, OP_SET_PRIO, OP_SEND, OP_RECV,
+    OP_ALLOC, OP_ALLOC_WAIT, OP_FREE, OP_DELAY, OP_EVT_SET, OP_EVT_WAIT, NUM_OPS
+};
+
+static const char *g_op_names[NUM_OPS] = {
+    "create", "create_ex", "exit", "yield", "set_prio", "send", "recv",
+    "alloc", "alloc_wait", "free", "delay", "evt_set", "evt_wait",
+};
+
+/* relative weight of each operation */
+static const int g_op_weights[NUM_OPS] = {
+    4, 3, 2, 8, 8, 12, 8, 10, 3, 12, 4, 6, 4,
+};
+
+typedef struct stress_block {
+    unsigned char *ptr;
+    unsigned int size;
+} STRESS_BLOCK_T;
+
+typedef struct stress_task {
+    STRESS_BLOCK_T blocks[MAX_BLOCKS];
+    int num_blocks;
+    int op;                         /* operation in progress, -1 for an interrupt */
+} STRESS_TASK_T;
+
+static int g_op_weight_sum;
+static unsigned int g_rand_state;
+static unsigned int g_seed = 350;
+static unsigned long long g_max_ops;
+static unsigned long long g_ops;
+static unsigned long long g_ops_at_alarm;
+static unsigned int g_check_every = 1;
+static unsigned int g_irq_pct = DEF_IRQ_PCT;
+static unsigned long long g_start_ns;
+
+static STRESS_TASK_T g_tasks[NUM_TIDS];
+static int g_user_blocks[NUM_TIDS];         /* mirrors g_tasks[].num_blocks for host_check_kernel */
+static unsigned char g_alloc_wait[NUM_TIDS];
+
+static unsigned long g_op_ok[NUM_OPS];
+static unsigned long g_op_err[NUM_OPS];
+static unsigned long g_irqs[3];
+static int g_max_live;
+
+/* xorshift32, so a seed gives the same run on every libc */
+static unsigned int rand_next(void) {
+    unsigned int x = g_rand_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    g_rand_state = x;
+    return x;
+}
+
+static unsigned int rand_range(unsigned int lo, unsigned int hi) {
+    return lo + rand_next() % (hi - lo + 1);
+}
+
+static void stress_fail(const char *why, int tid) {
+    int me = host_tsk_current();
+    int op = g_tasks[me].op;
+
+    fprintf(stderr, "rtx_stress: seed %u, op %llu (%s in task %d): %s",
+            g_seed, g_ops, op >= 0 ? g_op_names[op] : "interrupt", me, why);
+    if (tid >= 0) {
+        fprintf(stderr, ", task %d", tid);
+    }
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
+static void stress_watchdog(int sig) {
+    char msg[128];
+    int len;
+
+    (void) sig;
+    if (g_ops == g_ops_at_alarm) {
+        len = snprintf(msg, sizeof(msg), "rtx_stress: seed %u, op %llu: no progress for %d s, the kernel hangs\n",
+                       g_seed, g_ops, WATCHDOG_SECS);
+        write(STDERR_FILENO, msg, len);
+        _exit(1);
+    }
+    g_ops_at_alarm = g_ops;
+    alarm(WATCHDOG_SECS);
+}
+
+/* the byte at offset i of a block or message, derived from a seed byte */
+static unsigned char fill_byte(unsigned int seed, unsigned int i) {
+    return (unsigned char) (seed * 31 + i * 7 + 1);
+}
+
+static void block_fill(unsigned char *p, unsigned int size) {
+    for (unsigned int i = 0; i < size; i++) {
+        p[i] = fill_byte((unsigned int) (unsigned long) p, i);
+    }
+}
+
+static int block_intact(const unsigned char *p, unsigned int size) {
+    for (unsigned int i = 0; i < size; i++) {
+        if (p[i] != fill_byte((unsigned int) (unsigned long) p, i)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* remember a block task tid now owns */
+static void block_add(int tid, void *ptr, unsigned int size) {
+    STRESS_TASK_T *t = &g_tasks[tid];
+
+    block_fill(ptr, size);
+    t->blocks[t->num_blocks].ptr = ptr;
+    t->blocks[t->num_blocks].size = size;
+    t->num_blocks++;
+    g_user_blocks[tid] = t->num_blocks;
+}
+
+/* forget block i of task tid, PRE: called before the block is freed, the free may switch tasks */
+static unsigned char *block_take(int tid, int i) {
+    STRESS_TASK_T *t = &g_tasks[tid];
+    unsigned char *ptr = t->blocks[i].ptr;
+
+    if (!block_intact(ptr, t->blocks[i].size)) {
+        stress_fail("a heap block was overwritten while allocated", tid);
+    }
+    t->blocks[i] = t->blocks[--t->num_blocks];
+    g_user_blocks[tid] = t->num_blocks;
+    return ptr;
+}
+
+static void stress_check(void) {
+    int tid;
+    const char *why;
+
+    if (g_check_every == 0 || g_ops % g_check_every != 0) {
+        return;
+    }
+    why = host_check_kernel(g_user_blocks, g_alloc_wait, &tid);
+    if (why != NULL) {
+        stress_fail(why, tid);
+    }
+}
+
+static void stress_report(void) {
+    double secs = (host_time_ns() - g_start_ns) / 1e9;
+
+    printf("seed %u, %llu operations in %.2f s, %.0f ops/s, checks every %u, at most %d tasks live\n",
+           g_seed, g_ops, secs, secs > 0 ? g_ops / secs : 0.0, g_check_every, g_max_live);
+    printf("%-11s %10s %10s\n", "operation", "RTX_OK", "RTX_ERR");
+    for (int op = 0; op < NUM_OPS; op++) {
+        printf("%-11s %10lu %10lu\n", g_op_names[op], g_op_ok[op], g_op_err[op]);
+    }
+    printf("interrupts: %lu SysTick, %lu UART RX, %lu UART TX\n", g_irqs[0], g_irqs[1], g_irqs[2]);
+}
+
+/* an interrupt lands on the running task, the way the handlers in k_wait.c and uart_irq.c run */
+static void stress_irq(void) {
+    int kind = rand_next() % 3;
+    int tid = rand_range(0, host_tsk_max() - 1);
+
+    g_tasks[host_tsk_current()].op = -1;
+    g_irqs[kind]++;
+    if (kind == 0) {
+        if (k_wait_tick()) {
+            k_tsk_preempt();
+        }
+    } else if (kind == 1) {
+        unsigned char buf[sizeof(MSG_HDR_T) + 1];
+        MSG_HDR_T *hdr = (MSG_HDR_T *) buf;
+
+        hdr->length = sizeof(buf);
+        hdr->type = KEY_IN;
+        buf[sizeof(MSG_HDR_T)] = (unsigned char) rand_range('a', 'z');
+        if (k_send_msg_isr(tid, buf)) {
+            k_tsk_preempt();
+        }
+    } else if (k_evt_set_isr(tid, 1U << (rand_next() % 4))) {
+        k_tsk_preempt();
+    }
+}
+
+/* op gets RTX_OK or RTX_ERR, which one it must get if not -2 */
+static void stress_result(int op, int ret, int expect) {
+    if (ret == RTX_OK) {
+        g_op_ok[op]++;
+    } else {
+        g_op_err[op]++;
+    }
+    if (expect != -2 && ret != expect) {
+        stress_fail(expect == RTX_OK ? "call failed that must succeed" : "call succeeded that must fail", -1);
+    }
+}
+
+static void stress_task(void);
+
+static void op_create(int ex) {
+    unsigned char tid = 0xEE;
+    int prio = rand_next() % 8 == 0 ? rand_range(4, 6) : rand_range(0, 3);
+    int u_stack = rand_next() % 16 == 0 ? 0 : rand_range(0x40, 0x100) * 4;
+    int k_stack = rand_next() % 2 == 0 ? 0 : rand_range(0x10, 0x100) * 4;
+    int ret;
+
+    if (!ex) {
+        ret = k_tsk_create(&tid, stress_task, prio, u_stack);
+        stress_result(OP_CREATE, ret, prio > 3 || u_stack == 0 ? RTX_ERR : -2);
+    } else {
+        ret = host_tsk_create_ex(&tid, stress_task, prio, u_stack, k_stack);
+        stress_result(OP_CREATE_EX, ret,
+                      prio > 3 || u_stack == 0 || (k_stack != 0 && ((k_stack + 7) & ~7) < KERN_STACK_MIN)
+                      ? RTX_ERR : -2);
+    }
+    /* the new task may have run and exited already, its TID is all that can be checked */
+    if (ret == RTX_OK && tid >= host_tsk_max()) {
+        stress_fail("tsk_create returned a TID that does not exist", tid);
+    }
+}
+
+/* free everything the task holds and exit, as long as two tasks stay */
+static void op_exit(int me) {
+    if (host_tsk_live() <= 3) {
+        return;
+    }
+    while (g_tasks[me].num_blocks > 0) {
+        if (k_mem_dealloc_wake(block_take(me, 0)) != RTX_OK) {
+            stress_fail("could not free a block before exiting", me);
+        }
+    }
+    g_op_ok[OP_EXIT]++;
+    k_tsk_exit();
+    stress_fail("tsk_exit returned", me);
+}
+
+static void op_set_prio(int me) {
+    int tid = rand_range(0, host_tsk_max() + 1);
+    int prio = rand_next() % 8 == 0 ? rand_range(4, 255) : rand_range(0, 3);
+    int state = host_tsk_state(tid);
+    int ret = k_tsk_set_prio(tid, prio);
+
+    (void) me;
+    stress_result(OP_SET_PRIO, ret, prio > 3 || tid == 0 || state <= S_DORMANT ? RTX_ERR : RTX_OK);
+}
+
+static void op_send(void) {
+    unsigned char buf[MSG_MAX];
+    MSG_HDR_T *hdr = (MSG_HDR_T *) buf;
+    int tid = rand_range(0, host_tsk_max());
+    unsigned int len = rand_next() % 16 == 0 ? sizeof(MSG_HDR_T) : rand_range(sizeof(MSG_HDR_T) + 1, MSG_MAX);
+    int expect;
+
+    hdr->length = len;
+    hdr->type = 0;
+    buf[sizeof(MSG_HDR_T)] = (unsigned char) rand_next();
+    for (unsigned int i = sizeof(MSG_HDR_T) + 1; i < len; i++) {
+        buf[i] = fill_byte(buf[sizeof(MSG_HDR_T)], i);
+    }
+    /* a full mailbox is the one failure that depends on the run. The receiver
+       may run and exit before k_send_msg returns, decide before the call */
+    expect = !host_tsk_has_mailbox(tid) || len == sizeof(MSG_HDR_T) ? RTX_ERR : -2;
+    stress_result(OP_SEND, k_send_msg(tid, buf), expect);
+}
+
+static void op_recv(int me) {
+    unsigned char buf[MSG_MAX];
+    MSG_HDR_T *hdr = (MSG_HDR_T *) buf;
+    unsigned char sender = 0xEE;
+    unsigned int len = rand_next() % 8 == 0 ? rand_range(sizeof(MSG_HDR_T), MSG_MAX - 1) : MSG_MAX;
+    int ret;
+
+    if (!host_tsk_has_mailbox(me)) {
+        stress_result(OP_RECV, k_recv_msg(&sender, buf, len), RTX_ERR);
+        return;
+    }
+    ret = k_recv_msg(&sender, buf, len);
+    stress_result(OP_RECV, ret, len == MSG_MAX ? RTX_OK : -2);
+    if (ret != RTX_OK) {
+        return;
+    }
+    if (hdr->length > len) {
+        stress_fail("received a message longer than the buffer", me);
+    }
+    if (hdr->type == KEY_IN) {
+        if (hdr->length != sizeof(MSG_HDR_T) + 1 || sender != TID_UART_IRQ) {
+            stress_fail("KEY_IN message of the wrong length or not from the UART IRQ", me);
+        }
+        return;
+    }
+    if (sender >= host_tsk_max()) {
+        stress_fail("received a message from no task", me);
+    }
+    for (unsigned int i = sizeof(MSG_HDR_T) + 1; i < hdr->length; i++) {
+        if (buf[i] != fill_byte(buf[sizeof(MSG_HDR_T)], i)) {
+            stress_fail("message contents corrupted in the mailbox", me);
+        }
+    }
+}
+
+static void op_alloc(int me, int wait) {
+    unsigned int size = rand_next() % 32 == 0 ? 0 : rand_range(1, MAX_BLOCK_SIZE);
+    void *ptr;
+
+    if (g_tasks[me].num_blocks == MAX_BLOCKS) {
+        return;
+    }
+    if (wait) {
+        g_alloc_wait[me] = 1;
+        ptr = k_mem_alloc_wait(size, rand_range(1, 20));
+        g_alloc_wait[me] = 0;
+    } else {
+        ptr = k_mem_alloc_fair(size);
+    }
+    stress_result(wait ? OP_ALLOC_WAIT : OP_ALLOC, ptr != NULL ? RTX_OK : RTX_ERR, size == 0 ? RTX_ERR : -2);
+    if (ptr != NULL) {
+        block_add(me, ptr, size);
+    }
+}
+
+/* free one of the task's blocks, or try another task's, which must fail */
+static void op_free(int me) {
+    int tid = rand_next() % 8 == 0 ? (int) rand_range(1, host_tsk_max() - 1) : me;
+    STRESS_TASK_T *t = &g_tasks[tid];
+
+    if (t->num_blocks == 0 || host_tsk_state(tid) <= S_DORMANT) {
+        return;
+    }
+    if (tid != me) {
+        STRESS_BLOCK_T *b = &t->blocks[rand_next() % t->num_blocks];
+
+        stress_result(OP_FREE, k_mem_dealloc_wake(b->ptr), RTX_ERR);
+        if (!block_intact(b->ptr, b->size)) {
+            stress_fail("a rejected free changed the block", tid);
+        }
+        return;
+    }
+    stress_result(OP_FREE, k_mem_dealloc_wake(block_take(me, rand_next() % t->num_blocks)), RTX_OK);
+}
+
+static void op_evt_wait(int me) {
+    unsigned int flags = rand_next() % 16 == 0 ? 0 : rand_range(1, 15);
+    unsigned char opt = rand_next() % 4;
+    unsigned int timeout = rand_next() % 4 == 0 ? 0 : rand_range(1, 20);
+    unsigned int got = 0;
+    int ret = k_evt_wait(flags, opt, timeout, &got);
+
+    (void) me;
+    stress_result(OP_EVT_WAIT, ret, flags == 0 ? RTX_ERR : -2);
+    if (ret == RTX_OK && (got == 0 || (got & ~flags) != 0 || ((opt & EVT_ALL) && got != flags))) {
+        stress_fail("evt_wait returned flags it did not wait for", me);
+    }
+}
+
+/* one random operation of task me */
+static void stress_step(int me) {
+    int pick = rand_next() % 100;
+    int op;
+
+    if (host_tsk_current() != me) {
+        stress_fail("a task runs on another task's context", me);
+    }
+    if (pick < (int) g_irq_pct) {
+        stress_irq();
+    }
+    host_tsk_cycles(rand_range(50, 500));
+
+    pick = rand_next() % g_op_weight_sum;
+    for (op = 0; pick >= g_op_weights[op]; op++) {
+        pick -= g_op_weights[op];
+    }
+    g_tasks[me].op = op;
+    switch (op) {
+        case OP_CREATE:     op_create(0); break;
+        case OP_CREATE_EX:  op_create(1); break;
+        case OP_EXIT:       op_exit(me); break;
+        case OP_YIELD:      stress_result(op, k_tsk_yield(), RTX_OK); break;
+        case OP_SET_PRIO:   op_set_prio(me); break;
+        case OP_SEND:       op_send(); break;
+        case OP_RECV:       op_recv(me); break;
+        case OP_ALLOC:      op_alloc(me, 0); break;
+        case OP_ALLOC_WAIT: op_alloc(me, 1); break;
+        case OP_FREE:       op_free(me); break;
+        case OP_DELAY:
+            if (rand_next() % 8 == 0) {
+                stress_result(op, k_tsk_delay(0), RTX_ERR);
+            } else {
+                stress_result(op, k_tsk_delay(rand_range(1, 10)), RTX_OK);
+            }
+            break;
+        case OP_EVT_SET: {
+            int tid = rand_range(0, host_tsk_max());
+            int state = host_tsk_state(tid);
+
+            stress_result(op, k_evt_set(tid, 1U << (rand_next() % 4)), state <= S_DORMANT ? RTX_ERR : RTX_OK);
+            break;
+        }
+        case OP_EVT_WAIT:   op_evt_wait(me); break;
+    }
+}
+
+/* after every operation, by any task */
+static void stress_done(void) {
+    int live = host_tsk_live();
+
+    g_ops++;
+    if (live > g_max_live) {
+        g_max_live = live;
+    }
+    stress_check();
+    if (g_ops >= g_max_ops) {
+        stress_report();
+        exit(0);
+    }
+}
+
+static void stress_task(void) {
+    int me = host_tsk_current();
+
+    g_tasks[me].num_blocks = 0;
+    g_user_blocks[me] = 0;
+    k_mbx_create(rand_range(16, 256));     /* with the heap full the task goes without */
+    for (;;) {
+        stress_step(me);
+        stress_done();
+    }
+}
+
+/* the null task: interrupts only, it must never block */
+static void stress_idle(void) {
+    for (;;) {
+        if (host_tsk_current() != 0) {
+            stress_fail("the null task runs on another task's context", 0);
+        }
+        stress_irq();
+        host_tsk_cycles(1000);
+        stress_done();
+    }
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-n Mops] [-s seed] [-c check_every] [-t max_tasks] [-i irq_pct]\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned int mops = DEF_MOPS;
+    int max_tasks = DEF_MAX_TASKS;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (i + 1 >= argc || argv[i][0] != '-' || argv[i][2] != '\0') {
+            usage(argv[0]);
+            return 1;
+        }
+        switch (argv[i][1]) {
+            case 'n': mops = (unsigned int) atoi(argv[++i]); break;
+            case 's': g_seed = (unsigned int) strtoul(argv[++i], NULL, 0); break;
+            case 'c': g_check_every = (unsigned int) atoi(argv[++i]); break;
+            case 't': max_tasks = atoi(argv[++i]); break;
+            case 'i': g_irq_pct = (unsigned int) atoi(argv[++i]); break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (mops == 0 || g_seed == 0 || max_tasks <= TID_KCD || max_tasks > NUM_TIDS - 3 || g_irq_pct > 100) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    g_rand_state = g_seed;
+    for (i = 0; i < NUM_OPS; i++) {
+        g_op_weight_sum += g_op_weights[i];
+    }
+    g_max_ops = mops * 1000000ULL;
+    if (host_iram_map() != 0 || k_mem_init(4, 1) != RTX_OK) {   /* FIRST_FIT */
+        return 1;
+    }
+    host_hal_init(stress_idle);
+    signal(SIGALRM, stress_watchdog);
+    alarm(WATCHDOG_SECS);
+    g_start_ns = host_time_ns();
+
+    host_tsk_boot(stress_task, STRESS_PRIO, STRESS_STACK, max_tasks);
+    fprintf(stderr, "rtx_stress: the kernel did not start\n");
+    return 1;
+}
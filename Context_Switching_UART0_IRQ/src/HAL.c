@@ -6,6 +6,7 @@
  */
  
  #include "k_rtx.h"
+ #include "k_svc.h"
  //#include "k_task.h"
  
 extern TCB *gp_current_task;
@@ -14,30 +15,53 @@ extern TCB *gp_current_task;
 __asm void __rte(void)
 {
   PRESERVE8                  ; 8 bytes alignement of the stack
-	B SVC_EXIT                 ; Exit SVC_Handler
+	B TASK_START               ; Exit SVC_Handler with clean registers
+}
+
+/* save the outgoing task's callee-saved registers on its own stack and switch to
+   new_msp. A NEW task has no saved registers yet, it starts from its exception
+   stack frame through TASK_START, which clears the outgoing task's R4-R11.
+   A READY task was switched out here before, so its registers are popped and
+   this call returns on its behalf.
+   R0 = &old_tcb->msp, R1 = new_tcb->msp, R2 = 1 if the new task is NEW */
+__asm void __ctx_switch(U32 **p_old_msp, U32 *new_msp, U32 is_new)
+{
+  PRESERVE8
+  PUSH {R4-R11, LR}    ; only a real switch pays for the spill
+  MOV  R3, SP
+  STR  R3, [R0]        ; old_tcb->msp
+  MSR  MSP, R1         ; handler mode, SP is MSP
+  CMP  R2, #0
+  BNE  TASK_START      ; NEW task, pop its exception stack frame
+  POP  {R4-R11, LR}    ; registers the READY task saved when it was switched out
+  BX   LR
 }
 
 /* Overview 
-  1. Get SVC number and verify if 0
-  2. Load R0-R3, R12 from exception stack frame to call desired kernel mode function. Save gp-regs
-  3. restore gp-regs, store return value in RO (which is on exception stack frame) 
+  1. Get SVC number and look up its kernel function in g_svc_table
+  2. Load R0-R3 from exception stack frame to call desired kernel mode function.
+     R4-R11 are not saved here, kernel functions preserve them (AAPCS) and
+     __ctx_switch saves them when a call actually switches tasks
+  3. store return value in RO (which is on exception stack frame) 
   4. Return appropriate EXC_RETURN val to set processor mode, depending on current running task
 */
 
-/* NOTE: We're assuming the exception stack frame is pushed onto PSP for user and kernel threads*/
+/* NOTE: Privileged tasks (and main before rtx_init) run in thread mode on MSP,
+         their kernel stack. Unprivileged tasks run on PSP, their user stack, and
+         SVC_EXIT points MSP at the top of their kernel stack for the IRQs taken
+         while they run. */
 __asm void SVC_Handler (void) 
 {
   PRESERVE8             ; 8 bytes alignement of the stack
   CPSID I               ; disable interrupt
 	
-  MRS  R0, PSP          ; Read PSP into R0
-	CMP  R0, #0 				  ; Check if this is the first invocation
-	BNE  normal_operation 
-	MRS  R0, MSP          ;since PSP = 0x0, load MSP address
-  										
+  MRS  R0, MSP          ; the exception stack frame is on MSP ...
+  TST  LR, #4           ; EXC_RETURN bit 2 set: the caller ran on PSP
+  BEQ  normal_operation 
+  MRS  R0, PSP          ; ... or on PSP, an unprivileged task
 	
 normal_operation
-  MSR MSP, R0          ; Set MSP = PSP
+  MSR MSP, R0          ; run the kernel function below the exception stack frame
 	
   
   LDR  R1, [R0, #24]   ; Read Saved PC from SP (skip over 6 regs - R0-R3, R12, LR)
@@ -46,43 +70,60 @@ normal_operation
                        ; exception stack frame is pushed onto the stack.
              
   LDRH R1, [R1, #-2]   ; Load halfword because SVC number is encoded there
-  BICS R1, R1, #0xFF00 ; Extract SVC Number and save it in R1.  
-                       ; R1 <= R1 & ~(0xFF00), update flags
+  BIC  R1, R1, #0xFF00 ; Extract SVC Number and save it in R1.  
                        ; SVC number is 2 bytes above PC on stack
-                   
-  BNE  SVC_EXIT        ; if SVC Number !=0, exit
+  CMP  R1, #__cpp(SVC_NUM_CALLS)
+  BHS  SVC_INVALID     ; number outside the table
+  LDR  R12, =__cpp(g_svc_table)
+  LDR  R12, [R12, R1, LSL #2] ; kernel function for this SVC number
+  CMP  R12, #0
+  BEQ  SVC_INVALID     ; unused table entry
  
-  LDM  R0, {R0-R3, R12}; Read R0-R3, R12 from stack (no writeback)
+  LDM  R0, {R0-R3}     ; Read R0-R3 from stack (no writeback)
                        ; NOTE R0 contains the sp before this instruction
-                       ; ****Need to set MSP back to kernel stack before system call****
-  PUSH {R4-R11, LR}    ; Save other registers
   BLX  R12             ; Call SVC C Function, 
-                       ; R12 contains the corresponding 
-                       ; C kernel functions entry point
                        ; R0-R3 contains the kernel function input parameters (See AAPCS)
-  POP {R4-R11, LR}     ; Restore other registers
-  MRS  R12, MSP        ; Read MSP
+                       ; LR is rebuilt at SVC_EXIT, R4-R11 are callee-saved
+  MRS  R12, MSP        ; Read MSP (the exception stack frame, of the new task after a switch)
   STR  R0, [R12]       ; store C kernel function return value in R0
                        ; to R0 on the exception stack frame  
+  B    SVC_EXIT
+
+TASK_START             ; a NEW task must not see another task's R4-R11
+  MOV  R4, #0
+  MOV  R5, #0
+  MOV  R6, #0
+  MOV  R7, #0
+  MOV  R8, #0
+  MOV  R9, #0
+  MOV  R10, #0
+  MOV  R11, #0
+  B    SVC_EXIT
+
+SVC_INVALID
+  MVN  R1, #0          ; RTX_ERR
+  STR  R1, [R0]        ; R0 still points at the exception stack frame
 SVC_EXIT  
 	
-	MVN  LR, #:NOT:0xFFFFFFFD           ; set EXC_RETURN value to Thread mode, PSP
   LDR R3, =__cpp(&gp_current_task)    ; Load R3 with address of pointer to current task
 	LDR R3, [R3]                        ; Get address of current task
 	MOV R2, #0                          ; clear R2
-	LDRB R2, [R3, #25]                  ; read priv member (136 bits = 17 byte offset)
+	LDRB R2, [R3, #__cpp(TCB_OFFSET(priv))] ; read priv member
   CMP R2, #1                          ; check if priv level is 1 or 0
   BEQ kernel_thread                   ; if 1, handler was invoked by kernel thread
   B user_thread                       ; if 0, handler was invoked by user thread
 
-	//TO DO: Make sure privilege level is set appropriately, currently user task is privileged?
 kernel_thread
+	MVN  LR, #:NOT:0xFFFFFFF9  ; EXC_RETURN: Thread mode, MSP. The frame is on MSP
 	MOV R3, #0                 ; 
 	MSR CONTROL, R3            ; set control bit[0] to 0 (priviledged)
   CPSIE I                    ; enable interrupt
   BX   LR
 
 user_thread
+	MVN  LR, #:NOT:0xFFFFFFFD  ; EXC_RETURN: Thread mode, PSP
+	LDR R2, [R3, #__cpp(TCB_OFFSET(msp_hi))]
+	MSR MSP, R2                ; MSP was left on the user stack, IRQs get the empty kernel stack
 	MOV R3, #1                 ; 
 	MSR CONTROL, R3            ; set control bit[0] to 1 (unpriviledged)
   CPSIE I                    ; enable interrupt
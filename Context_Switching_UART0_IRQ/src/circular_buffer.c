@@ -9,117 +9,159 @@
 #endif /* ! DEBUG_CIRC_BUFF */
 
 
+/*
+ * The buffer is a byte ring. One byte always stays unused so that
+ * head == tail means empty and the ring never looks empty when full.
+ */
+
+static U32 circ_buf_size(CIRCULAR_BUFFER_T *mailbox) {
+    return (U8 *) mailbox->buffer_end - (U8 *) mailbox->buffer_start;
+}
+
+U32 circ_buf_used(CIRCULAR_BUFFER_T *mailbox) {
+    U8 *head = mailbox->head;
+    U8 *tail = mailbox->tail;
+
+    return tail >= head ? tail - head : circ_buf_size(mailbox) - (head - tail);
+}
+
+/* bytes that can be queued, the size given to init minus the spare byte */
+U32 circ_buf_capacity(CIRCULAR_BUFFER_T *mailbox) {
+    return circ_buf_size(mailbox) - 1;
+}
+
 CIRCULAR_BUFFER_T *circular_buffer_init(CIRCULAR_BUFFER_T *mailbox, void *ptr, size_t size) {
     mailbox->buffer_start = ptr;
-    mailbox->buffer_end = ptr + size;
+    mailbox->buffer_end = (U8 *) ptr + size;
     mailbox->head = ptr;
     mailbox->tail = ptr;
+    return mailbox;
 }
 
 int is_circ_buf_empty(CIRCULAR_BUFFER_T *mailbox) {
     return mailbox->head == mailbox->tail;
 }
 
+/**
+ * @return: 1 if fewer than length bytes are free
+ */
 int is_circ_buf_full(CIRCULAR_BUFFER_T *mailbox, U32 length) {
-    if (mailbox->tail < mailbox->head && mailbox->tail + length < mailbox->head) {
-        return 0;
-    } else if (mailbox->tail > mailbox->head) {
-        if (mailbox->tail + length <= mailbox->buffer_end) {
-            return 0;
-        } else if (mailbox->buffer_start + length - (mailbox->buffer_end - mailbox->tail) < mailbox->head) {
-            return 0;
-        }
-    }
-
-    return 1;
+    return circ_buf_used(mailbox) + length > circ_buf_size(mailbox) - 1;
 }
 
+/* copy len bytes in at the tail, PRE: they fit */
+void circ_buf_put(CIRCULAR_BUFFER_T *mailbox, const void *src, U32 len) {
+    const U8 *p = src;
+    U8 *tail = mailbox->tail;
 
-U32 peek_msg_len(CIRCULAR_BUFFER_T *mailbox) {
-    U32 len = 0;
-    U32 res = 0;
-    void *iterator = mailbox->head;
+    while (len-- > 0) {
+        *tail++ = *p++;
+        if (tail == mailbox->buffer_end) {
+            tail = mailbox->buffer_start;
+        }
+    }
+    mailbox->tail = tail;
+}
 
-    for (int i = 4; i > 0; i--) {
-        res = (*iterator) << (i-1);
-        iterator = iterator + 1;
+/* copy len bytes out from the head, dst may be NULL to drop them */
+void circ_buf_get(CIRCULAR_BUFFER_T *mailbox, void *dst, U32 len) {
+    U8 *p = dst;
+    U8 *head = mailbox->head;
 
-        if (iterator > mailbox->buffer_end) {
-            iterator = mailbox->buffer_start;
+    while (len-- > 0) {
+        if (p != NULL) {
+            *p++ = *head;
+        }
+        head++;
+        if (head == mailbox->buffer_end) {
+            head = mailbox->buffer_start;
         }
     }
-
-    return res;
+    mailbox->head = head;
 }
 
-U32 peek_msg_type(CIRCULAR_BUFFER_T *mailbox) {
-    U32 type = 0;
+/* read a word at offset bytes from the head without consuming it, PRE: offset < size */
+static U32 circ_buf_peek_word(CIRCULAR_BUFFER_T *mailbox, U32 offset) {
+    U8 *it = (U8 *) mailbox->head + offset;
     U32 res = 0;
-    void *iterator = mailbox->head;
-    // Iterate thru first 4 bits, then do the same like in peek_msg_len
+    int i;
 
-    if (iterator + 4 <= mailbox->buffer_end) {
-        iterator = iterator + 4;
-    } else {
-        iterator = mailbox->buffer_start + 4 - (mailbox->buffer_end - iterator);
+    if (it >= (U8 *) mailbox->buffer_end) {
+        it -= circ_buf_size(mailbox);
     }
 
-    for (int i = 4; i > 0; i--) {
-        res = (*iterator) << (i-1);
-        iterator = iterator + 1;
-
-        if (iterator > mailbox->buffer_end) {
-            iterator = mailbox->buffer_start;
+    for (i = 0; i < 4; i++) {
+        res |= (U32) *it << (8 * i);     /* little endian, like the header */
+        it++;
+        if (it == mailbox->buffer_end) {
+            it = mailbox->buffer_start;
         }
     }
 
     return res;
 }
 
-int dequeue_msg(CIRCULAR_BUFFER_T *mailbox, void *buf, size_t buf_len) {
-    if (mailbox->tail == mailbox->head) {
-        return 0;
-    }
+U32 peek_msg_len(CIRCULAR_BUFFER_T *mailbox) {
+    return circ_buf_peek_word(mailbox, 0);
+}
+
+U32 peek_msg_type(CIRCULAR_BUFFER_T *mailbox) {
+    return circ_buf_peek_word(mailbox, 4);
+}
 
-    U32 length = peek_msg_len(mailbox);
+/**
+ * @brief: remove the message at the head
+ * @return: 1 on success, 0 if the ring is empty or buf is too small,
+ *          in which case the message stays queued
+ */
+int dequeue_msg(CIRCULAR_BUFFER_T *mailbox, void *buf, size_t buf_len) {
+    U32 length;
 
-    if (length <= 0) {
+    if (is_circ_buf_empty(mailbox)) {
         return 0;
     }
 
+    length = peek_msg_len(mailbox);
     if (buf_len < length) {
         return 0;
     }
 
-    for (int i = 0; i < length; i++) {
-        *(buf + i) = *(mailbox->head);
-
-        mailbox->head = mailbox->head + 1;
-
-        if (mailbox->head > mailbox->buffer_end) {
-            mailbox->head = mailbox->buffer_start;
-        }
-    }
-
+    circ_buf_get(mailbox, buf, length);
     return 1;
 }
 
+/**
+ * @return: 1 on success, 0 if the message does not fit
+ */
 int enqueue_msg(CIRCULAR_BUFFER_T *mailbox, void *msg) {
-    U32 length = *((U32 *) msg);
+    U32 length = ((RTX_MSG_HDR *) msg)->length;
 
-    if (length <= 0) {
+    if (length < sizeof(RTX_MSG_HDR) || is_circ_buf_full(mailbox, length)) {
         return 0;
     }
 
-    for (int i = 0; i < length; i++) {
-        *(mailbox->tail) = msg + i;
+    circ_buf_put(mailbox, msg, length);
+    return 1;
+}
 
-        mailbox->tail = mailbox->tail + 1;
+/**
+ * @brief: count the queued messages by walking their headers
+ * @param: trailer, bytes stored after every message (the mailbox's sender TID)
+ */
+U32 circ_buf_count_msgs(CIRCULAR_BUFFER_T *mailbox, U32 trailer) {
+    U32 used = circ_buf_used(mailbox);
+    U32 offset = 0;
+    U32 n = 0;
 
-        if (mailbox->tail > mailbox->buffer_end) {
-            mailbox->tail = mailbox->buffer_start;
+    while (offset < used) {
+        U32 length = circ_buf_peek_word(mailbox, offset);
+
+        if (length < sizeof(RTX_MSG_HDR)) {
+            break;      /* not a header, stop instead of spinning on it */
         }
+        offset += length + trailer;
+        n++;
     }
 
-    return 1;
+    return n;
 }
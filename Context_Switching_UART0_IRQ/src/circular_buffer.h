@@ -15,9 +15,14 @@ typedef struct circular_buffer {
 CIRCULAR_BUFFER_T *circular_buffer_init(CIRCULAR_BUFFER_T *mailbox, void *ptr, size_t size);
 int is_circ_buf_empty(CIRCULAR_BUFFER_T *mailbox);
 int is_circ_buf_full(CIRCULAR_BUFFER_T *mailbox, U32 length);
+U32 circ_buf_used(CIRCULAR_BUFFER_T *mailbox);
+U32 circ_buf_capacity(CIRCULAR_BUFFER_T *mailbox);
+U32 circ_buf_count_msgs(CIRCULAR_BUFFER_T *mailbox, U32 trailer);
 U32 peek_msg_len(CIRCULAR_BUFFER_T *mailbox);
 U32 peek_msg_type(CIRCULAR_BUFFER_T *mailbox);
 int dequeue_msg(CIRCULAR_BUFFER_T *mailbox, void *buf, size_t buf_len);
 int enqueue_msg(CIRCULAR_BUFFER_T *mailbox, void *msg);
+void circ_buf_put(CIRCULAR_BUFFER_T *mailbox, const void *src, U32 len);
+void circ_buf_get(CIRCULAR_BUFFER_T *mailbox, void *dst, U32 len);
 
 #endif //ECE350_CIRCULAR_BUFFER_H
@@ -0,0 +1,128 @@
+/* @brief: defines and structs shared by kernel and user on top of common.h
+ * @file: common_ext.h
+ * NOTE: common.h is the course-provided header and stays unmodified,
+ *       additions to the user API live here instead.
+ */
+
+#ifndef _COMMON_EXT_H_
+#define _COMMON_EXT_H_
+
+#include "common.h"
+
+/* ----- Definitions ----- */
+
+/* task states on top of the ones in common.h */
+#define BLK_DELAY             6     /* suspended by tsk_delay */
+#define BLK_SEM               7     /* blocked in sem_wait */
+#define BLK_MUT               8     /* blocked in mtx_lock */
+#define BLK_EVT               9     /* blocked in evt_wait */
+
+/* TCB table size limits, MAX_TASKS in common.h is the default rtx_init uses */
+#define MAX_TASKS_LIMIT       0xFD  /* TIDs 0xFD-0xFF are reserved below */
+#define TID_KERNEL            0xFD  /* owner of the kernel's heap blocks, not a task */
+
+/* kernel stack sizes, RTX_TASK_INFO.k_stack_size = 0 picks KERN_STACK_SIZE from common.h.
+   SVC_Handler runs kernel code on the caller's PSP, so an unprivileged task's
+   SVCs use its user stack. Its kernel stack takes the IRQs that interrupt it,
+   and a preemption switches out and back in on it */
+#define KERN_STACK_MIN        0x180 /* an IRQ, the switch out and tsk_reap on the way back */
+
+/* task-local storage, the running task's slots are g_tls[0..TLS_SLOTS-1] */
+#define TLS_SLOTS             4
+
+/* user task globals an unprivileged task may pass as an SVC buffer, e.g.
+   static U8 g_buf[64] RTX_USER_DATA; the linker collects them in the
+   rtx_udata section and svc_ptr_ok refuses every other global of the image */
+#define RTX_USER_DATA         __attribute__((section("rtx_udata"), aligned(8)))
+
+/* evt_wait options */
+#define EVT_ANY               0x0   /* wake when any of the flags is set */
+#define EVT_ALL               0x1   /* wake when all of the flags are set */
+#define EVT_NO_CLEAR          0x2   /* leave the flags that ended the wait set */
+
+/* event flags the kernel sets from interrupt handlers, the rest are free */
+#define EVT_UART0_TX_DONE     0x80000000    /* every console channel drained */
+#define EVT_UART0_TX_SPACE    0x40000000    /* a full console channel fell below its low-water mark */
+
+/* message types on top of the ones in common.h, sent to the display task */
+#define CON_OPEN              5     /* data: U8 priority, then the tag put before each line */
+#define CON_CLOSE             6     /* data: one ignored byte, back to the default channel */
+
+/* SVC numbers of the user API, encoded in the SVC instruction's immediate.
+   0 is never used so a stray SVC 0 is rejected. */
+#define SVC_MEM_INIT          1
+#define SVC_MEM_ALLOC         2
+#define SVC_MEM_DEALLOC       3
+#define SVC_MEM_COUNT_EXTFRAG 4
+#define SVC_RTX_INIT          5
+#define SVC_TSK_YIELD         6
+#define SVC_TSK_CREATE        7
+#define SVC_TSK_EXIT          8
+#define SVC_TSK_SET_PRIO      9
+#define SVC_TSK_GET           10
+#define SVC_TSK_LS            11
+#define SVC_TSK_STATS         12
+#define SVC_MBX_CREATE        13
+#define SVC_SEND_MSG          14
+#define SVC_RECV_MSG          15
+#define SVC_MBX_LS            16
+#define SVC_TSK_DELAY         17
+#define SVC_MEM_ALLOC_WAIT    18
+#define SVC_SEM_CREATE        19
+#define SVC_SEM_WAIT          20
+#define SVC_SEM_POST          21
+#define SVC_SEM_DELETE        22
+#define SVC_MTX_CREATE        23
+#define SVC_MTX_LOCK          24
+#define SVC_MTX_UNLOCK        25
+#define SVC_MTX_DELETE        26
+#define SVC_EVT_SET           27
+#define SVC_EVT_CLEAR         28
+#define SVC_EVT_WAIT          29
+#define SVC_RTX_INIT_CFG      30
+#define SVC_TSK_CREATE_EX     31
+#define SVC_MBX_STATS         32
+#define SVC_MEM_TRACE_DUMP    33    /* RTX_ERR unless the kernel is built with MEM_TRACE */
+#define SVC_NUM_CALLS         34    /* one past the highest SVC number */
+
+/* ----- Types ----- */
+typedef unsigned char   sem_t;  /* semaphore handle */
+typedef unsigned char   mtx_t;  /* mutex handle */
+
+/* ----- Structures ----- */
+
+/* rtx_init_cfg() parameters, rtx_init() is rtx_init_cfg() with max_tasks = MAX_TASKS */
+typedef struct rtx_config {
+    size_t blk_size;     /* passed to mem_init                                */
+    int    algo;         /* passed to mem_init                                */
+    U16    max_tasks;    /* TCBs and kernel stacks incl. the null task, TID_KCD + 1..MAX_TASKS_LIMIT */
+} RTX_CONFIG;
+
+/* Task run-time statistics, one entry per task in tsk_stats() */
+typedef struct rtx_task_stats {
+    U64    run_cycles;   /* CPU cycles spent running                   */
+    U64    blk_cycles;   /* CPU cycles from blocking in any BLK_ state */
+                         /* until switched back in                     */
+    U32    last_run;     /* cycle counter when the task last ran       */
+    U32    num_switches; /* times the task was switched in             */
+    U32    num_vol;      /* voluntary switches (yield, block, exit)    */
+    U32    num_invol;    /* involuntary switches (preempted)           */
+    U16    u_stack_size; /* user stack size in bytes, 0 if privileged  */
+    U16    u_stack_used; /* user stack high-water mark, SVCs included  */
+    U16    k_stack_size; /* kernel stack size in bytes                 */
+    U16    k_stack_used; /* kernel stack high-water mark in bytes      */
+    task_t tid;          /* Task ID                                    */
+    U8     prio;         /* Execution priority                         */
+    U8     state;        /* Task state                                 */
+} RTX_TASK_STATS;
+
+/* Mailbox occupancy, one entry per mailbox in mbx_stats() */
+typedef struct rtx_mbx_stats {
+    U32    capacity;     /* bytes the mailbox holds, the mbx_create size */
+    U32    used;         /* bytes queued, headers and sender TIDs included */
+    U16    num_msgs;     /* messages queued                            */
+    U8     num_waiters;  /* tasks blocked on it, only the owner in recv_msg */
+    task_t tid;          /* owner                                      */
+} RTX_MBX_STATS;
+
+#endif // _COMMON_EXT_H_
@@ -0,0 +1,251 @@
+/**
+ * @file:   console.c
+ * @brief:  UART0 console multiplexer, see console.h
+ * NOTE: Each ring has one producer (con_put, display task, interrupts off
+ *       while it touches the shared state) and one consumer (con_tx_isr).
+ *       The indices run freely and are reduced modulo CON_RING_SIZE on
+ *       access, so head - tail is the fill.
+ *       The wire only switches channels after a '\n' or when the channel
+ *       on it runs dry, so complete lines are never interleaved. A line cut
+ *       off that way (an echo still being typed) is ended with CR LF before
+ *       the next channel's line, and continues untagged when its channel
+ *       gets the wire back.
+ */
+
+#include <LPC17xx.h>
+#include "console.h"
+#include "uart_def.h"
+#include "k_evt.h"
+#include "k_rtx.h"
+
+typedef struct con_channel {
+    U8  ring[CON_RING_SIZE];
+    volatile U32 head;      /* next byte written, producer only */
+    volatile U32 tail;      /* next byte sent, THRE interrupt only */
+    U32 bytes_out;
+    U32 bytes_dropped;
+    char tag[CON_TAG_MAX + 1];
+    task_t owner;           /* valid while open */
+    U8  open;               /* owned by a task, channel 0 is never opened */
+    U8  prio;
+    U8  mid_line;           /* the next byte from the ring continues a line */
+    U8  tag_pos;            /* tag characters already sent for that line */
+    U8  stalled;            /* the producer found the ring full */
+} CON_CHANNEL_T;
+
+static CON_CHANNEL_T g_con[CON_CHANNELS] = {
+    [0] = { .prio = CON_DEFAULT_PRIO },
+};
+static CON_CHANNEL_T *g_con_cur;    /* channel whose line is on the wire, NULL between lines */
+static U8 g_con_rr;                 /* last channel picked, round robin start */
+static U8 g_con_busy;               /* IER_THRE is on and the FIFO is draining */
+static task_t g_con_waiter;         /* task signalled with EVT_UART0_TX_ */
+static const char g_con_crlf[] = "\r\n";
+static U8 g_con_crlf_pos = sizeof(g_con_crlf) - 1;  /* CR LF characters sent after a cut */
+
+extern TCB *gp_current_task;
+
+/**
+ * @brief: give owner a channel of its own or update the one it has
+ * @param: tag, sent before every line, tag_len 0 for none
+ * @return: channel number, RTX_ERR if prio is invalid or all channels are taken
+ */
+int con_open(task_t owner, U8 prio, const char *tag, U32 tag_len) {
+    int ch = con_find(owner);
+
+    if (prio > LOWEST || tag_len > CON_TAG_MAX) {
+        return RTX_ERR;
+    }
+
+    if (ch == 0) {
+        /* a free channel that has finished sending its previous owner's data */
+        for (ch = 1; ch < CON_CHANNELS; ch++) {
+            if (!g_con[ch].open && g_con[ch].head == g_con[ch].tail && &g_con[ch] != g_con_cur) {
+                break;
+            }
+        }
+        if (ch == CON_CHANNELS) {
+            return RTX_ERR;
+        }
+    }
+
+    __disable_irq();
+    g_con[ch].owner = owner;
+    g_con[ch].open = 1;
+    g_con[ch].prio = prio;
+    for (U32 i = 0; i < tag_len; i++) {
+        g_con[ch].tag[i] = tag[i];
+    }
+    g_con[ch].tag[tag_len] = '\0';
+    __enable_irq();
+
+    return ch;
+}
+
+/**
+ * @brief: give owner's channel back, data already queued is still sent
+ */
+int con_close(task_t owner) {
+    int ch = con_find(owner);
+
+    if (ch == 0) {
+        return RTX_ERR;
+    }
+    g_con[ch].open = 0;
+    return RTX_OK;
+}
+
+/* the channel of tid, the default channel if it has none */
+int con_find(task_t tid) {
+    for (int ch = 1; ch < CON_CHANNELS; ch++) {
+        if (g_con[ch].open && g_con[ch].owner == tid) {
+            return ch;
+        }
+    }
+    return 0;
+}
+
+/* move up to a FIFO's worth of bytes to THR, PRE: UART0 IRQ can't run */
+static int con_fill(LPC_UART_TypeDef *pUart) {
+    int n = 0;
+
+    while (n < UART_TX_FIFO_DEPTH) {
+        CON_CHANNEL_T *ch = g_con_cur;
+
+        if (ch == NULL || ch->head == ch->tail) {
+            /* between lines, or the line's channel ran dry: pick again */
+            CON_CHANNEL_T *prev = ch;
+
+            ch = NULL;
+            for (int k = 1; k <= CON_CHANNELS; k++) {
+                CON_CHANNEL_T *c = &g_con[(g_con_rr + k) % CON_CHANNELS];
+                if (c->head != c->tail && (ch == NULL || c->prio < ch->prio)) {
+                    ch = c;
+                }
+            }
+            g_con_cur = ch;
+            if (ch == NULL) {
+                break;
+            }
+            g_con_rr = ch - g_con;
+            if (prev != NULL && prev != ch && prev->mid_line) {
+                g_con_crlf_pos = 0;
+            }
+        }
+
+        if (g_con_crlf_pos < sizeof(g_con_crlf) - 1) {
+            pUart->THR = g_con_crlf[g_con_crlf_pos++];
+            n++;
+            continue;
+        }
+
+        U8 c = ch->ring[ch->tail % CON_RING_SIZE];
+
+        if (!ch->mid_line && c != '\r' && c != '\n' && ch->tag[ch->tag_pos] != '\0') {
+            pUart->THR = ch->tag[ch->tag_pos++];
+            n++;
+            continue;
+        }
+
+        pUart->THR = c;
+        ch->tail++;
+        n++;
+        if (c == '\n') {
+            ch->mid_line = 0;
+            ch->tag_pos = 0;
+            g_con_cur = NULL;
+        } else if (c != '\r') {
+            ch->mid_line = 1;
+        }
+    }
+
+    return n;
+}
+
+/**
+ * @brief: queue bytes on a channel and start the transmitter if it is idle
+ * @return: number of bytes queued, less than len if the ring is full. The
+ *          caller then gets EVT_UART0_TX_SPACE once the ring has drained
+ *          below CON_LOW_WATER, and EVT_UART0_TX_DONE when all are empty.
+ * NOTE: privileged callers only, the display task.
+ */
+U32 con_put(int ch, const void *buf, U32 len) {
+    CON_CHANNEL_T *c = &g_con[ch];
+    const U8 *p = buf;
+    U32 n = 0;
+
+    __disable_irq();
+    g_con_waiter = gp_current_task->tid;
+    while (n < len && c->head - c->tail < CON_RING_SIZE) {
+        c->ring[c->head % CON_RING_SIZE] = p[n++];
+        c->head++;
+    }
+    c->bytes_out += n;
+    if (n < len) {
+        c->stalled = 1;
+    }
+    if (!g_con_busy && n > 0) {
+        /* the FIFO is empty while IER_THRE is off, prime it and let THRE take over */
+        LPC_UART_TypeDef *pUart = (LPC_UART_TypeDef *) LPC_UART0;
+        g_con_busy = 1;
+        con_fill(pUart);
+        pUart->IER |= IER_THRE;
+    }
+    __enable_irq();
+
+    return n;
+}
+
+void con_dropped(int ch, U32 len) {
+    g_con[ch].bytes_dropped += len;
+}
+
+/**
+ * @brief: snapshot of one channel for the console report
+ * @return: RTX_OK, RTX_ERR if the channel is free and empty
+ */
+int con_info(int ch, CON_INFO_T *info) {
+    CON_CHANNEL_T *c;
+
+    if (ch < 0 || ch >= CON_CHANNELS) {
+        return RTX_ERR;
+    }
+    c = &g_con[ch];
+    if (ch != 0 && !c->open && c->head == c->tail) {
+        return RTX_ERR;
+    }
+    info->pending = c->head - c->tail;
+    info->bytes_out = c->bytes_out;
+    info->bytes_dropped = c->bytes_dropped;
+    info->owner = ch == 0 ? TID_KERNEL : c->owner;
+    info->prio = c->prio;
+    for (int i = 0; i <= CON_TAG_MAX; i++) {
+        info->tag[i] = c->tag[i];
+    }
+    return RTX_OK;
+}
+
+/**
+ * @brief: THRE interrupt, refill the FIFO or stop the transmitter
+ * @return: 1 if a task was woken that should preempt the running one
+ */
+int con_tx_isr(void) {
+    LPC_UART_TypeDef *pUart = (LPC_UART_TypeDef *) LPC_UART0;
+    int preempt = 0;
+    int sent = con_fill(pUart);
+
+    for (int ch = 0; ch < CON_CHANNELS; ch++) {
+        CON_CHANNEL_T *c = &g_con[ch];
+        if (c->stalled && c->head - c->tail < CON_LOW_WATER) {
+            c->stalled = 0;
+            preempt |= k_evt_set_isr(g_con_waiter, EVT_UART0_TX_SPACE);
+        }
+    }
+
+    if (sent == 0) {
+        pUart->IER &= ~IER_THRE;
+        g_con_busy = 0;
+        preempt |= k_evt_set_isr(g_con_waiter, EVT_UART0_TX_DONE);
+    }
+    return preempt;
+}
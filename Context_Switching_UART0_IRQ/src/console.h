@@ -0,0 +1,44 @@
+/**
+ * @file:   console.h
+ * @brief:  UART0 console multiplexer, per-task output channels with priorities
+ * NOTE: Every channel has its own transmit ring, a priority (HIGH..LOWEST,
+ *       the task priorities) and an optional tag sent before each of its
+ *       lines. The THRE interrupt always continues the line on the wire and
+ *       then picks the highest priority channel with data, round robin among
+ *       equals, so an alarm line goes out before any further bulk line.
+ *       Only the display task writes to the channels.
+ */
+
+#ifndef CONSOLE_H_
+#define CONSOLE_H_
+
+#include "common_ext.h"
+
+/* ----- Definitions ----- */
+#define CON_CHANNELS       4                        /* channel 0 is the default, for tasks without one */
+#define CON_RING_SIZE      256                      /* bytes per channel, a power of two */
+#define CON_LOW_WATER      (CON_RING_SIZE / 2)      /* EVT_UART0_TX_SPACE below this */
+#define CON_TAG_MAX        8                        /* tag characters, e.g. "[alarm] " */
+#define CON_DEFAULT_PRIO   MEDIUM
+#define UART_TX_FIFO_DEPTH 16                       /* bytes per THRE interrupt */
+
+/* ----- Types ----- */
+typedef struct con_info {
+    U32    pending;         /* bytes waiting in the ring */
+    U32    bytes_out;       /* bytes queued */
+    U32    bytes_dropped;   /* bytes the display task gave up on */
+    char   tag[CON_TAG_MAX + 1];
+    task_t owner;           /* TID_KERNEL for the default channel */
+    U8     prio;
+} CON_INFO_T;
+
+/* ----- Functions ----- */
+int  con_open(task_t owner, U8 prio, const char *tag, U32 tag_len);
+int  con_close(task_t owner);
+int  con_find(task_t tid);
+U32  con_put(int ch, const void *buf, U32 len);
+void con_dropped(int ch, U32 len);
+int  con_info(int ch, CON_INFO_T *info);
+int  con_tx_isr(void);
+
+#endif /* ! CONSOLE_H_ */
@@ -0,0 +1,125 @@
+/**
+ * @file:   k_evt.c
+ * @brief:  per-task event flags
+ * NOTE: Each task has 32 flags in its TCB. Setting flags only ORs a word and,
+ *       if the owner waits for them, makes it ready: no mailbox, no copy.
+ *       A waiting task is parked in BLK_EVT without a wait queue (only the
+ *       owner waits on its own flags) and keeps its mask in wait_arg.
+ */
+
+#include "k_evt.h"
+#include "k_task.h"
+
+#ifdef DEBUG_0
+#include "printf.h"
+#endif /* DEBUG_0 */
+
+extern TCB *gp_current_task;
+extern TCB *ready_queue_head;
+extern U16 g_max_tasks;
+extern TCB *g_tcbs;
+
+/* flags of mask that satisfy a wait with option opt, 0 if the wait goes on */
+static U32 evt_match(U32 flags, U32 mask, U8 opt) {
+    U32 hit = flags & mask;
+
+    if (opt & EVT_ALL) {
+        return hit == mask ? hit : 0;
+    }
+    return hit;
+}
+
+/**
+ * @brief: set flags of tid and wake it if that completes its wait
+ * @return: 1 if tid was woken and outranks the running task
+ */
+static int evt_post(TCB *task, U32 flags) {
+    task->evt_flags |= flags;
+
+    if (task->state != BLK_EVT || evt_match(task->evt_flags, task->wait_arg, task->evt_opt) == 0) {
+        return 0;
+    }
+
+    k_tsk_unblock(task, RTX_OK);
+    return task->prio < gp_current_task->prio;
+}
+
+static TCB *evt_task(task_t tid) {
+    if (tid >= g_max_tasks || g_tcbs[tid].state == DORMANT) {
+        #ifdef DEBUG_0
+        printf("[ERROR] evt: task %d does not exist\n\r", tid);
+        #endif /* DEBUG_0 */
+        return NULL;
+    }
+    return &g_tcbs[tid];
+}
+
+int k_evt_set(task_t tid, U32 flags) {
+    TCB *task = evt_task(tid);
+
+    if (task == NULL) {
+        return RTX_ERR;
+    }
+
+    if (evt_post(task, flags)) {
+        return k_tsk_preempt();
+    }
+    return RTX_OK;
+}
+
+/**
+ * @brief: same as k_evt_set for IRQ handlers, which cannot trap into the
+ *         kernel. The handler forces the switch itself when this returns 1,
+ *         the way UART0_IRQHandler does with g_switch_flag.
+ */
+int k_evt_set_isr(task_t tid, U32 flags) {
+    TCB *task = evt_task(tid);
+
+    if (task == NULL) {
+        return 0;
+    }
+    return evt_post(task, flags);
+}
+
+int k_evt_clear(U32 flags) {
+    gp_current_task->evt_flags &= ~flags;
+    return RTX_OK;
+}
+
+/**
+ * @brief: wait until any (EVT_ANY) or all (EVT_ALL) of flags are set
+ * @param: opt, EVT_ANY or EVT_ALL, plus EVT_NO_CLEAR to leave the flags set
+ * @param: timeout, ticks to wait, 0 to only test, WAIT_FOREVER
+ * @param: got, if not NULL receives the flags that ended the wait
+ * @return: RTX_OK, RTX_ERR on timeout or if flags is 0
+ */
+int k_evt_wait(U32 flags, U8 opt, U32 timeout, U32 *got) {
+    TCB *task = gp_current_task;
+    U32 hit;
+
+    if (flags == 0) {
+        return RTX_ERR;
+    }
+
+    hit = evt_match(task->evt_flags, flags, opt);
+    if (hit == 0) {
+        if (timeout == 0 || task->prio == PRIO_NULL) {
+            return RTX_ERR;
+        }
+
+        task->wait_arg = flags;
+        task->evt_opt = opt;
+        if (k_tsk_block(NULL, BLK_EVT, timeout) != RTX_OK) {
+            return RTX_ERR;
+        }
+        hit = evt_match(task->evt_flags, flags, opt);
+    }
+
+    if (!(opt & EVT_NO_CLEAR)) {
+        task->evt_flags &= ~hit;
+    }
+    if (got != NULL) {
+        *got = hit;
+    }
+    return RTX_OK;
+}
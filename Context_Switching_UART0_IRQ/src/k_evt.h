@@ -0,0 +1,17 @@
+/**
+ * @file:   k_evt.h
+ * @brief:  per-task event flags
+ */
+
+#ifndef K_EVT_H_
+#define K_EVT_H_
+
+#include "k_rtx.h"
+
+/* ----- Functions ----- */
+int k_evt_set(task_t tid, U32 flags);
+int k_evt_clear(U32 flags);
+int k_evt_wait(U32 flags, U8 opt, U32 timeout, U32 *got);
+int k_evt_set_isr(task_t tid, U32 flags);   /* from an IRQ handler, 1 if the caller should preempt */
+
+#endif /* ! K_EVT_H_ */
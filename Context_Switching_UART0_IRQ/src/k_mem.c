@@ -8,6 +8,9 @@
 #include "k_mem.h"
 #include "common.h"
 #include "uart_polling.h"
+#ifdef MEM_TRACE
+#include "k_wait.h"
+#endif /* MEM_TRACE */
 #ifdef DEBUG_MEM
 #include "printf.h"
 #endif /* ! DEBUG_MEM */
@@ -49,7 +52,11 @@ int mem_alloc_algo;
 size_t mem_blk_size;
 int mem_init_status;
 
+#ifdef DEBUG_MEM
 void print_linked_list(char *prefix);
+#else
+#define print_linked_list(prefix)
+#endif /* DEBUG_MEM */
 int first_fit_mem_init(unsigned int end_addr);
 void *first_fit_mem_alloc(size_t size);
 int first_fit_mem_dealloc(void *ptr);
@@ -58,6 +65,44 @@ int first_fit_count_extfrag(size_t size);
 extern unsigned int Image$$RW_IRAM1$$ZI$$Limit;
 extern TCB *gp_current_task;
 
+#ifdef MEM_TRACE
+/*
+*  Allocation trace recorder. Every k_mem_init/k_mem_alloc/k_mem_dealloc is
+*  appended to a ring that k_mem_trace_dump drains over UART1. When the ring
+*  is full new records are dropped and counted, so a dump never contains a
+*  silently broken sequence. host/mem_replay.c replays a captured dump.
+*/
+#define MEM_TRACE_INIT    'i'
+#define MEM_TRACE_ALLOC   'a'
+#define MEM_TRACE_DEALLOC 'd'
+
+#ifndef MEM_TRACE_TICK
+#ifdef HOST_PORT
+#define MEM_TRACE_TICK() (mem_trace_seq)   /* host tools may run without SysTick, use the op sequence */
+#else
+#define MEM_TRACE_TICK() (g_wait_ticks)    /* SysTick ticks, see k_wait.c */
+#endif /* HOST_PORT */
+#endif /* ! MEM_TRACE_TICK */
+
+typedef struct mem_trace_rec {
+    U32 tick;
+    U32 addr;   /* returned/freed address, heap start for MEM_TRACE_INIT */
+    U32 size;   /* requested size, blk_size for MEM_TRACE_INIT, return value for MEM_TRACE_DEALLOC */
+    U8  tid;    /* owner tid, algo for MEM_TRACE_INIT */
+    U8  op;
+} mem_trace_rec_t;
+
+mem_trace_rec_t mem_trace_ring[MEM_TRACE_LEN];
+U32 mem_trace_head;     /* next record to dump */
+U32 mem_trace_tail;     /* next free slot */
+#ifdef HOST_PORT
+U32 mem_trace_seq;
+#endif /* HOST_PORT */
+U32 mem_trace_dropped;
+
+void mem_trace_record(U8 op, U8 tid, U32 size, void *addr);
+#endif /* MEM_TRACE */
+
 int k_mem_init(size_t blk_size, int algo){
     U32 end_addr;
 
@@ -73,7 +118,7 @@ int k_mem_init(size_t blk_size, int algo){
         return RTX_ERR;
     }
 
-    end_addr = (unsigned int) &Image$$RW_IRAM1$$ZI$$Limit;
+    end_addr = (unsigned int) (uintptr_t) &Image$$RW_IRAM1$$ZI$$Limit;
 
     mem_blk_size = blk_size;
     mem_alloc_algo = algo;
@@ -88,11 +133,20 @@ int k_mem_init(size_t blk_size, int algo){
     switch (mem_alloc_algo) {
         case FIRST_FIT:
             mem_init_status = first_fit_mem_init(end_addr + 4);
-            return mem_init_status;
+            break;
         default:
             mem_init_status = RTX_ERR;
             return RTX_ERR;
     }
+
+#ifdef MEM_TRACE
+    mem_trace_head = 0;
+    mem_trace_tail = 0;
+    mem_trace_dropped = 0;
+    mem_trace_record(MEM_TRACE_INIT, algo, blk_size, (void *) (uintptr_t) (end_addr + 4));
+#endif /* MEM_TRACE */
+
+    return mem_init_status;
 }
 
 
@@ -116,12 +170,21 @@ void *k_mem_alloc(size_t size) {
         return NULL;
     }
 
+    void *ptr;
+
     switch (mem_alloc_algo) {
         case FIRST_FIT:
-            return first_fit_mem_alloc(size);
+            ptr = first_fit_mem_alloc(size);
+            break;
         default:
             return NULL;
     }
+
+#ifdef MEM_TRACE
+    mem_trace_record(MEM_TRACE_ALLOC, gp_current_task ? gp_current_task->tid : 0, size, ptr);
+#endif /* MEM_TRACE */
+
+    return ptr;
 }
 
 int k_mem_dealloc(void *ptr) {
@@ -137,12 +200,28 @@ int k_mem_dealloc(void *ptr) {
         return RTX_ERR;
     }
 
+    if (ptr == NULL) {
+#ifdef DEBUG_MEM
+        printf("k_mem_dealloc: ptr is NULL\r\n");
+#endif /* DEBUG_MEM */
+        return RTX_ERR;
+    }
+
+    int ret;
+
     switch (mem_alloc_algo) {
         case FIRST_FIT:
-            return first_fit_mem_dealloc(ptr);
+            ret = first_fit_mem_dealloc(ptr);
+            break;
         default:
             return RTX_ERR;
     }
+
+#ifdef MEM_TRACE
+    mem_trace_record(MEM_TRACE_DEALLOC, gp_current_task->tid, (U32) ret, ptr);
+#endif /* MEM_TRACE */
+
+    return ret;
 }
 
 int k_mem_count_extfrag(size_t size) {
@@ -173,6 +252,41 @@ int k_mem_count_extfrag(size_t size) {
     }
 }
 
+/**
+ * @brief: check that [ptr, ptr + len) lies inside one used heap block of tid
+ * @return: 1 if it does, 0 otherwise or if the range is not in the heap
+ * NOTE: walks the heap from its start, a block is free if and only if the
+ *       free list reaches it (see k_mem_check), so the cost grows with the
+ *       number of blocks below ptr.
+ */
+int k_mem_owned(const void *ptr, U32 len, U32 tid) {
+    char *lo = (char *) ptr;
+    char *addr = (char *) &Image$$RW_IRAM1$$ZI$$Limit + 4;
+    node_t *free_node = free_mem_head;
+
+    if (mem_init_status != RTX_OK || mem_alloc_algo != FIRST_FIT) {
+        return 0;
+    }
+    if (lo < addr || lo + len < lo || lo + len > (char *) IRAM1_END) {
+        return 0;
+    }
+
+    while (addr <= lo) {
+        if ((char *) free_node == addr) {
+            addr += sizeof(node_t) + free_node->size;
+            free_node = free_node->next;
+        } else {
+            used_mem_node_t *used = (used_mem_node_t *) addr;
+
+            addr += sizeof(used_mem_node_t) + used->size;
+            if (lo < addr) {
+                return used->owner_tid == tid && lo >= (char *) (used + 1) && lo + len <= addr;
+            }
+        }
+    }
+    return 0;       /* ptr is in a free block */
+}
+
 
 /*
 *  First Fit Memory Allocation
@@ -180,7 +294,7 @@ int k_mem_count_extfrag(size_t size) {
 
 
 int first_fit_mem_init(unsigned int heap_addr) {
-    free_mem_head = (node_t *) (heap_addr);
+    free_mem_head = (node_t *) (uintptr_t) heap_addr;
     free_mem_head->size = IRAM1_END - heap_addr - sizeof(node_t);
     free_mem_head->prev = NULL;
     free_mem_head->next = NULL;
@@ -220,6 +334,10 @@ void *first_fit_mem_alloc(size_t size) {
 #endif /* DEBUG_MEM */
 
     mem_chunk_size = CEIL((size + sizeof(used_mem_node_t)), mem_blk_size) * mem_blk_size;
+    /* a freed chunk is turned back into a node_t in place, so it must be able to hold one */
+    if (mem_chunk_size < sizeof(node_t)) {
+        mem_chunk_size = CEIL(sizeof(node_t), mem_blk_size) * mem_blk_size;
+    }
 #ifdef DEBUG_MEM
     printf("first_fit_mem_alloc: Return memory block size with header: 0x%x\r\n", mem_chunk_size);
 #endif /* DEBUG_MEM */
@@ -231,6 +349,13 @@ void *first_fit_mem_alloc(size_t size) {
         return NULL;
     }
 
+    if (gp_current_task == NULL) {
+#ifdef DEBUG_MEM
+        printf("first_fit_mem_alloc: No running task to alloc a memory block\r\n");
+#endif /* DEBUG_MEM */
+        return NULL;
+    }
+
     while (cur_node != NULL) {
         if (cur_node->size >= mem_chunk_size) {
 #ifdef DEBUG_MEM
@@ -251,6 +376,14 @@ void *first_fit_mem_alloc(size_t size) {
             new_node->next = cur_node->next;
             new_node->prev = cur_node->prev;
 
+            if (new_node->next != NULL) {
+                new_node->next->prev = new_node;
+            }
+
+            if (new_node->prev != NULL) {
+                new_node->prev->next = new_node;
+            }
+
 #ifdef DEBUG_MEM
             printf("first_fit_mem_alloc: New free node address 0x%x after splitting\r\n", new_node);
             printf("first_fit_mem_alloc: New free node size 0x%x after splitting\r\n", new_node->size);
@@ -260,14 +393,7 @@ void *first_fit_mem_alloc(size_t size) {
 
             ret_node = (used_mem_node_t *) cur_node;
             ret_node->size = mem_chunk_size - sizeof(used_mem_node_t);
-            if (gp_current_task) {
-                ret_node->owner_tid = gp_current_task->tid;
-            } else {
-#ifdef DEBUG_MEM
-                printf("first_fit_mem_alloc: No running task to alloc a memory block\r\n");
-#endif /* DEBUG_MEM */
-                return NULL;
-            }
+            ret_node->owner_tid = gp_current_task->tid;
 
 #ifdef DEBUG_MEM
             printf("first_fit_mem_alloc: New allocated node address 0x%x\r\n", ret_node);
@@ -290,16 +416,11 @@ void *first_fit_mem_alloc(size_t size) {
                 cur_node->prev->next = cur_node->next;
             }
 
+            /* hand out the whole block, including the part of the node_t header the used header does not need */
+            mem_chunk_size = cur_node->size + sizeof(node_t);
             ret_node = (used_mem_node_t *) cur_node;
-            ret_node->size = cur_node->size;
-            if (gp_current_task) {
-                ret_node->owner_tid = gp_current_task->tid;
-            } else {
-#ifdef DEBUG_MEM
-                printf("first_fit_mem_alloc: No running task to alloc a memory block\r\n");
-#endif /* DEBUG_MEM */
-                return NULL;
-            }
+            ret_node->size = mem_chunk_size - sizeof(used_mem_node_t);
+            ret_node->owner_tid = gp_current_task->tid;
 
 #ifdef DEBUG_MEM
             printf("first_fit_mem_alloc: New allocated node address 0x%x\r\n", ret_node);
@@ -322,7 +443,7 @@ void *first_fit_mem_alloc(size_t size) {
 
 
 int first_fit_mem_dealloc(void *ptr) {
-    node_t *new_node;
+    node_t *new_node = NULL;
     node_t *cur_node = free_mem_head;
     used_mem_node_t *dealloc_ptr = (used_mem_node_t *) ptr - 1;
 
@@ -384,6 +505,7 @@ int first_fit_mem_dealloc(void *ptr) {
                 new_node->prev = cur_node;
                 new_node->next = NULL;
                 cur_node->next = new_node;
+                break;
             }
 
             cur_node = cur_node->next;
@@ -397,7 +519,9 @@ int first_fit_mem_dealloc(void *ptr) {
 
                 new_node->prev->size = new_node->prev->size + new_node->size + sizeof(node_t);
                 new_node->prev->next = new_node->next;
-                new_node->next->prev = new_node->prev;
+                if (new_node->next != NULL) {
+                    new_node->next->prev = new_node->prev;
+                }
                 new_node = new_node->prev;
 
 #ifdef DEBUG_MEM
@@ -416,8 +540,8 @@ int first_fit_mem_dealloc(void *ptr) {
                 new_node->size = new_node->size + new_node->next->size + sizeof(node_t);
                 new_node->next = new_node->next->next;
 
-                if (new_node->next->next) {
-                    new_node->next->next->prev = new_node;
+                if (new_node->next != NULL) {
+                    new_node->next->prev = new_node;
                 }
 
 #ifdef DEBUG_MEM
@@ -470,8 +594,8 @@ int first_fit_count_extfrag(size_t size) {
 }
 
 
-void print_linked_list(char *prefix) {
 #ifdef DEBUG_MEM
+void print_linked_list(char *prefix) {
     node_t *cur_node = free_mem_head;
     int index = 0;
 
@@ -484,8 +608,156 @@ void print_linked_list(char *prefix) {
         cur_node = cur_node->next;
         index++;
     }
+}
 #endif /* DEBUG_MEM */
+
+
+#ifdef MEM_CHECK
+/**
+ * @brief: walk the whole heap and check that its blocks tile it exactly and
+ *         that the free list is address-ordered, doubly linked and coalesced
+ * @param: visit, called for every used block with its owner, the address
+ *         k_mem_alloc returned and the usable size, may be NULL
+ * @return: RTX_OK if the heap is consistent, RTX_ERR at the first problem
+ * NOTE: a block is free if and only if the free list reaches it, so walking
+ *       both at once tells the two kinds of headers apart.
+ */
+int k_mem_check(void (*visit)(U32 owner_tid, void *ptr, int size)) {
+    char *addr = (char *) &Image$$RW_IRAM1$$ZI$$Limit + 4;
+    node_t *free_node = free_mem_head;
+    node_t *prev_free = NULL;
+    char *prev_end = NULL;      /* end of the previous block if it was free */
+
+    if (mem_init_status != RTX_OK || mem_alloc_algo != FIRST_FIT) {
+        return RTX_ERR;
+    }
+    if (free_mem_head != NULL && free_mem_head->prev != NULL) {
+        return RTX_ERR;
+    }
+
+    while (addr < (char *) IRAM1_END) {
+        if ((char *) free_node == addr) {
+            if (free_node->prev != prev_free || free_node->size < 0 || prev_end == addr) {
+                return RTX_ERR;     /* broken back link, or two free blocks not coalesced */
+            }
+            addr += sizeof(node_t) + free_node->size;
+            prev_end = addr;
+            prev_free = free_node;
+            free_node = free_node->next;
+            if (free_node != NULL && (char *) free_node < addr) {
+                return RTX_ERR;     /* not address-ordered, or overlapping */
+            }
+        } else {
+            used_mem_node_t *used = (used_mem_node_t *) addr;
+
+            if (used->size <= 0) {
+                return RTX_ERR;
+            }
+            if (visit != NULL) {
+                visit(used->owner_tid, used + 1, used->size);
+            }
+            addr += sizeof(used_mem_node_t) + used->size;
+        }
+    }
+
+    /* the blocks end exactly at IRAM1_END and every free node was reached */
+    return addr == (char *) IRAM1_END && free_node == NULL ? RTX_OK : RTX_ERR;
+}
+#endif /* MEM_CHECK */
+
+
+#ifdef MEM_TRACE
+void mem_trace_record(U8 op, U8 tid, U32 size, void *addr) {
+    mem_trace_rec_t *rec;
+
+#ifdef HOST_PORT
+    mem_trace_seq++;
+#endif /* HOST_PORT */
+    if (mem_trace_tail - mem_trace_head >= MEM_TRACE_LEN) {
+        mem_trace_dropped++;
+        return;
+    }
+
+    rec = &mem_trace_ring[mem_trace_tail % MEM_TRACE_LEN];
+    rec->tick = MEM_TRACE_TICK();
+    rec->addr = (U32) (uintptr_t) addr;
+    rec->size = size;
+    rec->tid = tid;
+    rec->op = op;
+    mem_trace_tail++;
+}
+
+/* printf is only initialized under DEBUG_0, so the dump formats its own numbers */
+void mem_trace_put_num(U32 val, U32 base) {
+    char buf[12];
+    int i = sizeof(buf) - 1;
+
+    buf[i] = '\0';
+    do {
+        buf[--i] = "0123456789abcdef"[val % base];
+        val /= base;
+    } while (val != 0);
+
+    if (base == 16) {
+        buf[--i] = 'x';
+        buf[--i] = '0';
+    }
+    uart1_put_string(&buf[i]);
+}
+
+/**
+ * @brief: drain the trace ring over UART1, one "MT ..." line per record
+ *         MT begin <dropped since last dump>
+ *         MT i <tick> <algo> <blk_size> <heap start>
+ *         MT a <tick> <tid> <size> <addr, 0x0 if the alloc failed>
+ *         MT d <tick> <tid> <addr> <return value>
+ *         MT end
+ * @return: number of records dumped
+ * NOTE: uses polling output, call it from a task, never from an IRQ handler.
+ *       Tasks reach it through the mem_trace_dump SVC, the KCD runs it for %MT.
+ */
+int k_mem_trace_dump(void) {
+    int count = 0;
+    mem_trace_rec_t *rec;
+
+    uart1_put_string("MT begin ");
+    mem_trace_put_num(mem_trace_dropped, 10);
+    uart1_put_string("\r\n");
+    mem_trace_dropped = 0;
+
+    while (mem_trace_head != mem_trace_tail) {
+        rec = &mem_trace_ring[mem_trace_head % MEM_TRACE_LEN];
+
+        uart1_put_string("MT ");
+        uart1_put_char(rec->op);
+        uart1_put_char(' ');
+        mem_trace_put_num(rec->tick, 10);
+        uart1_put_char(' ');
+        mem_trace_put_num(rec->tid, 10);
+        uart1_put_char(' ');
+        if (rec->op == MEM_TRACE_DEALLOC) {
+            mem_trace_put_num(rec->addr, 16);
+            uart1_put_char(' ');
+            if ((int) rec->size == RTX_ERR) {
+                uart1_put_string("-1");
+            } else {
+                mem_trace_put_num(rec->size, 10);
+            }
+        } else {
+            mem_trace_put_num(rec->size, 10);
+            uart1_put_char(' ');
+            mem_trace_put_num(rec->addr, 16);
+        }
+        uart1_put_string("\r\n");
+
+        mem_trace_head++;
+        count++;
+    }
+
+    uart1_put_string("MT end\r\n");
+    return count;
 }
+#endif /* MEM_TRACE */
 
 
 int mem_cpy(void *destination, void *source, size_t size) {
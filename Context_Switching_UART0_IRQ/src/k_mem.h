@@ -11,7 +11,15 @@
 #include "k_rtx.h"
 
 /* ----- Definitions ----- */
+#ifndef IRAM1_END
 #define IRAM1_END 0x10008000
+#endif /* ! IRAM1_END */
+
+#ifdef MEM_TRACE
+#ifndef MEM_TRACE_LEN
+#define MEM_TRACE_LEN 64    /* alloc/dealloc records kept between two dumps */
+#endif /* ! MEM_TRACE_LEN */
+#endif /* MEM_TRACE */
 
 /* ----- Variables ----- */
 /* This symbol is defined by linker (see ARM Linker User Guide in Arm Compiler 5 Documentation) */   
@@ -22,7 +30,22 @@ int k_mem_init(size_t blk_size, int algo);
 void *k_mem_alloc(size_t size);
 int k_mem_dealloc(void *ptr);
 int k_mem_count_extfrag(size_t size);
+int k_mem_owned(const void *ptr, U32 len, U32 tid);    /* range inside a used block of tid */
 
 int mem_cpy(void *destination, void *source, size_t size);
 
+/* blocking variants, k_mem_wait.c */
+void *k_mem_alloc_wait(size_t size, U32 timeout);
+void *k_mem_alloc_fair(size_t size);
+int k_mem_dealloc_wake(void *ptr);
+int k_mem_wake_waiters(void);
+
+#ifdef MEM_TRACE
+int k_mem_trace_dump(void);     /* drain the allocation trace over UART1 */
+#endif /* MEM_TRACE */
+
+#ifdef MEM_CHECK
+int k_mem_check(void (*visit)(U32 owner_tid, void *ptr, int size));    /* heap consistency walk */
+#endif /* MEM_CHECK */
+
 #endif /* ! K_MEM_H_ */
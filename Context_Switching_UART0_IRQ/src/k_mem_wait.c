@@ -0,0 +1,113 @@
+/**
+ * @file:   k_mem_wait.c
+ * @brief:  blocking memory allocation on top of k_mem.c
+ * NOTE: Kept out of k_mem.c so the allocator itself stays free of scheduler
+ *       dependencies and still builds in the host tools.
+ *       Waiters are served strictly in priority order (FIFO within a
+ *       priority): after a free, the highest priority waiter is retried first
+ *       and the scan stops at the first request that still does not fit.
+ *       mem_alloc and mem_alloc_wait do not try the heap while a task of the
+ *       caller's priority or higher waits, so a stream of small requests
+ *       cannot starve a larger, more urgent one.
+ */
+
+#include "k_mem.h"
+#include "k_task.h"
+#include "k_wait.h"
+
+#ifdef DEBUG_0
+#include "printf.h"
+#endif /* DEBUG_0 */
+
+extern TCB *gp_current_task;
+
+WAIT_QUEUE_T g_mem_wait = {0};     /* tasks in BLK_MEM, wait_arg holds the size, then the block */
+
+/* a task of the caller's priority or higher waits, it gets the next free memory */
+static int mem_wait_ahead(void) {
+    TCB *task = k_wait_peek(&g_mem_wait);
+
+    return task != NULL && task->prio <= gp_current_task->prio;
+}
+
+/**
+ * @brief: allocate size bytes, blocking in BLK_MEM while the heap cannot serve it
+ * @param: timeout, ticks to wait, 0 to fail at once like k_mem_alloc, WAIT_FOREVER to wait
+ * @return: the block, NULL on timeout
+ */
+void *k_mem_alloc_wait(size_t size, U32 timeout) {
+    void *ptr = NULL;
+
+    if (!mem_wait_ahead()) {
+        ptr = k_mem_alloc(size);
+    }
+
+    if (ptr != NULL || size == 0 || timeout == 0) {
+        return ptr;
+    }
+
+    /* the null task must stay runnable, it cannot wait for memory */
+    if (gp_current_task->prio == PRIO_NULL) {
+        return NULL;
+    }
+
+    gp_current_task->wait_arg = size;
+    if (k_tsk_block(&g_mem_wait, BLK_MEM, timeout) != RTX_OK) {
+        return NULL;
+    }
+
+    return (void *) (uintptr_t) gp_current_task->wait_arg;
+}
+
+/**
+ * @brief: k_mem_alloc that does not pass waiting tasks, the mem_alloc SVC
+ * @return: the block, NULL if the heap cannot serve it or a task of the
+ *          caller's priority or higher waits for memory
+ */
+void *k_mem_alloc_fair(size_t size) {
+    return k_mem_alloc_wait(size, 0);
+}
+
+/**
+ * @brief: hand freed memory to waiting tasks, highest priority first.
+ *         The block is allocated on behalf of the waiter so it owns it.
+ * @return: number of tasks made ready
+ * NOTE: does not preempt the caller, see k_mem_dealloc_wake
+ */
+int k_mem_wake_waiters(void) {
+    TCB *caller = gp_current_task;
+    TCB *task;
+    void *ptr;
+    int n = 0;
+
+    while ((task = k_wait_peek(&g_mem_wait)) != NULL) {
+        gp_current_task = task;
+        ptr = k_mem_alloc(task->wait_arg);
+        gp_current_task = caller;
+
+        if (ptr == NULL) {
+            break;
+        }
+
+        task->wait_arg = (U32) (uintptr_t) ptr;
+        k_tsk_unblock(task, RTX_OK);
+        n++;
+    }
+
+    return n;
+}
+
+/**
+ * @brief: k_mem_dealloc that also serves waiting tasks, the mem_dealloc SVC
+ */
+int k_mem_dealloc_wake(void *ptr) {
+    if (k_mem_dealloc(ptr) == RTX_ERR) {
+        return RTX_ERR;
+    }
+
+    if (k_mem_wake_waiters() > 0) {
+        k_tsk_resched();
+    }
+
+    return RTX_OK;
+}
@@ -0,0 +1,156 @@
+/**
+ * @file:   k_mpu.c
+ * @brief:  MPU stack guard regions for unprivileged tasks
+ * NOTE: Regions 0-5 map the memory an unprivileged task may touch with the
+ *       attributes the default map gives it: flash read-only and cacheable,
+ *       SRAM normal memory, so writes stay buffered, peripherals device memory.
+ *       Anything else faults for unprivileged code, privileged code falls back
+ *       to the default map (PRIVDEFENA).
+ *       The SRAM regions are full access. Kernel data, the heap headers and
+ *       the other tasks' stacks share IRAM1 with the task's own memory and no
+ *       MPU region is fine enough to tell them apart, so the MPU does not keep
+ *       a task out of them. It guards stacks, svc_ptr_ok keeps the kernel from
+ *       writing through a bad pointer.
+ *       The guard uses the highest region number because the highest numbered
+ *       region wins where regions overlap. Privileged tasks run on their
+ *       kernel stack and are not guarded.
+ */
+
+#include <LPC17xx.h>
+#include "rtx.h"
+#include "k_mpu.h"
+#include "k_task.h"
+
+#ifdef DEBUG_0
+#include "printf.h"
+#endif /* DEBUG_0 */
+
+#define MPU_REGION_FLASH  0
+#define MPU_REGION_IRAM1  1
+#define MPU_REGION_AHB0   2
+#define MPU_REGION_AHB1   3
+#define MPU_REGION_GPIO   4
+#define MPU_REGION_PERIPH 5
+#define MPU_REGION_GUARD  7
+
+#define MPU_RASR_SIZE(log2_bytes) (((log2_bytes) - 1) << MPU_RASR_SIZE_Pos)
+#define MPU_AP_NONE 0x0     /* no access, privileged or not */
+#define MPU_AP_FULL 0x3     /* read/write, privileged or not */
+#define MPU_AP_RO   0x6     /* read-only, privileged or not */
+
+/* TEX, S, C, B as the default memory map sets them for each kind of memory */
+#define MPU_ATTR_FLASH  (MPU_RASR_C_Msk)                    /* normal, write-through */
+#define MPU_ATTR_SRAM   (MPU_RASR_C_Msk | MPU_RASR_B_Msk)   /* normal, write-back */
+#define MPU_ATTR_DEVICE (MPU_RASR_S_Msk | MPU_RASR_B_Msk)   /* shareable device */
+
+#define MMFSR_Msk        0xFF           /* MemManage status, the low byte of CFSR */
+#define EXC_RETURN_PSP   0xFFFFFFFD     /* the fault was taken from thread mode on PSP */
+
+extern TCB *gp_current_task;
+
+U32 g_mpu_guard_rasr;       /* RASR value of an enabled guard region */
+
+static void mpu_region(U32 region, U32 base, U32 log2_size, U32 ap, U32 attr) {
+    MPU->RNR = region;
+    MPU->RBAR = base;
+    MPU->RASR = (ap << MPU_RASR_AP_Pos) | attr | MPU_RASR_SIZE(log2_size) | MPU_RASR_ENABLE_Msk;
+}
+
+void k_mpu_init(void) {
+    U32 log2_size = 0;
+
+    while ((1u << log2_size) < MPU_GUARD_SIZE) {
+        log2_size++;
+    }
+    g_mpu_guard_rasr = (MPU_AP_NONE << MPU_RASR_AP_Pos) | MPU_RASR_XN_Msk |
+                       MPU_RASR_SIZE(log2_size) | MPU_RASR_ENABLE_Msk;
+
+    MPU->CTRL = 0;
+
+    /* LPC1768 memory map, bases are aligned to the region sizes */
+    mpu_region(MPU_REGION_FLASH,  0x00000000, 19, MPU_AP_RO, MPU_ATTR_FLASH);     /* 512KB flash */
+    mpu_region(MPU_REGION_IRAM1,  0x10000000, 15, MPU_AP_FULL, MPU_ATTR_SRAM);    /* 32KB IRAM1 */
+    mpu_region(MPU_REGION_AHB0,   0x2007C000, 14, MPU_AP_FULL, MPU_ATTR_SRAM);    /* 16KB AHB SRAM bank 0 */
+    mpu_region(MPU_REGION_AHB1,   0x20080000, 14, MPU_AP_FULL, MPU_ATTR_SRAM);    /* 16KB AHB SRAM bank 1 */
+    /* GPIO, then the APB and AHB peripherals with their bit-band alias, 512MB */
+    mpu_region(MPU_REGION_GPIO,   0x2009C000, 14, MPU_AP_FULL, MPU_ATTR_DEVICE | MPU_RASR_XN_Msk);
+    mpu_region(MPU_REGION_PERIPH, 0x40000000, 29, MPU_AP_FULL, MPU_ATTR_DEVICE | MPU_RASR_XN_Msk);
+
+    MPU->RNR = MPU_REGION_GUARD;
+    MPU->RASR = 0;
+
+    SCB->SHCSR |= SCB_SHCSR_MEMFAULTENA_Msk;
+    MPU->CTRL = MPU_CTRL_ENABLE_Msk | MPU_CTRL_PRIVDEFENA_Msk;
+    __DSB();
+    __ISB();
+}
+
+void k_mpu_guard_set(TCB *task) {
+    MPU->RNR = MPU_REGION_GUARD;
+    if (task->priv == 0 && task->psp_hi != NULL) {
+        MPU->RBAR = MPU_GUARD_BASE(TCB_PSP_LO(task));
+        MPU->RASR = g_mpu_guard_rasr;
+    } else {
+        MPU->RASR = 0;
+    }
+    __DSB();
+    __ISB();
+}
+
+/* where a faulted task resumes, unprivileged on a fresh stack frame */
+static void mpu_fault_exit(void) {
+    tsk_exit();
+}
+
+/**
+ * @brief: the running task touched its guard region, i.e. its stack overflowed,
+ *         or memory outside the regions above.
+ *         Report it as a fault of that task and end the task instead of
+ *         corrupting its neighbour.
+ * @param: exc_return, the LR the fault was taken with
+ * NOTE: The MPU stopped the access, so only the task's own stack is spent.
+ *       A fault in the task's own code (thread mode, PSP) returns into
+ *       mpu_fault_exit on an empty user stack, whose tsk_exit frees the task
+ *       through the usual path. A fault in kernel code, an SVC on the user
+ *       stack or a privileged task, left kernel state half updated, that
+ *       still fail-stops, and so does the null task, which cannot exit.
+ */
+void c_MemManage_Handler(U32 exc_return) {
+    TCB *task = gp_current_task;
+    U32 *sp;
+
+    #ifdef DEBUG_0
+    if (SCB->CFSR & SCB_CFSR_MMARVALID_Msk) {
+        printf("[ERROR] MemManage fault in task %d at 0x%x\n\r", task->tid, SCB->MMFAR);
+    } else {
+        printf("[ERROR] MemManage fault in task %d\n\r", task->tid);
+    }
+    #endif /* DEBUG_0 */
+    SCB->CFSR = MMFSR_Msk;      /* write one to clear */
+
+    if (exc_return != EXC_RETURN_PSP || task->priv == 1 || task->prio == PRIO_NULL) {
+        tsk_stack_overflow(task);
+    }
+    tsk_fault_report(task->tid, "MemManage fault, task exited");
+
+    /* the frame the fault stacked, if any, is discarded with the rest of the stack */
+    *TCB_PSP_LO(task) = STACK_FILL;     /* the canary, so the switch out passes tsk_stack_check */
+    sp = task->psp_hi;
+    *(--sp) = INITIAL_xPSR;
+    *(--sp) = (U32) (uintptr_t) &mpu_fault_exit;
+    for (int i = 0; i < 6; i++) {   /* R0-R3, R12, LR */
+        *(--sp) = 0x0;
+    }
+    __set_PSP((U32) (uintptr_t) sp);
+}
+
+/* pass the EXC_RETURN to c_MemManage_Handler, the exception return then uses the PSP it set */
+__asm void MemManage_Handler(void)
+{
+    PRESERVE8
+    IMPORT c_MemManage_Handler
+    MOV  R0, LR
+    PUSH {R4, LR}
+    BL   c_MemManage_Handler
+    POP  {R4, PC}
+}
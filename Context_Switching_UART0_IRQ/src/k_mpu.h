@@ -0,0 +1,37 @@
+/**
+ * @file:   k_mpu.h
+ * @brief:  MPU stack guard regions for unprivileged tasks
+ */
+
+#ifndef K_MPU_H_
+#define K_MPU_H_
+
+#include "k_rtx.h"
+
+/* ----- Definitions ----- */
+#ifndef MPU_GUARD_SIZE
+#define MPU_GUARD_SIZE 32   /* bytes, a power of two >= 32 (smallest MPU region) */
+#endif /* ! MPU_GUARD_SIZE */
+
+/*
+  alloc_user_stack reserves MPU_STACK_PAD bytes below every user stack. The
+  guard is the MPU_GUARD_SIZE aligned block inside that pad, so it always sits
+  between the allocation header and the stack canary:
+
+         stack_lo-->|---------------------------|
+                    |  0..MPU_GUARD_SIZE slack  |
+                    |---------------------------|
+                    |  guard, no access         |
+   MPU_GUARD_BASE-->|---------------------------|
+                    |  0..MPU_GUARD_SIZE-1 slack|
+            block-->|---------------------------|
+*/
+#define MPU_STACK_PAD (2 * MPU_GUARD_SIZE)
+#define MPU_GUARD_BASE(stack_lo) \
+    (((U32) (uintptr_t) (stack_lo) - MPU_STACK_PAD + MPU_GUARD_SIZE - 1) & ~(U32) (MPU_GUARD_SIZE - 1))
+
+/* ----- Functions ----- */
+void k_mpu_init(void);              /* memory map regions on, guard off */
+void k_mpu_guard_set(TCB *task);    /* guard the stack of the task about to run */
+
+#endif /* ! K_MPU_H_ */
@@ -3,6 +3,12 @@
  * @brief:  kernel message passing routines
  * @author: Yiqing Huang
  * @date:   2020/10/09
+ * NOTE: Each mailbox entry is the message itself (RTX_MSG_HDR.length bytes)
+ *       followed by one byte holding the sender's TID. A receiver that finds
+ *       its mailbox empty parks itself in BLK_MSG through k_tsk_block and the
+ *       next k_send_msg to it wakes it up, so nobody polls.
+ *       Only the owner receives from a mailbox, so there is never more than
+ *       one waiter and the task is parked without a wait queue.
  */
 
 #include "k_msg.h"
@@ -10,29 +16,32 @@
 #include "common.h"
 #include "k_mem.h"
 extern TCB *gp_current_task;
+extern U16 g_max_tasks;
+extern TCB *g_tcbs;
 
 #ifdef DEBUG_0
 #include "printf.h"
 #endif /* ! DEBUG_0 */
 
+#define MSG_TID_SIZE 1  /* sender TID stored after every message */
+
+U32 g_msg_isr_drops = 0;    /* k_send_msg_isr messages not queued, an IRQ has nobody to return RTX_ERR to */
+
 int k_mbx_create(size_t size) {
 #ifdef DEBUG_0
     printf("k_mbx_create: size = %d\r\n", size);
 #endif /* DEBUG_0 */
 
-    if (size<=0||size<MIN_MBX_SIZE){
+    if (size < MIN_MBX_SIZE) {
         return RTX_ERR;
     }
 
-    //Assume it is not the NULL task running
-    if (!gp_current_task->has_mailbox ){ //MailBox already Exists
+    if (gp_current_task->has_mailbox) { //MailBox already Exists
         return RTX_ERR;    
     }
 
-    //Need to check if size is larger than available memory at run time
-    //Maybe this check be put inside circular queue during init?
-    //try to run k_mem_alloc (allocation will run here)
-    void* mailbox_buffer=k_mem_alloc(size);
+    /* one extra byte because the ring never fills its last byte */
+    void *mailbox_buffer = k_mem_alloc(size + 1);
 
     if (!mailbox_buffer){
         #ifdef DEBUG_0
@@ -41,159 +50,177 @@ int k_mbx_create(size_t size) {
         return RTX_ERR;
     }
     
-    //ENSURE THAT MAILBOX IS SET TO NULL DURING TASK CREATE
-    //Can you even set this to null? since it's not a pointer
-    //OTHERWISE THERE MIGHT BE GARBAGE DATA
-
-    //Call circular buffer init and pass in buffer and size
-    circular_buffer_init(gp_current_task->mailbox, mailbox_buffer, size);
+    circular_buffer_init(&gp_current_task->mailbox, mailbox_buffer, size + 1);
+    gp_current_task->has_mailbox = 1;
 
     return RTX_OK;
 }
 
-int k_send_msg(task_t receiver_tid, const void *buf) {
-#ifdef DEBUG_0
-    printf("k_send_msg: receiver_tid = %d, buf=0x%x\r\n", receiver_tid, buf);
-#endif /* DEBUG_0 */
-
-    //Trap kernel
-    //No interrupts
-    __disable_irq()
-
+/**
+ * @brief: queue buf in the mailbox of receiver_tid with sender_tid after it
+ *         and wake the receiver if it waits in BLK_MSG
+ * @return: 1 if the receiver was woken and outranks the running task,
+ *          0 if it was not, RTX_ERR if the message was not queued
+ */
+static int msg_post(task_t receiver_tid, const void *buf, task_t sender_tid) {
     if (!buf){
         #ifdef DEBUG_0
             printf("k_send_msg: buf is NULL\r\n");
         #endif /* DEBUG_0 */
-        __enable_irq();
         return RTX_ERR;
     }
 
-    //Check all tid's in task through g_tcbs, ensure one exists
-    //Recycle code from lab 2 
-    if (!g_tcbs[receiver_tid]){
+    if (receiver_tid >= g_max_tasks) {
         #ifdef DEBUG_0
-            printf("k_send_msg: recieved ID in g_tcb is null\r\n");
+            printf("k_send_msg: receiver_tid out of range\r\n");
         #endif /* DEBUG_0 */
-        __enable_irq();
         return RTX_ERR;
     }
-    
 
-    TCB *task = &g_tcbs[recieved_tid];
+    TCB *task = &g_tcbs[receiver_tid];
 
-    //DOUBLE CHECK WHAT STATE IT SHOULD BE IN (RECIVEING TASK)
-    if(task->state == DORMANT){
-        //Check that the status of the sending task is not dormant
+    if (task->state == DORMANT || !task->has_mailbox) {
         #ifdef DEBUG_0
-            printf("k_send_msg: reciever_tid is not running\r\n");
+            printf("k_send_msg: receiver %d is dormant or has no mailbox\r\n", receiver_tid);
         #endif /* DEBUG_0 */
-        __enable_irq();
-        return RTX_ERR;
-    }
-     
-     //Change to variable
-    if(!task->has_mailbox){
-        //No mailbox for task
-        __enable_irq();
         return RTX_ERR;
     }
 
-    //Can i cast like this lmfao???
-    U32 length = *((U32 *) buf);
-    //Try this U32 length = *((U32 *) msg); struct rtx_msg_hdr *ptr = (void *)buf;
-    //Check example of casting 
+    U32 length = ((RTX_MSG_HDR *) buf)->length;
 
-    if (header->length < MIN_MSG_SIZE){
-        __enable_irq();
+    if (length < sizeof(RTX_MSG_HDR) + MIN_MSG_SIZE) {
         return RTX_ERR;
     }
 
-    if(is_circ_buf_full(task->mailbox,header->length)){
-        __enable_irq();
+    if (is_circ_buf_full(&task->mailbox, length + MSG_TID_SIZE)) {
         return RTX_ERR;
     }
 
-    //check that this doesn't conflict with pre emption
-    if(task->state ==BLK_MSG){
-        task->state== READY;
-        //Add state back to ready_queue
-        push(pop_task_by_id,task->tid);
+    enqueue_msg(&task->mailbox, (void *) buf);
+    circ_buf_put(&task->mailbox, &sender_tid, MSG_TID_SIZE);
+
+    if (task->state != BLK_MSG) {
+        return 0;
     }
+    k_tsk_unblock(task, RTX_OK);
+    return task->prio < gp_current_task->prio;
+}
+
+int k_send_msg(task_t receiver_tid, const void *buf) {
+#ifdef DEBUG_0
+    printf("k_send_msg: receiver_tid = %d, buf=0x%x\r\n", receiver_tid, buf);
+#endif /* DEBUG_0 */
+
+    int ret = msg_post(receiver_tid, buf, gp_current_task->tid);
 
-    if (!enqueue_msg(task->mailbox,buf)){
-        //Does enqueue_msg read the header from the buffer?
-        //Assuming i can just do deep copy and have logic
-        //Inside of enqueue calculate length
-        __enable_irq();
+    if (ret == RTX_ERR) {
         return RTX_ERR;
     }
-
-    //Pass TID onto the lined list of the task
-    push_tid(task->msg_sender_head, gp_current_task->tid);
-    //Turn back on interrupts
-    __enable_irq();
-    //Switch properly at the end (call yeild?)
-    k_tsk_yield();
-  
+    if (ret) {
+        k_tsk_resched();
+    }
     return RTX_OK;
 }
 
+/**
+ * @brief: k_send_msg for IRQ handlers, which cannot trap into the kernel.
+ *         The receiver sees TID_UART_IRQ as the sender. The handler forces
+ *         the switch itself when this returns 1, like k_evt_set_isr.
+ * @return: 1 if the caller should preempt, 0 if not or if the message was
+ *          not queued, which g_msg_isr_drops counts
+ */
+int k_send_msg_isr(task_t receiver_tid, const void *buf) {
+    int ret = msg_post(receiver_tid, buf, TID_UART_IRQ);
+
+    if (ret == RTX_ERR) {
+        g_msg_isr_drops++;
+        return 0;
+    }
+    return ret;
+}
+
 int k_recv_msg(task_t *sender_tid, void *buf, size_t len) {
     #ifdef DEBUG_0
         printf("k_recv_msg: sender_tid  = 0x%x, buf=0x%x, len=%d\r\n", sender_tid, buf, len);
     #endif /* DEBUG_0 */
-    if ( !(len > 0)) {
-        return RTX_ERR;
-    }
 
-    //trap into kernel- atomicity on / disable interrupts
-    __disable_irq();
-    TCB* curr_task = gp_current_task;
+    TCB *curr_task = gp_current_task;
 
-    if (!curr_task->mailbox)
-    {
-        __enable_irq();
+    if (buf == NULL || !curr_task->has_mailbox) {
         return RTX_ERR;
     }
     
-    while(is_empty(curr_task->mailbox))
-    {
-        curr_task->state = BLK_MSG;
-        k_tsk_yield();
+    if (is_circ_buf_empty(&curr_task->mailbox)) {
+        k_tsk_block(NULL, BLK_MSG, WAIT_FOREVER);
     }
 
-    buf = k_mem_alloc(len);
-    void* ptr;
-    //unsure how dequeueing will be implemented for cicurlar queue
-    dequeue_msg(curr_task->mailbox, ptr);
-
-    if (ptr == NULL)
-    {
-        __enable_irq();
-        return RTX_ERR;
-    }
-    //check if len < size of the message - length field should be first 4 bytes of the message (in the header)
-    int actual_len;
-    memcpy(&actual_len, ptr, 4);
-    if (len < actual_len)
-    {
-        __enable_irq();
+    if (!dequeue_msg(&curr_task->mailbox, buf, len)) {
+        /* buf too small, the message is dropped */
+        circ_buf_get(&curr_task->mailbox, NULL, peek_msg_len(&curr_task->mailbox) + MSG_TID_SIZE);
         return RTX_ERR;
     }
 
-    memcpy(buf, ptr, len);
-    //*sender_tid = ; //??
-    //^---SENDER TID NEEDS TO BE SAVED SOMEWHERE IN THE MESSAGE, can't change message header, put it right after header??
-
-    //atomicity off / enable interrupts
-    __enable_irq();
+    task_t tid;
+    circ_buf_get(&curr_task->mailbox, &tid, MSG_TID_SIZE);
+    if (sender_tid != NULL) {
+        *sender_tid = tid;
+    }
 
-    return 0;
+    return RTX_OK;
 }
 
+/**
+ * @brief: list the TIDs of the tasks that own a mailbox
+ * @return: number of TIDs written to buf, RTX_ERR on invalid arguments
+ */
 int k_mbx_ls(task_t *buf, int count) {
 #ifdef DEBUG_0
     printf("k_mbx_ls: buf=0x%x, count=%d\r\n", buf, count);
 #endif /* DEBUG_0 */
-    return 0;
+
+    if (buf == NULL || count <= 0) {
+        return RTX_ERR;
+    }
+
+    int n = 0;
+    for (int i = 0; i < g_max_tasks && n < count; i++) {
+        if (g_tcbs[i].state != DORMANT && g_tcbs[i].has_mailbox) {
+            buf[n++] = g_tcbs[i].tid;
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief: snapshot the occupancy of every mailbox
+ * @return: number of elements filled, RTX_ERR on invalid arguments
+ * NOTE: senders never block, so the only possible waiter is the owner in
+ *       k_recv_msg. The messages are counted by walking the ring, which
+ *       keeps the send/receive path free of bookkeeping.
+ */
+int k_mbx_stats(RTX_MBX_STATS *buf, int count) {
+#ifdef DEBUG_0
+    printf("k_mbx_stats: buf=0x%x, count=%d\r\n", buf, count);
+#endif /* DEBUG_0 */
+
+    if (buf == NULL || count <= 0) {
+        return RTX_ERR;
+    }
+
+    int n = 0;
+    for (int i = 0; i < g_max_tasks && n < count; i++) {
+        TCB *task = &g_tcbs[i];
+
+        if (task->state == DORMANT || !task->has_mailbox) {
+            continue;
+        }
+
+        buf[n].tid = task->tid;
+        buf[n].capacity = circ_buf_capacity(&task->mailbox);
+        buf[n].used = circ_buf_used(&task->mailbox);
+        buf[n].num_msgs = circ_buf_count_msgs(&task->mailbox, MSG_TID_SIZE);
+        buf[n].num_waiters = task->state == BLK_MSG;
+        n++;
+    }
+    return n;
 }
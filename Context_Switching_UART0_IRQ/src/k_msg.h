@@ -12,7 +12,9 @@
 
 int k_mbx_create(size_t size);
 int k_send_msg(task_t receiver_tid, const void *buf);
+int k_send_msg_isr(task_t receiver_tid, const void *buf);   /* from an IRQ handler, 1 if the caller should preempt */
 int k_recv_msg(task_t *sender_tid, void *buf, size_t len);
 int k_mbx_ls(task_t *buf, int count);
+int k_mbx_stats(RTX_MBX_STATS *buf, int count);
 
 #endif /* ! K_MSG_H_ */
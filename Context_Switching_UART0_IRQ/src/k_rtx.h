@@ -8,7 +8,9 @@
 #ifndef K_RTX_H_
 #define K_RTX_H_
 
+#include <stdint.h>      /* uintptr_t */
 #include "common.h"
+#include "common_ext.h"
 #include "circular_buffer.h"
 /*----- Definitations -----*/
 #define NUM_TEST_PROCS 2
@@ -21,6 +23,13 @@
 
 /*----- Types -----*/
 
+/* lowest word of a task's user and kernel stacks, the canary lives there */
+#define TCB_PSP_LO(tcb) ((U32 *) ((char *) (tcb)->psp_hi - (tcb)->psp_size))
+#define TCB_MSP_LO(tcb) ((tcb)->msp_hi - ((tcb)->k_stack_size >> 2))
+
+/* byte offset of a TCB member, for the embedded assembly in HAL.c */
+#define TCB_OFFSET(member) ((U32) &((TCB *) 0)->member)
+
 
 /*
   TCB data structure definition to support two kernel tasks.
@@ -42,6 +51,40 @@ typedef struct tcb
     U8  state;   /* task state */  
     U8  priv;    /* = 0 unprivileged, =1 priviliged */
     U8  has_mailbox; /* 0 = no mailbox. 1 = has mailbox */
+
+    /* run-time statistics, updated in task_switch. Cycles come from DWT->CYCCNT */
+    U64 run_cycles;   /* cycles spent RUNNING */
+    U64 blk_cycles;   /* cycles from blocking in any BLK_ state until running again */
+    U32 last_run;     /* CYCCNT when the task was last switched in */
+    U32 blk_start;    /* CYCCNT when the task blocked, 0 if not blocked */
+    U32 num_switches; /* times the task was switched in */
+    U32 num_vol;      /* switched out by yielding, blocking or exiting */
+    U32 num_invol;    /* switched out by preemption */
+
+    /* blocking, see k_wait.h. next links the task into its wait queue */
+    struct tcb *wait_prev;      /* previous task in the same wait queue FIFO */
+    struct wait_queue *wait_q;  /* queue the task is parked on, NULL if none */
+    struct tcb *timer_next;     /* next task in the timeout list */
+    U32 wait_until;   /* tick at which the wait times out */
+    U32 wait_arg;     /* request the task is waiting for, meaning depends on the queue */
+    S32 wait_ret;     /* what k_tsk_block returns to the task when it runs again */
+    U8  wait_timed;   /* 1 while on the timeout list */
+
+    /* priority inheritance, see k_sync.c. prio is the priority the task runs at */
+    U8  base_prio;              /* priority set by tsk_create / tsk_set_prio */
+    struct mutex *mtx_held;     /* mutexes the task holds, linked by next_held */
+
+    /* event flags, see k_evt.c */
+    U32 evt_flags;
+    U8  evt_opt;      /* EVT_ options of the pending evt_wait */
+
+    U16 k_stack_size; /* kernel stack size in bytes, the stack is a TID_KERNEL heap block.
+                         Unprivileged tasks take IRQs on it, SVCs on their user stack */
+    U8  static_def;   /* 1 if the stacks are in the image (k_task_def.h) and never freed */
+
+    /* task-local storage. The slots live in g_tls while the task runs,
+       task_switch copies them here and back */
+    U32 tls[TLS_SLOTS];
 } TCB;
 
 #endif // ! K_RTX_H_
@@ -13,16 +13,31 @@
 
 int k_rtx_init(size_t blk_size, int algo, RTX_TASK_INFO *task_info, int num_tasks)
 {
+    RTX_CONFIG cfg;
+
+    cfg.blk_size = blk_size;
+    cfg.algo = algo;
+    cfg.max_tasks = MAX_TASKS;
+
+    return k_rtx_init_cfg(&cfg, task_info, num_tasks);
+}
+
+int k_rtx_init_cfg(const RTX_CONFIG *cfg, RTX_TASK_INFO *task_info, int num_tasks)
+{
+    if ( cfg == NULL ) {
+        return RTX_ERR;
+    }
+
     /* interrupts are already disabled when we enter here */
     if ( uart_irq_init(0) != RTX_OK ) {
         return RTX_ERR;
     }
     
-    if ( k_mem_init(blk_size, algo) != RTX_OK) {
+    if ( k_mem_init(cfg->blk_size, cfg->algo) != RTX_OK) {
         return RTX_ERR;
     }
 
-    if ( k_tsk_init(task_info, num_tasks) != RTX_OK ) {
+    if ( k_tsk_init(task_info, num_tasks, cfg->max_tasks) != RTX_OK ) {
         return RTX_ERR;
     }
     
@@ -13,4 +13,5 @@
 /* Functions */
 
 int k_rtx_init(size_t blk_size, int alog, RTX_TASK_INFO *task_info, int num_tasks);
+int k_rtx_init_cfg(const RTX_CONFIG *cfg, RTX_TASK_INFO *task_info, int num_tasks);
 #endif /* ! K_RTX_INIT_H_ */
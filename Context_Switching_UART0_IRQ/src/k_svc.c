@@ -0,0 +1,213 @@
+/**
+ * @file:   k_svc.c
+ * @brief:  SVC dispatch table and argument checks for the user API
+ * NOTE: SVC_Handler in HAL.c indexes g_svc_table with the SVC immediate and
+ *       calls the entry with R0-R3 of the caller's exception stack frame.
+ *       Calls that take a pointer go through a svc_ wrapper which checks that
+ *       an unprivileged caller only hands in memory of its own (svc_ptr_ok).
+ *       Calls without pointers are dispatched to the kernel function directly.
+ */
+
+#include "k_svc.h"
+#include "k_mem.h"
+#include "k_task.h"
+#include "k_msg.h"
+#include "k_rtx_init.h"
+#include "k_sync.h"
+#include "k_evt.h"
+
+#ifdef DEBUG_0
+#include "printf.h"
+#endif /* DEBUG_0 */
+
+#define AHB_SRAM_BASE 0x2007C000
+#define AHB_SRAM_END  0x20084000
+#define IRAM1_BASE    0x10000000
+
+extern TCB *gp_current_task;
+
+extern unsigned int Image$$RW_IRAM1$$ZI$$Limit;
+
+/* the RTX_USER_DATA globals, weak so an image without any still links */
+extern __weak unsigned int rtx_udata$$Base;
+extern __weak unsigned int rtx_udata$$Limit;
+
+/**
+ * @brief: check a user supplied buffer before the kernel reads or writes
+ *         through it
+ * @return: 1 if the caller is privileged or [ptr, ptr + len) lies in the
+ *          caller's own user stack, in a heap block the caller allocated,
+ *          in the rtx_udata section or in AHB SRAM; 0 otherwise
+ * NOTE: The image's RAM (0x10000000 up to Image$$RW_IRAM1$$ZI$$Limit) holds
+ *       the kernel's own data, the scheduler, the TID map and the pools, so
+ *       it is refused as a whole except for the RTX_USER_DATA globals,
+ *       which every unprivileged task shares like AHB SRAM. The rest of IRAM1
+ *       is the heap, where only the caller's blocks are accepted: the TCBs,
+ *       kernel stacks, other tasks' stacks and mailboxes are blocks of
+ *       TID_KERNEL or of other tasks, and headers lie outside every block.
+ */
+int svc_ptr_ok(const void *ptr, U32 len) {
+    TCB *task = gp_current_task;
+    U32 lo = (U32) ptr;
+    U32 hi = lo + len;
+
+    if (task == NULL || task->priv == 1) {
+        return 1;
+    }
+
+    if (ptr == NULL || hi < lo) {
+        return 0;
+    }
+
+    /* the user stack, a heap block of TID_KERNEL or part of the image for static tasks */
+    if (lo >= (U32) TCB_PSP_LO(task) && hi <= (U32) task->psp_hi) {
+        return 1;
+    }
+
+    if (lo >= AHB_SRAM_BASE && hi <= AHB_SRAM_END) {
+        return 1;
+    }
+
+    if (lo >= (U32) &rtx_udata$$Base && hi <= (U32) &rtx_udata$$Limit) {
+        return 1;
+    }
+
+    if (lo < (U32) &Image$$RW_IRAM1$$ZI$$Limit && hi > IRAM1_BASE) {
+        #ifdef DEBUG_0
+        printf("[ERROR] svc_ptr_ok: task %d passed kernel data address 0x%x\n\r", task->tid, lo);
+        #endif /* DEBUG_0 */
+        return 0;
+    }
+
+    if (k_mem_owned(ptr, len, task->tid)) {
+        return 1;
+    }
+
+    #ifdef DEBUG_0
+    printf("[ERROR] svc_ptr_ok: task %d passed address 0x%x it does not own\n\r", task->tid, lo);
+    #endif /* DEBUG_0 */
+    return 0;
+}
+
+static int svc_tsk_create(task_t *task, void (*task_entry)(void), U8 prio, U16 stack_size) {
+    if (!svc_ptr_ok(task, sizeof(task_t))) {
+        return RTX_ERR;
+    }
+    return k_tsk_create(task, task_entry, prio, stack_size);
+}
+
+static int svc_tsk_create_ex(task_t *task, const RTX_TASK_INFO *info) {
+    if (!svc_ptr_ok(task, sizeof(task_t)) || !svc_ptr_ok(info, sizeof(RTX_TASK_INFO))) {
+        return RTX_ERR;
+    }
+    return k_tsk_create_ex(task, info);
+}
+
+static int svc_tsk_get(task_t task_id, RTX_TASK_INFO *buffer) {
+    if (!svc_ptr_ok(buffer, sizeof(RTX_TASK_INFO))) {
+        return RTX_ERR;
+    }
+    return k_tsk_get(task_id, buffer);
+}
+
+static int svc_tsk_ls(task_t *buf, int count) {
+    if (count < 0 || !svc_ptr_ok(buf, count * sizeof(task_t))) {
+        return RTX_ERR;
+    }
+    return k_tsk_ls(buf, count);
+}
+
+static int svc_tsk_stats(RTX_TASK_STATS *buf, int count) {
+    if (count < 0 || !svc_ptr_ok(buf, count * sizeof(RTX_TASK_STATS))) {
+        return RTX_ERR;
+    }
+    return k_tsk_stats(buf, count);
+}
+
+static int svc_send_msg(task_t tid, const void *buf) {
+    if (!svc_ptr_ok(buf, sizeof(RTX_MSG_HDR)) || !svc_ptr_ok(buf, ((RTX_MSG_HDR *) buf)->length)) {
+        return RTX_ERR;
+    }
+    return k_send_msg(tid, buf);
+}
+
+static int svc_recv_msg(task_t *tid, void *buf, size_t len) {
+    if ((tid != NULL && !svc_ptr_ok(tid, sizeof(task_t))) || !svc_ptr_ok(buf, len)) {
+        return RTX_ERR;
+    }
+    return k_recv_msg(tid, buf, len);
+}
+
+static int svc_mbx_ls(task_t *buf, int count) {
+    if (count < 0 || !svc_ptr_ok(buf, count * sizeof(task_t))) {
+        return RTX_ERR;
+    }
+    return k_mbx_ls(buf, count);
+}
+
+static int svc_mbx_stats(RTX_MBX_STATS *buf, int count) {
+    if (count < 0 || !svc_ptr_ok(buf, count * sizeof(RTX_MBX_STATS))) {
+        return RTX_ERR;
+    }
+    return k_mbx_stats(buf, count);
+}
+
+static int svc_sem_create(sem_t *sem, U32 count) {
+    if (!svc_ptr_ok(sem, sizeof(sem_t))) {
+        return RTX_ERR;
+    }
+    return k_sem_create(sem, count);
+}
+
+static int svc_mtx_create(mtx_t *mtx) {
+    if (!svc_ptr_ok(mtx, sizeof(mtx_t))) {
+        return RTX_ERR;
+    }
+    return k_mtx_create(mtx);
+}
+
+static int svc_evt_wait(U32 flags, U8 opt, U32 timeout, U32 *got) {
+    if (got != NULL && !svc_ptr_ok(got, sizeof(U32))) {
+        return RTX_ERR;
+    }
+    return k_evt_wait(flags, opt, timeout, got);
+}
+
+/* unused numbers stay NULL, SVC_Handler returns RTX_ERR for them */
+const SVC_FUNC_T g_svc_table[SVC_NUM_CALLS] = {
+    [SVC_MEM_INIT]          = (SVC_FUNC_T) k_mem_init,
+    [SVC_MEM_ALLOC]         = (SVC_FUNC_T) k_mem_alloc_fair,
+    [SVC_MEM_DEALLOC]       = (SVC_FUNC_T) k_mem_dealloc_wake,
+    [SVC_MEM_COUNT_EXTFRAG] = (SVC_FUNC_T) k_mem_count_extfrag,
+    [SVC_RTX_INIT]          = (SVC_FUNC_T) k_rtx_init,
+    [SVC_TSK_YIELD]         = (SVC_FUNC_T) k_tsk_yield,
+    [SVC_TSK_CREATE]        = (SVC_FUNC_T) svc_tsk_create,
+    [SVC_TSK_EXIT]          = (SVC_FUNC_T) k_tsk_exit,
+    [SVC_TSK_SET_PRIO]      = (SVC_FUNC_T) k_tsk_set_prio,
+    [SVC_TSK_GET]           = (SVC_FUNC_T) svc_tsk_get,
+    [SVC_TSK_LS]            = (SVC_FUNC_T) svc_tsk_ls,
+    [SVC_TSK_STATS]         = (SVC_FUNC_T) svc_tsk_stats,
+    [SVC_MBX_CREATE]        = (SVC_FUNC_T) k_mbx_create,
+    [SVC_SEND_MSG]          = (SVC_FUNC_T) svc_send_msg,
+    [SVC_RECV_MSG]          = (SVC_FUNC_T) svc_recv_msg,
+    [SVC_MBX_LS]            = (SVC_FUNC_T) svc_mbx_ls,
+    [SVC_TSK_DELAY]         = (SVC_FUNC_T) k_tsk_delay,
+    [SVC_MEM_ALLOC_WAIT]    = (SVC_FUNC_T) k_mem_alloc_wait,
+    [SVC_SEM_CREATE]        = (SVC_FUNC_T) svc_sem_create,
+    [SVC_SEM_WAIT]          = (SVC_FUNC_T) k_sem_wait,
+    [SVC_SEM_POST]          = (SVC_FUNC_T) k_sem_post,
+    [SVC_SEM_DELETE]        = (SVC_FUNC_T) k_sem_delete,
+    [SVC_MTX_CREATE]        = (SVC_FUNC_T) svc_mtx_create,
+    [SVC_MTX_LOCK]          = (SVC_FUNC_T) k_mtx_lock,
+    [SVC_MTX_UNLOCK]        = (SVC_FUNC_T) k_mtx_unlock,
+    [SVC_MTX_DELETE]        = (SVC_FUNC_T) k_mtx_delete,
+    [SVC_EVT_SET]           = (SVC_FUNC_T) k_evt_set,
+    [SVC_EVT_CLEAR]         = (SVC_FUNC_T) k_evt_clear,
+    [SVC_EVT_WAIT]          = (SVC_FUNC_T) svc_evt_wait,
+    [SVC_RTX_INIT_CFG]      = (SVC_FUNC_T) k_rtx_init_cfg,
+    [SVC_TSK_CREATE_EX]     = (SVC_FUNC_T) svc_tsk_create_ex,
+    [SVC_MBX_STATS]         = (SVC_FUNC_T) svc_mbx_stats,
+#ifdef MEM_TRACE
+    [SVC_MEM_TRACE_DUMP]    = (SVC_FUNC_T) k_mem_trace_dump,
+#endif /* MEM_TRACE */
+};
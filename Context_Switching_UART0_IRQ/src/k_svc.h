@@ -0,0 +1,21 @@
+/**
+ * @file:   k_svc.h
+ * @brief:  SVC dispatch table header file
+ */
+
+#ifndef K_SVC_H_
+#define K_SVC_H_
+
+#include "k_rtx.h"
+
+/* ----- Types ----- */
+/* every entry is called with R0-R3 of the caller's exception stack frame */
+typedef void (*SVC_FUNC_T)(void);
+
+/* ----- Variables ----- */
+extern const SVC_FUNC_T g_svc_table[SVC_NUM_CALLS];    /* indexed by the SVC immediate */
+
+/* ----- Functions ----- */
+int svc_ptr_ok(const void *ptr, U32 len);
+
+#endif /* ! K_SVC_H_ */
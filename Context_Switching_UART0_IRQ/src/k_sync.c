@@ -0,0 +1,336 @@
+/**
+ * @file:   k_sync.c
+ * @brief:  counting semaphores and priority inheritance mutexes
+ * NOTE: Both objects live in static pools and user code refers to them by
+ *       index. Waiting goes through k_tsk_block on the object's wait queue.
+ *
+ *       Priority inheritance: a task's prio is the better of its base_prio
+ *       and the priority of the best waiter on any mutex it holds. When a
+ *       task blocks on a mutex, the owner is boosted; if that owner is itself
+ *       blocked on a mutex the boost is passed on along the chain. Unlocking
+ *       hands the mutex to the best waiter and recomputes both priorities.
+ */
+
+#include "k_sync.h"
+#include "k_task.h"
+#include "linked_list.h"
+
+#ifdef DEBUG_0
+#include "printf.h"
+#endif /* DEBUG_0 */
+
+extern TCB *gp_current_task;
+extern TCB *ready_queue_head;
+
+SEM_T g_sems[MAX_SEMS];
+MUTEX_T g_mutexes[MAX_MUTEXES];
+
+static SEM_T *sem_get(sem_t sem) {
+    if (sem >= MAX_SEMS || !g_sems[sem].in_use) {
+        #ifdef DEBUG_0
+        printf("[ERROR] invalid semaphore %d\n\r", sem);
+        #endif /* DEBUG_0 */
+        return NULL;
+    }
+    return &g_sems[sem];
+}
+
+static MUTEX_T *mtx_get(mtx_t mtx) {
+    if (mtx >= MAX_MUTEXES || !g_mutexes[mtx].in_use) {
+        #ifdef DEBUG_0
+        printf("[ERROR] invalid mutex %d\n\r", mtx);
+        #endif /* DEBUG_0 */
+        return NULL;
+    }
+    return &g_mutexes[mtx];
+}
+
+/* the mutex a BLK_MUT task waits on, its wait queue is the first member */
+static MUTEX_T *mtx_waiting_on(TCB *task) {
+    return task->state == BLK_MUT ? (MUTEX_T *) task->wait_q : NULL;
+}
+
+/*
+ *  Semaphores
+ */
+
+int k_sem_create(sem_t *sem, U32 count) {
+    int i;
+
+    if (count > SEM_MAX_COUNT) {
+        return RTX_ERR;
+    }
+
+    for (i = 0; i < MAX_SEMS; i++) {
+        if (!g_sems[i].in_use) {
+            k_wait_init(&g_sems[i].wait);
+            g_sems[i].count = count;
+            g_sems[i].in_use = 1;
+            *sem = i;
+            return RTX_OK;
+        }
+    }
+
+    #ifdef DEBUG_0
+    printf("[ERROR] k_sem_create: no free semaphore\n\r");
+    #endif /* DEBUG_0 */
+    return RTX_ERR;
+}
+
+/**
+ * @param: timeout, ticks to wait, 0 to only try, WAIT_FOREVER
+ * @return: RTX_OK once the semaphore is taken, RTX_ERR on timeout or deletion
+ */
+int k_sem_wait(sem_t sem, U32 timeout) {
+    SEM_T *s = sem_get(sem);
+
+    if (s == NULL) {
+        return RTX_ERR;
+    }
+
+    if (s->count > 0) {
+        s->count--;
+        return RTX_OK;
+    }
+
+    if (timeout == 0) {
+        return RTX_ERR;
+    }
+
+    /* k_sem_post passes the count straight to the woken task */
+    return k_tsk_block(&s->wait, BLK_SEM, timeout);
+}
+
+int k_sem_post(sem_t sem) {
+    SEM_T *s = sem_get(sem);
+
+    if (s == NULL) {
+        return RTX_ERR;
+    }
+
+    if (k_wait_wake_one(&s->wait, RTX_OK) != NULL) {
+        return k_tsk_resched();
+    }
+
+    if (s->count >= SEM_MAX_COUNT) {
+        return RTX_ERR;
+    }
+    s->count++;
+    return RTX_OK;
+}
+
+/**
+ * @brief: free the semaphore, waiting tasks return RTX_ERR from sem_wait
+ */
+int k_sem_delete(sem_t sem) {
+    SEM_T *s = sem_get(sem);
+
+    if (s == NULL) {
+        return RTX_ERR;
+    }
+
+    s->in_use = 0;
+    if (k_wait_wake_all(&s->wait, RTX_ERR) > 0) {
+        k_tsk_resched();
+    }
+    return RTX_OK;
+}
+
+/*
+ *  Mutexes
+ */
+
+/**
+ * @brief: change the priority a task runs at, keeping every queue it is on sorted
+ */
+static void tsk_set_effective(TCB *task, U8 prio) {
+    if (task->prio == prio) {
+        return;
+    }
+
+    if (TSK_BLOCKED(task->state)) {
+        k_wait_reprio(task, prio);
+    } else if (task != gp_current_task && (task->state == READY || task->state == NEW)) {
+        pop_task_by_id(&ready_queue_head, task->tid);
+        task->prio = prio;
+        push(&ready_queue_head, task);
+    } else {
+        task->prio = prio;
+    }
+}
+
+U8 k_mtx_effective_prio(TCB *task) {
+    U8 prio = task->base_prio;
+    MUTEX_T *m;
+
+    for (m = task->mtx_held; m != NULL; m = m->next_held) {
+        TCB *waiter = k_wait_peek(&m->wait);
+        if (waiter != NULL && waiter->prio < prio) {
+            prio = waiter->prio;
+        }
+    }
+
+    return prio;
+}
+
+/**
+ * @brief: task's priority changed while it waits on a mutex, recompute the
+ *         owner, and the owner's owner if that one waits on a mutex too
+ */
+void k_mtx_prio_changed(TCB *task) {
+    MUTEX_T *m;
+
+    while ((m = mtx_waiting_on(task)) != NULL && m->owner != NULL) {
+        U8 prio = k_mtx_effective_prio(m->owner);
+
+        if (prio == m->owner->prio) {
+            break;
+        }
+        tsk_set_effective(m->owner, prio);
+        task = m->owner;
+    }
+}
+
+static void mtx_take(MUTEX_T *m, TCB *task) {
+    m->owner = task;
+    m->next_held = task->mtx_held;
+    task->mtx_held = m;
+}
+
+/**
+ * @brief: give m to its best waiter, or unlock it, and drop the old owner's
+ *         inherited priority. Does not preempt.
+ */
+static void mtx_release(MUTEX_T *m) {
+    TCB *owner = m->owner;
+    MUTEX_T **pp = &owner->mtx_held;
+    TCB *next;
+
+    while (*pp != m) {
+        pp = &(*pp)->next_held;
+    }
+    *pp = m->next_held;
+    m->next_held = NULL;
+
+    next = k_wait_wake_one(&m->wait, RTX_OK);
+    m->owner = NULL;
+    if (next != NULL) {
+        mtx_take(m, next);
+        tsk_set_effective(next, k_mtx_effective_prio(next));
+    }
+
+    tsk_set_effective(owner, k_mtx_effective_prio(owner));
+}
+
+int k_mtx_create(mtx_t *mtx) {
+    int i;
+
+    for (i = 0; i < MAX_MUTEXES; i++) {
+        if (!g_mutexes[i].in_use) {
+            k_wait_init(&g_mutexes[i].wait);
+            g_mutexes[i].owner = NULL;
+            g_mutexes[i].next_held = NULL;
+            g_mutexes[i].in_use = 1;
+            *mtx = i;
+            return RTX_OK;
+        }
+    }
+
+    #ifdef DEBUG_0
+    printf("[ERROR] k_mtx_create: no free mutex\n\r");
+    #endif /* DEBUG_0 */
+    return RTX_ERR;
+}
+
+/**
+ * @param: timeout, ticks to wait, 0 to only try, WAIT_FOREVER
+ * @return: RTX_OK once the mutex is held, RTX_ERR on timeout, deletion or
+ *          when the caller already holds it
+ */
+int k_mtx_lock(mtx_t mtx, U32 timeout) {
+    MUTEX_T *m = mtx_get(mtx);
+    TCB *owner;
+    U8 prio = gp_current_task->prio;
+
+    if (m == NULL || m->owner == gp_current_task) {
+        return RTX_ERR;
+    }
+
+    if (m->owner == NULL) {
+        mtx_take(m, gp_current_task);
+        return RTX_OK;
+    }
+
+    if (timeout == 0 || prio == PRIO_NULL) {
+        return RTX_ERR;
+    }
+
+    /* boost the owner, and transitively whoever it is waiting for */
+    for (owner = m->owner; owner != NULL && prio < owner->prio; ) {
+        MUTEX_T *next = mtx_waiting_on(owner);
+
+        tsk_set_effective(owner, prio);
+        owner = next != NULL ? next->owner : NULL;
+    }
+
+    if (k_tsk_block(&m->wait, BLK_MUT, timeout) == RTX_OK) {
+        return RTX_OK;      /* mtx_release made us the owner */
+    }
+
+    /* timed out or deleted, take back the boost we gave */
+    if (m->in_use && m->owner != NULL) {
+        tsk_set_effective(m->owner, k_mtx_effective_prio(m->owner));
+        k_mtx_prio_changed(m->owner);
+    }
+    return RTX_ERR;
+}
+
+int k_mtx_unlock(mtx_t mtx) {
+    MUTEX_T *m = mtx_get(mtx);
+
+    if (m == NULL || m->owner != gp_current_task) {
+        return RTX_ERR;
+    }
+
+    mtx_release(m);
+    return k_tsk_resched();
+}
+
+/**
+ * @brief: free an unlocked mutex, or one the caller holds. Waiting tasks
+ *         return RTX_ERR from mtx_lock.
+ */
+int k_mtx_delete(mtx_t mtx) {
+    MUTEX_T *m = mtx_get(mtx);
+    TCB *owner;
+
+    if (m == NULL || (m->owner != NULL && m->owner != gp_current_task)) {
+        return RTX_ERR;
+    }
+
+    owner = m->owner;
+    if (owner != NULL) {
+        MUTEX_T **pp = &owner->mtx_held;
+        while (*pp != m) {
+            pp = &(*pp)->next_held;
+        }
+        *pp = m->next_held;
+        m->owner = NULL;
+    }
+
+    m->in_use = 0;
+    k_wait_wake_all(&m->wait, RTX_ERR);
+    if (owner != NULL) {
+        tsk_set_effective(owner, k_mtx_effective_prio(owner));
+    }
+    return k_tsk_resched();
+}
+
+/**
+ * @brief: an exiting task must not leave its waiters blocked forever
+ */
+void k_mtx_release_all(TCB *task) {
+    while (task->mtx_held != NULL) {
+        mtx_release(task->mtx_held);
+    }
+}
@@ -0,0 +1,47 @@
+/**
+ * @file:   k_sync.h
+ * @brief:  counting semaphores and priority inheritance mutexes
+ */
+
+#ifndef K_SYNC_H_
+#define K_SYNC_H_
+
+#include "k_rtx.h"
+#include "k_wait.h"
+
+/* ----- Definitions ----- */
+#define MAX_SEMS      16
+#define MAX_MUTEXES   16
+#define SEM_MAX_COUNT 0xFFFF
+
+/* ----- Types ----- */
+typedef struct semaphore {
+    WAIT_QUEUE_T wait;      /* tasks in BLK_SEM */
+    U32 count;
+    U8  in_use;
+} SEM_T;
+
+typedef struct mutex {
+    WAIT_QUEUE_T wait;      /* tasks in BLK_MUT, must stay first, see mtx_waiting_on */
+    TCB *owner;             /* NULL while unlocked */
+    struct mutex *next_held;    /* next mutex held by the same owner */
+    U8  in_use;
+} MUTEX_T;
+
+/* ----- Functions ----- */
+int k_sem_create(sem_t *sem, U32 count);
+int k_sem_wait(sem_t sem, U32 timeout);
+int k_sem_post(sem_t sem);
+int k_sem_delete(sem_t sem);
+
+int k_mtx_create(mtx_t *mtx);
+int k_mtx_lock(mtx_t mtx, U32 timeout);
+int k_mtx_unlock(mtx_t mtx);
+int k_mtx_delete(mtx_t mtx);
+
+/* hooks for k_task.c */
+U8 k_mtx_effective_prio(TCB *task);     /* base_prio or the best inherited priority */
+void k_mtx_prio_changed(TCB *task);     /* pass a priority change down the chain of owners */
+void k_mtx_release_all(TCB *task);      /* unlock everything an exiting task holds */
+
+#endif /* ! K_SYNC_H_ */
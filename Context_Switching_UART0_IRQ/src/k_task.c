@@ -16,6 +16,9 @@
 #include "k_task.h"
 #include "linked_list.h"
 #include "k_mem.h"
+#include "k_mpu.h"
+#include "k_wait.h"
+#include "k_sync.h"
 
 #ifdef DEBUG_0
 #include "printf.h"
@@ -24,102 +27,408 @@
 /* ----- Global Variables ----- */
 TCB *gp_current_task = NULL;    /* always point to the current RUN process */
 
-/* TCBs and Kernel stacks are statically allocated and is inside the OS image */
-TCB g_tcbs[MAX_TASKS];
-U32 g_k_stacks[MAX_TASKS][KERN_STACK_SIZE >> 2];
+/* link-time tasks, see k_task_def.h. Weak, the section is absent without them */
+extern __weak const RTX_TASK_DEF rtx_tasks$$Base;
+extern __weak const RTX_TASK_DEF rtx_tasks$$Limit;
+
+/* built-in tasks with a fixed TID, weak so a kernel without them still links */
+extern __weak void kcd_task(void);
+extern __weak void lcd_task(void);
+
+/* the TCB table is allocated from the heap by k_tsk_init, kernel stacks per task */
+U16 g_max_tasks = 0;
+TCB *g_tcbs = NULL;
+
+/* free TIDs, bit (tid & 31) of word (tid >> 5) is set while tid is free */
+U32 g_tid_map[TID_MAP_WORDS];
 
 // Kernal Fake Task used for mem alloc of kernel necessary data
 TCB kernal_task;
 TCB *null_task = NULL;
 
 TCB *ready_queue_head = NULL;
-INT_LL_NODE_T *free_tid_head = NULL;
+
+/* exited tasks whose stacks and TID are not freed yet, linked through next.
+   See k_tsk_exit and tsk_reap */
+TCB *g_tsk_zombies = NULL;
+
+U32 g_tls[TLS_SLOTS];          /* TLS slots of the running task, see tls_get in rtx.h */
+
+U8 g_tsk_preempt = 0;           /* set while a switch is forced on the running task */
+
+/* free running cycle counter, wraps every ~43s at 100MHz so only deltas are used */
+#define CYCLES_NOW() (DWT->CYCCNT)
 
 void *alloc_user_stack(size_t size);
 int dealloc_user_stack(U32 *ptr, size_t size);
+int alloc_kern_stack(TCB *task, U16 size);
 
 /*---------------------------------------------------------------------------
 The memory map of the OS image may look like the following:
 
                     0x10008000+---------------------------+ High Address
-                              |                           |
                               |                           |
                               |    Free memory space      |
-                              | (Alloc user stacks here)  |
-                              |                           |
+                              |  user and kernel stacks,  |
+                              |  mailboxes, other blocks  |
                               |                           |
+                              |---------------------------|
+                              | TCBs, g_max_tasks of them |
+                      g_tcbs->|---------------------------|
                               |                           |
 &Image$$RW_IRAM1$$ZI$$Limit-->|---------------------------|-----+-----
                               |         ......            |     ^
                               |---------------------------|     |
-                              |                           |     | 
-                              |---------------------------|     |
-                              |      KERN_STACK_SIZE      |     |                
-             g_k_stacks[15]-->|---------------------------|     |
-                              |                           |     |
-                              |     other kernel stacks   |     |                              
+                              |  g_tid_map, other globals |  OS Image
                               |---------------------------|     |
-                              |      KERN_STACK_SIZE      |  OS Image
-              g_k_stacks[2]-->|---------------------------|     |
-                              |      KERN_STACK_SIZE      |     |                      
-              g_k_stacks[1]-->|---------------------------|     |
-                              |      KERN_STACK_SIZE      |     |
-              g_k_stacks[0]-->|---------------------------|     |
-                              |   other  global vars      |     |
-                              |---------------------------|     |
-                              |        TCBs               |     |
-                      g_tcbs->|---------------------------|     |
-                              |        global vars        |     |
-                              |---------------------------|     |
-                              |                           |     |          
-                              |                           |     |
-                              |                           |     |
                               |                           |     V
                     0x10000000+---------------------------+ Low Address
-    
+
+The TCB table is the first heap block k_tsk_init allocates. Each task's
+kernel stack is a heap block of its own k_stack_size, owned by TID_KERNEL
+and freed once the task has exited and another task runs, see tsk_reap.
+An unprivileged task runs its SVCs on its user stack, its kernel stack takes
+the IRQs that interrupt it (SVC_EXIT points MSP at its top). A privileged task
+runs on its kernel stack alone.
 ---------------------------------------------------------------------------*/
 
+/**
+ * @brief: fill [stack_lo, stack_hi) with STACK_FILL so the high-water mark
+ *         and the canary at stack_lo can be checked later
+ */
+void tsk_stack_fill(U32 *stack_lo, U32 *stack_hi) {
+    while (stack_lo < stack_hi) {
+        *stack_lo++ = STACK_FILL;
+    }
+}
+
+/**
+ * @brief: deepest use of a filled stack, scanning up from the low end
+ * @return: bytes between the deepest overwritten word and stack_hi
+ */
+U32 tsk_stack_used(U32 *stack_lo, U32 *stack_hi) {
+    U32 *sp = stack_lo;
+
+    while (sp < stack_hi && *sp == STACK_FILL) {
+        sp++;
+    }
+
+    return (U32) ((char *) stack_hi - (char *) sp);
+}
+
+/**
+ * @brief: one polled UART1 line naming the faulting task, in every build
+ * NOTE: printf is only initialized under DEBUG_0, so the TID is formatted here
+ */
+void tsk_fault_report(task_t tid, char *what) {
+    char num[4];
+
+    num[0] = '0' + tid / 100;
+    num[1] = '0' + tid / 10 % 10;
+    num[2] = '0' + tid % 10;
+    num[3] = '\0';
+    uart1_put_string("[FAULT] task ");
+    uart1_put_string(num);
+    uart1_put_string(": ");
+    uart1_put_string(what);
+    uart1_put_string("\r\n");
+}
+
+/**
+ * @brief: a stack pointer left its stack or the canary was overwritten.
+ *         Memory next to the stack is corrupt, so fail-stop rather than run on it.
+ */
+void tsk_stack_overflow(TCB *task) {
+    __disable_irq();
+    tsk_fault_report(task->tid, "stack overflow, halted");
+    #ifdef DEBUG_0
+    printf("[ERROR] stack overflow in task %d: msp = 0x%x, psp = 0x%x\n\r", task->tid, task->msp, task->psp);
+    #endif /* DEBUG_0 */
+    while (1) {}
+}
+
+/**
+ * @brief: cheap check done on every switch out: the saved stack pointers lie
+ *         inside the task's stacks and the canaries below them are intact.
+ * NOTE: SVC_Handler runs kernel code on the user stack (MSP = PSP), so the saved
+ *       msp of an unprivileged task may lie in either of its stacks.
+ *       A task switched out by k_tsk_exit is checked too, its stacks are only
+ *       freed after the switch.
+ */
+void tsk_stack_check(TCB *task) {
+    U32 *k_lo = TCB_MSP_LO(task);
+    BOOL msp_ok = task->msp >= k_lo && task->msp <= task->msp_hi;
+
+    if (*k_lo != STACK_FILL) {
+        tsk_stack_overflow(task);
+    }
+
+    if (task->priv == 0) {
+        U32 *u_lo = TCB_PSP_LO(task);
+
+        if (*u_lo != STACK_FILL || task->psp < u_lo || task->psp > task->psp_hi) {
+            tsk_stack_overflow(task);
+        }
+        msp_ok = msp_ok || (task->msp >= u_lo && task->msp <= task->psp_hi);
+    }
+
+    if (!msp_ok) {
+        tsk_stack_overflow(task);
+    }
+}
+
+/* user stacks carry MPU_STACK_PAD bytes below them for the MPU guard, see k_mpu.h */
 void *alloc_user_stack(size_t size) {
-    U32 *stack_low = k_mem_alloc(size);
-    if (stack_low == NULL) {
+    char *block = k_mem_alloc(size + MPU_STACK_PAD);
+    if (block == NULL) {
         return NULL;
     }
 
+    U32 *stack_low = (U32 *) (block + MPU_STACK_PAD);
+    tsk_stack_fill(stack_low, (U32 *) ((char *) stack_low + size));
     return (char *) stack_low + size;
 }
 
+/**
+ * @brief: allocate and fill the kernel stack of task, msp starts at the top
+ * @param: size, bytes; 0 picks KERN_STACK_SIZE, rounded up to 8 for AAPCS
+ * PRE: gp_current_task is kernal_task, the block is owned by TID_KERNEL
+ */
+int alloc_kern_stack(TCB *task, U16 size) {
+    U32 *lo;
+
+    if (size == 0) {
+        size = KERN_STACK_SIZE;
+    }
+    size = (size + 7) & ~7;
+    if (size < KERN_STACK_MIN) {
+        return RTX_ERR;
+    }
+
+    lo = k_mem_alloc(size);
+    if (lo == NULL) {
+        return RTX_ERR;
+    }
+
+    task->k_stack_size = size;
+    task->msp_hi = lo + (size >> 2);
+    task->msp = task->msp_hi;
+    tsk_stack_fill(lo, task->msp_hi);
+    return RTX_OK;
+}
+
 int dealloc_user_stack(U32 *ptr, size_t size) {
     if (ptr == NULL) {
         return RTX_ERR;
     }
 
-    return k_mem_dealloc((char *) ptr - size);
+    return k_mem_dealloc((char *) ptr - size - MPU_STACK_PAD);
+}
+
+/**
+ * @brief: find-first-set over g_tid_map, lowest free TID first
+ * @return: the TID now marked in use, -1 if all g_max_tasks are taken
+ */
+static int tid_alloc(void) {
+    for (int w = 0; w < TID_MAP_WORDS; w++) {
+        U32 bits = g_tid_map[w];
+        if (bits != 0) {
+            int bit = __CLZ(__RBIT(bits));
+            g_tid_map[w] = bits & ~(1U << bit);
+            return (w << 5) + bit;
+        }
+    }
+    return -1;
+}
+
+static void tid_free(task_t tid) {
+    g_tid_map[tid >> 5] |= 1U << (tid & 31);
+}
+
+static int tid_is_free(task_t tid) {
+    return (g_tid_map[tid >> 5] >> (tid & 31)) & 1;
+}
+
+static void tid_take(task_t tid) {
+    g_tid_map[tid >> 5] &= ~(1U << (tid & 31));
+}
+
+/* TID_KCD or TID_DISPLAY if entry is that built-in task, 0 otherwise */
+static task_t tsk_fixed_tid(void (*entry)()) {
+    if (entry == NULL) {
+        return 0;
+    }
+    if (entry == kcd_task) {
+        return TID_KCD;
+    }
+    return entry == lcd_task ? TID_DISPLAY : 0;
+}
+
+/**
+ * @brief: TID of an initial task. The UART0 IRQ and the KCD address the KCD
+ *         and display tasks by TID_KCD and TID_DISPLAY, which k_tsk_init
+ *         takes out of g_tid_map before any other task gets a TID.
+ * @return: the fixed TID the first time entry is a built-in task, the lowest
+ *          free TID otherwise
+ */
+static int tsk_init_tid(void (*entry)()) {
+    task_t tid = tsk_fixed_tid(entry);
+
+    if (tid != 0 && g_tcbs[tid].state == DORMANT) {
+        return tid;
+    }
+    return tid_alloc();
+}
+
+/**
+ * @brief: free the stacks and TIDs of the tasks on g_tsk_zombies, then hand
+ *         the memory to waiting tasks
+ * NOTE: An exiting task runs on its stacks until the switch away from it, so
+ *       they are freed here, on the stack of the task switched back in.
+ *       A NEW task is started straight from its exception stack frame, the
+ *       zombies then wait for the next switch to a task that ran before.
+ */
+static void tsk_reap(void) {
+    TCB *caller = gp_current_task;
+    TCB *task;
+
+    if (g_tsk_zombies == NULL) {
+        return;
+    }
+
+    gp_current_task = &kernal_task;     /* the stacks are TID_KERNEL blocks */
+    while ((task = g_tsk_zombies) != NULL) {
+        g_tsk_zombies = task->next;
+        task->next = NULL;
+
+        // link-time stacks are not heap blocks
+        if (!task->static_def) {
+            if (task->priv == 0 && dealloc_user_stack(task->psp_hi, task->psp_size) == RTX_ERR) {
+                #ifdef DEBUG_0
+                printf("[ERROR] tsk_reap: failed to deallocate user stack for task %d\n\r", task->tid);
+                #endif /* DEBUG_0 */
+            }
+            if (k_mem_dealloc(TCB_MSP_LO(task)) == RTX_ERR) {
+                #ifdef DEBUG_0
+                printf("[ERROR] tsk_reap: failed to deallocate kernel stack for task %d\n\r", task->tid);
+                #endif /* DEBUG_0 */
+            }
+            task->psp = NULL;
+        }
+        tid_free(task->tid);
+    }
+    gp_current_task = caller;
+
+    if (k_mem_wake_waiters() > 0) {
+        k_tsk_resched();
+    }
+}
+
+/**
+ * @brief: make a link-time task ready. Its stacks and initial frame are
+ *         already in the image, only the pointers go into the TCB.
+ */
+static void tsk_init_static(TCB *p_tcb, const RTX_TASK_DEF *def) {
+    p_tcb->state = NEW;
+    p_tcb->prio = def->prio;
+    p_tcb->base_prio = def->prio;
+    p_tcb->priv = def->priv;
+    p_tcb->static_def = 1;
+
+    p_tcb->k_stack_size = def->k_stack_size;
+    p_tcb->msp_hi = def->k_stack_lo + (def->k_stack_size >> 2);
+    if (def->priv) {
+        p_tcb->msp = p_tcb->msp_hi - TSK_INIT_FRAME_WORDS;
+        p_tcb->psp = p_tcb->msp;
+        p_tcb->psp_hi = NULL;
+        p_tcb->psp_size = 0;
+    } else {
+        p_tcb->msp = p_tcb->msp_hi;
+        p_tcb->psp_hi = def->u_stack_lo + (def->u_stack_size >> 2);
+        p_tcb->psp = p_tcb->psp_hi - TSK_INIT_FRAME_WORDS;
+        p_tcb->psp_size = def->u_stack_size;
+    }
+
+    push(&ready_queue_head, p_tcb);
 }
 
 void null_task_func() {
     while (1) {}
 }
 
+/**
+ * @brief: close the run slice of p_tcb_old and open one for p_tcb_new
+ * PRE: p_tcb_old still has the state it is being switched out with
+ */
+void tsk_account_switch(TCB *p_tcb_old, TCB *p_tcb_new) {
+    U32 now = CYCLES_NOW();
+
+    p_tcb_old->run_cycles += (U32) (now - p_tcb_old->last_run);
+    if (TSK_BLOCKED(p_tcb_old->state)) {
+        p_tcb_old->blk_start = now;
+        p_tcb_old->num_vol++;
+    } else if (g_tsk_preempt) {
+        p_tcb_old->num_invol++;
+    } else {
+        p_tcb_old->num_vol++;
+    }
+
+    if (p_tcb_new->blk_start != 0) {
+        p_tcb_new->blk_cycles += (U32) (now - p_tcb_new->blk_start);
+        p_tcb_new->blk_start = 0;
+    }
+    p_tcb_new->last_run = now;
+    p_tcb_new->num_switches++;
+}
+
+/**
+ * @brief: park the TLS slots of p_tcb_old in its TCB and load the ones
+ *         of p_tcb_new into g_tls
+ */
+static void tls_switch(TCB *p_tcb_old, TCB *p_tcb_new) {
+    for (int i = 0; i < TLS_SLOTS; i++) {
+        p_tcb_old->tls[i] = g_tls[i];
+        g_tls[i] = p_tcb_new->tls[i];
+    }
+}
+
 /**
  * @biref: initialize all tasks in the system
  * @param: RTX_TASK_INFO *task_info, an array of initial tasks
  * @param: num_tasks, number of elements in the task_info array
+ * @param: max_tasks, size of the TCB table including the null task
  * @return: none
  * PRE: memory has been properly initialized
+ * NOTE: tasks from the rtx_tasks section (k_task_def.h) get the TIDs after
+ *       the task_info ones. num_tasks may be 0 if there are any. PRIO_NULL
+ *       entries are skipped without taking a TID, the null task is built in.
+ *       The KCD and display tasks get TID_KCD and TID_DISPLAY, the others
+ *       the lowest free TIDs. Every TID left over is free for tsk_create.
  */
-int k_tsk_init(RTX_TASK_INFO *task_info, int num_tasks) {
+int k_tsk_init(RTX_TASK_INFO *task_info, int num_tasks, int max_tasks) {
 	/* Default is MSP when calling tsk_init(), set to PSP */
 	  //__set_PSP((U32) __get_MSP());
 		//__set_CONTROL((U32)3);
 
-    if (num_tasks <= 0 || num_tasks > MAX_TASKS) {
+    /* TID_KCD and TID_DISPLAY are fixed, the table must reach them */
+    if (max_tasks <= TID_KCD || max_tasks <= TID_DISPLAY || max_tasks > MAX_TASKS_LIMIT) {
+        #ifdef DEBUG_0
+        printf("[ERROR] k_tsk_init: invalid max_tasks\n\r");
+        #endif /* DEBUG_0 */
+        return RTX_ERR;
+    }
+
+    const RTX_TASK_DEF *p_def = &rtx_tasks$$Base;
+    int num_static = &rtx_tasks$$Limit - &rtx_tasks$$Base;
+
+    if (num_tasks < 0 || num_tasks + num_static <= 0 || num_tasks + num_static >= max_tasks) {
         #ifdef DEBUG_0
         printf("[ERROR] k_tsk_init: invalid num_tasks\n\r");
         #endif /* DEBUG_0 */
         return RTX_ERR;
     }
 
-    if (task_info == NULL) {
+    if (task_info == NULL && num_tasks > 0) {
         #ifdef DEBUG_0
         printf("[ERROR] k_tsk_init: no initial kernel tasks to run\n\r");
         #endif /* DEBUG_0 */
@@ -136,27 +445,83 @@ int k_tsk_init(RTX_TASK_INFO *task_info, int num_tasks) {
     int i;
     U32 *sp;
     RTX_TASK_INFO *p_taskinfo = task_info;
+
+    k_mpu_init();
+
+    /* start the cycle counter used for run-time statistics */
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
   
-    // Create fake kernal task with ID = MAX_TASKS+1
-    kernal_task.tid = MAX_TASKS + 1;
+    // Create fake kernal task, it owns the kernel's heap blocks
+    kernal_task.tid = TID_KERNEL;
     gp_current_task = &kernal_task;
 
+    g_tcbs = k_mem_alloc(max_tasks * sizeof(TCB));
+    if (g_tcbs == NULL) {
+        #ifdef DEBUG_0
+        printf("[ERROR] k_tsk_init: no memory for %d TCBs\n\r", max_tasks);
+        #endif /* DEBUG_0 */
+        return RTX_ERR;
+    }
+    g_max_tasks = max_tasks;
+
+    /* heap blocks are not cleared, start from the all-zero TCBs the static table had */
+    for (i = 0; i < (int) (max_tasks * sizeof(TCB) / sizeof(U32)); i++) {
+        ((U32 *) g_tcbs)[i] = 0;
+    }
+    for (i = 0; i < max_tasks; i++) {
+        g_tcbs[i].tid = i;
+        g_tcbs[i].state = DORMANT;
+    }
+    for (i = 0; i < TID_MAP_WORDS; i++) {
+        g_tid_map[i] = 0;
+    }
+    for (i = 1; i < max_tasks; i++) {
+        tid_free(i);
+    }
+    /* keep TID_KCD and TID_DISPLAY for the built-in tasks, see tsk_init_tid */
+    for (i = 0; i < num_tasks; i++) {
+        if (task_info[i].prio != PRIO_NULL && tsk_fixed_tid(task_info[i].ptask) != 0) {
+            tid_take(tsk_fixed_tid(task_info[i].ptask));
+        }
+    }
+    for (; p_def < &rtx_tasks$$Limit; p_def++) {
+        if (tsk_fixed_tid(p_def->ptask) != 0) {
+            tid_take(tsk_fixed_tid(p_def->ptask));
+        }
+    }
+    p_def = &rtx_tasks$$Base;
+
     /* Pretend an exception happened, by adding exception stack frame */
     /* initilize exception stack frame (i.e. initial context) for each task */
-    // TODO: if PRIO is NULL, skip that task
-    for (i = 0; i < num_tasks; i++) { // TODO: check that num task less than max
+    for (i = 0; i < num_tasks; i++, p_taskinfo++) {
         int j;
-        TCB *p_tcb = &g_tcbs[i+1];
 
-        p_tcb->tid = i+1;
+        /* the kernel runs its own null task at TID 0, a PRIO_NULL entry gets no TCB */
+        if (p_taskinfo->prio == PRIO_NULL) {
+            continue;
+        }
+
+        int tid = tsk_init_tid(p_taskinfo->ptask);
+        TCB *p_tcb = &g_tcbs[tid];
+
+        p_tcb->tid = tid;
         p_tcb->state = NEW;
-        p_tcb->mailbox=NULL;
-        //CHECK CREATE FUNCTION
+        p_tcb->has_mailbox = 0;
+        p_tcb->wait_q = NULL;
+        p_tcb->wait_timed = 0;
 
         p_tcb->prio = p_taskinfo->prio;
-        // TODO: can we skip NULL_PRIO task? can we ignore user provided NULL TASK and use our own
-        if (p_tcb->prio == PRIO_NULL) {
-            continue;
+        p_tcb->base_prio = p_tcb->prio;
+        p_tcb->mtx_held = NULL;
+        p_tcb->evt_flags = 0;
+
+        if (alloc_kern_stack(p_tcb, p_taskinfo->k_stack_size) != RTX_OK) {
+            #ifdef DEBUG_0
+            printf("[ERROR] k_tsk_init: failed to allocate init's task kernel stack\n\r");
+            #endif /* DEBUG_0 */
+            return RTX_ERR;
         }
 
         if (p_taskinfo->priv == 0) { /* unprivileged task */
@@ -172,22 +537,18 @@ int k_tsk_init(RTX_TASK_INFO *task_info, int num_tasks) {
 
             sp = p_tcb->psp_hi;
             *(--sp) = INITIAL_xPSR;
-            *(--sp) = (U32)(p_taskinfo->ptask);
+            *(--sp) = (U32) (uintptr_t) (p_taskinfo->ptask);
             for (int j = 0; j < 6; j++) {
                 *(--sp) = 0x0;
             }
 
             p_tcb->psp = sp;
             p_tcb->psp_size = p_taskinfo->u_stack_size;
-            p_tcb->msp_hi = g_k_stacks[i+1] + (KERN_STACK_SIZE >> 2);
-            p_tcb->msp = p_tcb->msp_hi;
         } else { /* privileged task */
             p_tcb->priv = 1;
-
-            p_tcb->msp_hi = g_k_stacks[i+1] + (KERN_STACK_SIZE >> 2);
             sp = p_tcb->msp_hi; /* stacks grows down, so get the high addr. */
             *(--sp)  = INITIAL_xPSR;    									/* task initial xPSR (program status register) */
-            *(--sp)  = (U32)(p_taskinfo->ptask); 					/* PC contains the entry point of the task */
+            *(--sp)  = (U32) (uintptr_t) (p_taskinfo->ptask); 					/* PC contains the entry point of the task */
             for ( j = 0; j < 6; j++ ) { 									/*R0-R3, R12, LR */
                 *(--sp) = 0x0;
             }
@@ -200,23 +561,15 @@ int k_tsk_init(RTX_TASK_INFO *task_info, int num_tasks) {
 
         //Add task to the priority queue for NEW tasks
         push(&ready_queue_head, p_tcb);
-
-        p_taskinfo++;
     }
 
-    for (int q = MAX_TASKS - 1; q > i; q--) {
-        INT_LL_NODE_T *new_tid = k_mem_alloc(sizeof(INT_LL_NODE_T));
-        if (new_tid == NULL) {
-            #ifdef DEBUG_0
-            printf("[ERROR] k_tsk_init: tid failed to allocate memory\n\r");
-            #endif /* DEBUG_0 */
-            return RTX_ERR;
-        }
-        new_tid->tid = q;
-        push_tid(&free_tid_head, new_tid);
+    for (; p_def < &rtx_tasks$$Limit; p_def++) {
+        int tid = tsk_init_tid(p_def->ptask);
+
+        g_tcbs[tid].tid = tid;
+        tsk_init_static(&g_tcbs[tid], p_def);
     }
 
-    print_free_tids(free_tid_head);
     print_prio_queue(ready_queue_head);
 
 
@@ -236,20 +589,26 @@ int k_tsk_init(RTX_TASK_INFO *task_info, int num_tasks) {
 
         sp = null_task->psp_hi; /* stacks grows down, so get the high addr. */
         *(--sp) = INITIAL_xPSR;
-        *(--sp) = (U32)(&null_task_func);
+        *(--sp) = (U32) (uintptr_t) &null_task_func;
         for (int g = 0; g < 6; g++) { /*R0-R3, R12, LR */
             *(--sp) = 0x0;
         }
         null_task->psp = sp;
 
-        null_task->msp_hi = g_k_stacks[0] + (KERN_STACK_SIZE >> 2);
-        null_task->msp = null_task->msp_hi;
+        if (alloc_kern_stack(null_task, KERN_STACK_SIZE) != RTX_OK) {
+            #ifdef DEBUG_0
+            printf("[ERROR] k_tsk_init: failed to allocate memory for null task's kernel stack\n\r");
+            #endif /* DEBUG_0 */
+            return RTX_ERR;
+        }
 
         null_task->prio = PRIO_NULL;
+        null_task->base_prio = PRIO_NULL;
         null_task->priv = 0;
     }
 
     gp_current_task = null_task;
+    k_wait_tick_init();
 
     return RTX_OK;
 }
@@ -296,15 +655,32 @@ int task_switch(TCB *p_tcb_old) { // TODO: confirm both p_tcb_old and gp_current
     
     state = gp_current_task->state;
 
+    if (gp_current_task != p_tcb_old && (state == NEW || state == READY)) {
+        tsk_account_switch(p_tcb_old, gp_current_task);
+        tls_switch(p_tcb_old, gp_current_task);
+        k_mpu_guard_set(gp_current_task);
+    }
+
+    /* p_tcb_old->msp is set here for the check, __ctx_switch stores it again
+       below the registers it saves */
     if (state == NEW) {
         if (gp_current_task != p_tcb_old && p_tcb_old->state != NEW) {
-            p_tcb_old->state = READY;
-            p_tcb_old->msp = (U32 *) __get_MSP();
-            p_tcb_old->psp = (U32 *) __get_PSP();
+            if (p_tcb_old->state == RUNNING) {
+                p_tcb_old->state = READY;
+            }
+            p_tcb_old->msp = (U32 *) (uintptr_t) __get_MSP();
+            p_tcb_old->psp = (U32 *) (uintptr_t) __get_PSP();
+            tsk_stack_check(p_tcb_old);
+            gp_current_task->state = RUNNING;
+            __set_PSP((U32) (uintptr_t) gp_current_task->psp);
+            __ctx_switch(&p_tcb_old->msp, gp_current_task->msp, 1);
+            tsk_reap();     /* p_tcb_old resumes here once it is switched back in */
+            return RTX_OK;
         }
         gp_current_task->state = RUNNING;
-        __set_MSP((U32) gp_current_task->msp);
-        __set_PSP((U32)gp_current_task->psp);
+        k_mpu_guard_set(gp_current_task);   /* the first task dispatched is guarded too */
+        __set_MSP((U32) (uintptr_t) gp_current_task->msp);
+        __set_PSP((U32) (uintptr_t) gp_current_task->psp);
 				
         __rte();  /* pop exception stack frame from the stack for a new task */
     } 
@@ -313,12 +689,16 @@ int task_switch(TCB *p_tcb_old) { // TODO: confirm both p_tcb_old and gp_current
 
     if (gp_current_task != p_tcb_old) {
         if (state == READY) {
-            p_tcb_old->state = READY; 
-            p_tcb_old->msp = (U32 *) __get_MSP(); // save the old process's sp
-            p_tcb_old->psp = (U32 *) __get_PSP();
+            if (p_tcb_old->state == RUNNING) {
+                p_tcb_old->state = READY;   /* a blocked task keeps its BLK_ state */
+            }
+            p_tcb_old->msp = (U32 *) (uintptr_t) __get_MSP(); // save the old process's sp
+            p_tcb_old->psp = (U32 *) (uintptr_t) __get_PSP();
+            tsk_stack_check(p_tcb_old);
             gp_current_task->state = RUNNING;
-            __set_MSP((U32) gp_current_task->msp); //switch to the new proc's stack 
-            __set_PSP((U32)gp_current_task->psp);
+            __set_PSP((U32) (uintptr_t) gp_current_task->psp);
+            __ctx_switch(&p_tcb_old->msp, gp_current_task->msp, 0); //switch to the new proc's stack
+            tsk_reap();     /* back on p_tcb_old's stack, see the NEW case */
         } else {
             gp_current_task = p_tcb_old; // revert back to the old proc on error
             return RTX_ERR;
@@ -377,8 +757,22 @@ int k_tsk_yield(void) {
     return RTX_OK;
 }
 
+/**
+ * @brief like k_tsk_yield, but a switch is counted as involuntary for the running task.
+ *        Used when the kernel or an IRQ handler forces the switch.
+ */
+int k_tsk_preempt(void) {
+    int ret;
 
-int k_tsk_create(task_t *task, void (*task_entry)(void), U8 prio, U16 stack_size) {
+    g_tsk_preempt = 1;
+    ret = k_tsk_yield();
+    g_tsk_preempt = 0;
+
+    return ret;
+}
+
+
+static int tsk_create(task_t *task, void (*task_entry)(void), U8 prio, U16 stack_size, U16 k_stack_size) {
     #ifdef DEBUG_0
     printf("k_tsk_create: entering...\n\r");
     printf("task = 0x%x, task_entry = 0x%x, prio=%d, stack_size = %d\n\r", task, task_entry, prio, stack_size);
@@ -389,7 +783,7 @@ int k_tsk_create(task_t *task, void (*task_entry)(void), U8 prio, U16 stack_size
         printf("[ERROR] k_tsk_create: attempted to create NULL task\n\r");
         #endif /* DEBUG_0 */
         return RTX_ERR;
-    } else if (!(prio >= 0 && prio <= 4)) {
+    } else if (prio > 4) {
         #ifdef DEBUG_0
         printf("[ERROR] k_tsk_create: prio outside of task priority bounds\n\r");
         #endif /* DEBUG_0 */
@@ -403,7 +797,8 @@ int k_tsk_create(task_t *task, void (*task_entry)(void), U8 prio, U16 stack_size
         return RTX_ERR;
     }
 
-    if (free_tid_head == NULL) {
+    int tid = tid_alloc();
+    if (tid < 0) {
         #ifdef DEBUG_0
         printf("[ERROR] k_tsk_create: no available TID\n\r");
         #endif /* DEBUG_0 */
@@ -413,31 +808,31 @@ int k_tsk_create(task_t *task, void (*task_entry)(void), U8 prio, U16 stack_size
     TCB *prev_current_task = gp_current_task;
     gp_current_task = &kernal_task;
 
-    INT_LL_NODE_T *popped_tid = pop_tid(&free_tid_head);
-    if (popped_tid == NULL) {
-        #ifdef DEBUG_0
-        printf("[ERROR] k_tsk_create: no available TID\n\r");
-        #endif /* DEBUG_0 */
-        return RTX_ERR;
-    }
-
-    int tid = popped_tid->tid;
-    if (k_mem_dealloc(popped_tid) == RTX_ERR) {
-        #ifdef DEBUG_0
-        printf("[ERROR] k_tsk_create: error in deallocating tid\n\r");
-        #endif /* DEBUG_0 */
-        return RTX_ERR;
-    }
-
     TCB *new_task = &g_tcbs[tid];
 
     new_task->tid = tid;
     new_task->state = NEW;
     new_task->next = NULL;
     new_task->prio = prio;
+    new_task->base_prio = prio;
+    new_task->mtx_held = NULL;
+    new_task->evt_flags = 0;
     new_task->priv = 0;
-    new_task->mailbox=NULL;
-    //ADD SETTING MAILBOX TO NULL
+    new_task->static_def = 0;
+    for (int j = 0; j < TLS_SLOTS; j++) {
+        new_task->tls[j] = 0;
+    }
+    new_task->has_mailbox = 0;
+    new_task->wait_q = NULL;
+    new_task->wait_timed = 0;
+
+    new_task->run_cycles = 0;
+    new_task->blk_cycles = 0;
+    new_task->last_run = 0;
+    new_task->blk_start = 0;
+    new_task->num_switches = 0;
+    new_task->num_vol = 0;
+    new_task->num_invol = 0;
 
     new_task->psp_size = stack_size;
     new_task->psp_hi = alloc_user_stack(stack_size);
@@ -445,6 +840,20 @@ int k_tsk_create(task_t *task, void (*task_entry)(void), U8 prio, U16 stack_size
         #ifdef DEBUG_0
         printf("[ERROR] k_tsk_create: could not allocate stack for new task\n\r");
         #endif /* DEBUG_0 */
+        new_task->state = DORMANT;
+        tid_free(tid);
+        gp_current_task = prev_current_task;
+        return RTX_ERR;
+    }
+
+    if (alloc_kern_stack(new_task, k_stack_size) != RTX_OK) {
+        #ifdef DEBUG_0
+        printf("[ERROR] k_tsk_create: could not allocate kernel stack of %d bytes\n\r", k_stack_size);
+        #endif /* DEBUG_0 */
+        dealloc_user_stack(new_task->psp_hi, stack_size);
+        new_task->state = DORMANT;
+        tid_free(tid);
+        gp_current_task = prev_current_task;
         return RTX_ERR;
     }
 
@@ -452,27 +861,40 @@ int k_tsk_create(task_t *task, void (*task_entry)(void), U8 prio, U16 stack_size
 
     U32* sp = new_task->psp_hi;
     *(--sp) = INITIAL_xPSR;
-    *(--sp) = (U32)(task_entry);
+    *(--sp) = (U32) (uintptr_t) (task_entry);
     for (int j = 0; j < 6; j++) {
         *(--sp) = 0x0;
     }
     new_task->psp = sp;
 
-    new_task->msp_hi = g_k_stacks[tid] + (KERN_STACK_SIZE >> 2);
-    new_task->msp = new_task->msp_hi;
-
     push(&ready_queue_head, new_task);
     print_prio_queue(ready_queue_head);
 
     if(gp_current_task->prio > new_task->prio)  {
         //must run immediately
-        k_tsk_yield();
+        k_tsk_preempt();
     }
     *task = new_task->tid;
 
     return RTX_OK;
 }
 
+int k_tsk_create(task_t *task, void (*task_entry)(void), U8 prio, U16 stack_size) {
+    return tsk_create(task, task_entry, prio, stack_size, 0);
+}
+
+/**
+ * @brief: tsk_create with the kernel stack size given as well
+ * @param: info, ptask, prio, u_stack_size and k_stack_size are used,
+ *         k_stack_size = 0 picks KERN_STACK_SIZE
+ */
+int k_tsk_create_ex(task_t *task, const RTX_TASK_INFO *info) {
+    if (info == NULL) {
+        return RTX_ERR;
+    }
+    return tsk_create(task, (void (*)(void)) info->ptask, info->prio, info->u_stack_size, info->k_stack_size);
+}
+
 
 void k_tsk_exit(void) {
     #ifdef DEBUG_0
@@ -480,34 +902,26 @@ void k_tsk_exit(void) {
     #endif /* DEBUG_0 */
     // A PRIO_NULL task cannot exit
     if (gp_current_task->prio != PRIO_NULL) {
-        gp_current_task->state = DORMANT;
-
-        TCB *prev_current_task = gp_current_task;
-        gp_current_task = &kernal_task;
-
-        // If its unpriviledged task, dealloc user stack
-        if (prev_current_task->priv == 0) {
-            if (dealloc_user_stack(prev_current_task->psp_hi, prev_current_task->psp_size) == RTX_ERR) {
-                #ifdef DEBUG_0
-                printf("[ERROR] k_tsk_exit: failed to deallocate user stack for task %d\n\r", prev_current_task->tid);
-                #endif /* DEBUG_0 */
-            }
-            prev_current_task->psp = NULL;
-        }
+        // hand held mutexes to their waiters, the yield below lets them run
+        k_mtx_release_all(gp_current_task);
 
-        INT_LL_NODE_T *new_tid = k_mem_alloc(sizeof(INT_LL_NODE_T));
-        if (new_tid == NULL) {
-            #ifdef DEBUG_0
-            printf("[ERROR] k_tsk_exit: could not allocate memory for new_tid\n\r");
-            #endif /* DEBUG_0 */
+        // the mailbox buffer is the task's own block, free it while the task still owns it
+        if (gp_current_task->has_mailbox) {
+            k_mem_dealloc(gp_current_task->mailbox.buffer_start);
+            gp_current_task->has_mailbox = 0;
         }
-        new_tid->tid = prev_current_task->tid;
-        push_tid(&free_tid_head, new_tid);
+        gp_current_task->state = DORMANT;
 
-        pop_task_by_id(&ready_queue_head, 0);
-        gp_current_task = &g_tcbs[0];
+        // its stacks are still in use until the switch below, tsk_reap frees
+        // them and the TID from the next task's side of a switch
+        TCB *prev_current_task = gp_current_task;
+        prev_current_task->next = g_tsk_zombies;
+        g_tsk_zombies = prev_current_task;
 
-        k_tsk_yield();
+        // the null task is always ready here, so there is a task to switch to.
+        // task_switch closes the exiting task's slice and checks its stacks
+        gp_current_task = pop(&ready_queue_head);
+        task_switch(prev_current_task);
     }
 
     return;
@@ -515,6 +929,8 @@ void k_tsk_exit(void) {
 
 
 int k_tsk_set_prio(task_t task_id, U8 prio) {
+    int ret;
+
     #ifdef DEBUG_0
     printf("k_tsk_set_prio: entering...\n\r");
     printf("task_id = %d, prio = %d.\n\r", task_id, prio);
@@ -525,7 +941,7 @@ int k_tsk_set_prio(task_t task_id, U8 prio) {
         printf("[ERROR] k_tsk_set_prio: cannot set prio to PRIO_NULL\n\r");
         #endif /* DEBUG_0 */
         return RTX_ERR;
-    } else if (!(prio >= 0 && prio <= 4)) {
+    } else if (prio > 4) {
         #ifdef DEBUG_0
         printf("[ERROR] k_tsk_set_prio: prio outside of task priority bounds\n\r");
         #endif /* DEBUG_0 */
@@ -540,7 +956,7 @@ int k_tsk_set_prio(task_t task_id, U8 prio) {
         return RTX_ERR;
     }
 
-    if (task_id >= MAX_TASKS || task_id < 0) {
+    if (task_id >= g_max_tasks) {
         #ifdef DEBUG_0
         printf("[ERROR] k_tsk_get: task ID outside of TID domain\n\r");
         #endif /* DEBUG_0 */
@@ -550,7 +966,9 @@ int k_tsk_set_prio(task_t task_id, U8 prio) {
     //Ensure that we are only popping the task frmo the ready queue if it isn't already runing
     TCB *task;
 
-    if (task_id != gp_current_task->tid){
+    if (task_id != gp_current_task->tid && TSK_BLOCKED(g_tcbs[task_id].state)) {
+        task = &g_tcbs[task_id];    /* parked on a wait queue, not on the ready queue */
+    } else if (task_id != gp_current_task->tid){
         task = pop_task_by_id(&ready_queue_head, task_id);
     } else {
         task = gp_current_task;
@@ -581,6 +999,16 @@ int k_tsk_set_prio(task_t task_id, U8 prio) {
     // An unprivileged task may change the priority of any other unprivileged task (including itself).
     // A privileged task may change the priority of any other task (including itself).
     if (((gp_current_task->priv == 0 && task->priv == 0) || gp_current_task->priv == 1)) {
+        // a mutex holder keeps running at the priority it inherited if that is higher
+        task->base_prio = prio;
+        prio = k_mtx_effective_prio(task);
+
+        if (TSK_BLOCKED(task->state)) {
+            // a blocked task cannot preempt anyone, it only moves within its wait queue
+            k_wait_reprio(task, prio);
+            k_mtx_prio_changed(task);
+            return RTX_OK;
+        }
         task->prio = prio;
 
         //    The caller of this primitive never blocks, but could be preempted.
@@ -596,7 +1024,10 @@ int k_tsk_set_prio(task_t task_id, U8 prio) {
                 TCB *p_tcb_old = gp_current_task;
                 push(&ready_queue_head, p_tcb_old);
                 gp_current_task = task;
-                if (task_switch(p_tcb_old) == RTX_ERR) {
+                g_tsk_preempt = 1;
+                ret = task_switch(p_tcb_old);
+                g_tsk_preempt = 0;
+                if (ret == RTX_ERR) {
                     #ifdef DEBUG_0
                     printf("[ERROR] k_tsk_set_prio: could not switch task, same task resuming");
                     #endif
@@ -613,7 +1044,7 @@ int k_tsk_set_prio(task_t task_id, U8 prio) {
         else if (gp_current_task->prio > ready_queue_head->prio){
             //Yielding the current running task only if ready_queue_head
             //has a higher priority than the currently running task
-            k_tsk_yield();
+            k_tsk_preempt();
         }
         //No changes made if running task prio is higher or equal to prio of ready Q head
 
@@ -635,14 +1066,14 @@ int k_tsk_get(task_t task_id, RTX_TASK_INFO *buffer) {
     }
 
     // TODO: what if we try to access non-existent task, DORMANT
-    if (task_id >= MAX_TASKS || task_id < 0) {
+    if (task_id >= g_max_tasks) {
         #ifdef DEBUG_0
         printf("[ERROR] k_tsk_get: task ID outside of TID domain\n\r");
         #endif /* DEBUG_0 */
         return RTX_ERR;
     }
 
-    if (tid_is_available(free_tid_head, task_id) == 1) {
+    if (tid_is_free(task_id)) {
         #ifdef DEBUG_0
         printf("[ERROR] k_tsk_get: task ID does not exist or dormant\n\r");
         #endif /* DEBUG_0 */
@@ -659,13 +1090,13 @@ int k_tsk_get(task_t task_id, RTX_TASK_INFO *buffer) {
     buffer->prio = task->prio;
     buffer->state = task->state;
     buffer->priv = task->priv;
-    buffer->k_stack_size = KERN_STACK_SIZE;
+    buffer->k_stack_size = task->k_stack_size;
     buffer->k_sp = __get_MSP();
-    buffer->k_stack_hi = (U32) task->msp_hi;
+    buffer->k_stack_hi = (U32) (uintptr_t) task->msp_hi;
 
     if (task->priv == 0) {
         buffer->u_stack_size = task->psp_size;
-        buffer->u_stack_hi = (U32) task->psp_hi;
+        buffer->u_stack_hi = (U32) (uintptr_t) task->psp_hi;
         buffer->u_sp = __get_PSP();
         buffer->ptask = (void (*)()) (task->psp_hi - 2);
     } else {
@@ -677,3 +1108,160 @@ int k_tsk_get(task_t task_id, RTX_TASK_INFO *buffer) {
 
     return RTX_OK;     
 }
+
+/**
+ * @brief: list the TIDs of the tasks that are not DORMANT
+ * @param: buf, array of count task_t to fill
+ * @return: number of TIDs written, RTX_ERR on invalid arguments
+ */
+int k_tsk_ls(task_t *buf, int count) {
+    #ifdef DEBUG_0
+    printf("k_tsk_ls: buf = 0x%x, count = %d\n\r", buf, count);
+    #endif /* DEBUG_0 */
+
+    if (buf == NULL || count <= 0) {
+        return RTX_ERR;
+    }
+
+    int n = 0;
+
+    for (int i = 0; i < g_max_tasks && n < count; i++) {
+        TCB *task = &g_tcbs[i];
+
+        // same rule as k_tsk_stats, an initial PRIO_NULL task never runs
+        if (task->state == DORMANT || (task->prio == PRIO_NULL && task != null_task)) {
+            continue;
+        }
+        buf[n++] = task->tid;
+    }
+
+    return n;
+}
+
+/**
+ * @brief: snapshot run-time statistics of every task that is not DORMANT
+ * @param: buf, array of count RTX_TASK_STATS elements to fill
+ * @return: number of elements filled, RTX_ERR on invalid arguments
+ * NOTE: the running task's current slice is included in its run_cycles.
+ */
+int k_tsk_stats(RTX_TASK_STATS *buf, int count) {
+    #ifdef DEBUG_0
+    printf("k_tsk_stats: buf = 0x%x, count = %d\n\r", buf, count);
+    #endif /* DEBUG_0 */
+
+    if (buf == NULL || count <= 0) {
+        return RTX_ERR;
+    }
+
+    U32 now = CYCLES_NOW();
+    int n = 0;
+
+    for (int i = 0; i < g_max_tasks && n < count; i++) {
+        TCB *task = &g_tcbs[i];
+
+        // an initial task given with PRIO_NULL is never scheduled, the kernel runs its own null task
+        if (task->state == DORMANT || (task->prio == PRIO_NULL && task != null_task)) {
+            continue;
+        }
+
+        buf[n].tid = task->tid;
+        buf[n].prio = task->prio;
+        buf[n].state = task->state;
+        buf[n].run_cycles = task->run_cycles;
+        buf[n].blk_cycles = task->blk_cycles;
+        buf[n].last_run = task->last_run;
+        buf[n].num_switches = task->num_switches;
+        buf[n].num_vol = task->num_vol;
+        buf[n].num_invol = task->num_invol;
+        buf[n].k_stack_size = task->k_stack_size;
+        buf[n].k_stack_used = tsk_stack_used(TCB_MSP_LO(task), task->msp_hi);
+        if (task->priv == 0) {
+            buf[n].u_stack_size = task->psp_size;
+            buf[n].u_stack_used = tsk_stack_used(TCB_PSP_LO(task), task->psp_hi);
+        } else {
+            buf[n].u_stack_size = 0;
+            buf[n].u_stack_used = 0;
+        }
+
+        if (task == gp_current_task) {
+            buf[n].run_cycles += (U32) (now - task->last_run);
+            buf[n].last_run = now;
+        } else if (task->blk_start != 0) {
+            buf[n].blk_cycles += (U32) (now - task->blk_start);
+        }
+        n++;
+    }
+
+    return n;
+}
+
+/**
+ * @brief: block the running task on wq until it is woken or timeout ticks pass
+ * @param: wq, wait queue to park on, NULL to only wait for the timeout
+ * @param: state, the BLK_ state the task is in while parked
+ * @param: timeout, ticks to wait or WAIT_FOREVER
+ * @return: the value the waker passed to k_tsk_unblock, RTX_ERR on timeout
+ * NOTE: the null task is always either running or ready, and it never blocks,
+ *       so there is always a task to switch to.
+ */
+int k_tsk_block(WAIT_QUEUE_T *wq, U8 state, U32 timeout) {
+    TCB *p_tcb_old = gp_current_task;
+
+    if (p_tcb_old->prio == PRIO_NULL) {
+        #ifdef DEBUG_0
+        printf("[ERROR] k_tsk_block: the null task cannot block\n\r");
+        #endif /* DEBUG_0 */
+        return RTX_ERR;
+    }
+
+    p_tcb_old->state = state;
+    p_tcb_old->wait_ret = RTX_ERR;
+    wait_enqueue(wq, p_tcb_old, timeout);
+
+    gp_current_task = pop(&ready_queue_head);
+    if (task_switch(p_tcb_old) == RTX_ERR) {
+        #ifdef DEBUG_0
+        printf("[ERROR] k_tsk_block: could not switch away from task %d\n\r", p_tcb_old->tid);
+        #endif /* DEBUG_0 */
+        wait_remove(p_tcb_old);
+        p_tcb_old->state = RUNNING;
+        return RTX_ERR;
+    }
+
+    /* running again, whoever woke us has already taken us off wq */
+    return p_tcb_old->wait_ret;
+}
+
+/**
+ * @brief: make a blocked task ready again. It does not preempt the caller,
+ *         see k_tsk_resched.
+ * @param: ret, returned by the task's k_tsk_block call
+ */
+void k_tsk_unblock(TCB *task, int ret) {
+    wait_remove(task);
+    task->wait_ret = ret;
+    task->state = READY;
+    push(&ready_queue_head, task);
+}
+
+/**
+ * @brief: let a task woken by the caller run if it outranks the caller
+ */
+int k_tsk_resched(void) {
+    if (ready_queue_head != NULL && ready_queue_head->prio < gp_current_task->prio) {
+        return k_tsk_preempt();
+    }
+    return RTX_OK;
+}
+
+/**
+ * @brief: suspend the running task for ticks ticks
+ */
+int k_tsk_delay(U32 ticks) {
+    if (ticks == 0 || ticks == WAIT_FOREVER) {
+        return RTX_ERR;
+    }
+
+    k_tsk_block(NULL, BLK_DELAY, ticks);
+    return RTX_OK;   /* a delay ends by timing out, that is the normal case */
+}
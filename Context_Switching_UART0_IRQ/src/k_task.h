@@ -10,27 +10,46 @@
 #define K_TASK_H_
 
 #include "k_rtx.h"
+#include "k_wait.h"
+#include "k_task_def.h"
 
 /* ----- Definitions ----- */
 
-#define INITIAL_xPSR 0x01000000        /* user process initial xPSR value */
+/* g_tid_map words, one bit per TID up to MAX_TASKS_LIMIT */
+#define TID_MAP_WORDS ((MAX_TASKS_LIMIT + 31) >> 5)
+
+/* parked on a wait queue or the timeout list, see k_wait.h */
+#define TSK_BLOCKED(state) ((state) == BLK_MEM || (state) == BLK_MSG || ((state) >= BLK_DELAY && (state) < NEW))
 
 /* ----- Functions ----- */
 
-int k_tsk_init(RTX_TASK_INFO *task_info, int num_tasks);    /* initialize all tasks in the system */
+int k_tsk_init(RTX_TASK_INFO *task_info, int num_tasks, int max_tasks);    /* initialize all tasks in the system */
 TCB *dummy_scheduler(void);      /* pick the tid of the next to run task */
 int k_tsk_yield(void);           /* kernel tsk_yield function */
+int k_tsk_preempt(void);         /* tsk_yield forced by the kernel or an IRQ */
 
 int k_tsk_create(task_t *task, void (*task_entry)(void), U8 prio, U16 stack_size);
+int k_tsk_create_ex(task_t *task, const RTX_TASK_INFO *info);
 void k_tsk_exit(void);
 int k_tsk_set_prio(task_t task_id, U8 prio);
 int k_tsk_get(task_t task_id, RTX_TASK_INFO *buffer);
 int k_tsk_ls(task_t *buf, int count);
+int k_tsk_stats(RTX_TASK_STATS *buf, int count);
+int k_tsk_delay(U32 ticks);
+
+int k_tsk_block(WAIT_QUEUE_T *wq, U8 state, U32 timeout);  /* park the running task */
+void k_tsk_unblock(TCB *task, int ret);                     /* make a parked task READY */
+int k_tsk_resched(void);         /* preempt the caller if a higher priority task is ready */
+
+U32 tsk_stack_used(U32 *stack_lo, U32 *stack_hi);   /* high-water mark in bytes */
+void tsk_stack_overflow(TCB *task);    /* called when a stack check fails, does not return */
+void tsk_fault_report(task_t tid, char *what);  /* "[FAULT] task <tid>: <what>" on UART1 */
 
 extern void __rte(void);               /* pop exception stack frame */
+extern void __ctx_switch(U32 **p_old_msp, U32 *new_msp, U32 is_new); /* save R4-R11, switch MSP */
 
-/* we do not implement these tasks in the starter code */
-extern void null_task(void);
+/* we do not implement these tasks in the starter code.
+   null_task (null_task.c) is not declared here, k_task.c's null_task is the null task's TCB */
 extern void kcd_task(void);
 extern void lcd_task(void);
 
@@ -0,0 +1,73 @@
+/**
+ * @file:   k_task_def.h
+ * @brief:  link-time task table, tasks that exist before rtx_init runs
+ * NOTE: RTX_TASK_DEFINE_PRIV/RTX_TASK_DEFINE_USR emit the task's stacks with
+ *       the initial exception frame already in place and a RTX_TASK_DEF into
+ *       the rtx_tasks section. k_tsk_init walks that section and only copies
+ *       the pointers into the TCB: no heap allocation, no frame building and
+ *       no stack fill at boot. The linker must keep the section, see the
+ *       --keep=*(rtx_tasks) option in SVC.uvprojx.
+ *       Static stacks are not pattern filled, only the canary is set, so
+ *       tsk_stats reports them as fully used. Measure a task created at run
+ *       time first to size its static stacks.
+ */
+
+#ifndef K_TASK_DEF_H_
+#define K_TASK_DEF_H_
+
+#include "k_rtx.h"
+#include "k_mpu.h"
+
+/* ----- Definitions ----- */
+
+#define INITIAL_xPSR         0x01000000  /* user process initial xPSR value */
+#define STACK_FILL           0xA5A5A5A5  /* unused stack words, the lowest word doubles as the canary */
+#define TSK_INIT_FRAME_WORDS 8           /* R0-R3, R12, LR, PC, xPSR */
+
+typedef struct rtx_task_def {
+    void (*ptask)(void);
+    U32 *k_stack_lo;     /* kernel stack, initial frame on top if priv */
+    U32 *u_stack_lo;     /* user stack, initial frame on top, NULL if priv */
+    U16  k_stack_size;   /* bytes */
+    U16  u_stack_size;   /* bytes, 0 if priv */
+    U8   prio;
+    U8   priv;
+} RTX_TASK_DEF;
+
+/* words of a stack of size bytes, the frame is the top TSK_INIT_FRAME_WORDS of them */
+#define TSK_DEF_WORDS(size) ((size) >> 2)
+
+/* canary at word lo, the initial frame at the top (PC = entry, xPSR) */
+#define TSK_DEF_STACK(lo, words, entry)                                        \
+    { [(lo)] = STACK_FILL, [(words) - 2] = (U32) (entry), [(words) - 1] = INITIAL_xPSR }
+
+/**
+ * @brief: privileged task, runs on its kernel stack
+ * @param: k_size, kernel stack bytes, a multiple of 8 and at least KERN_STACK_MIN
+ */
+#define RTX_TASK_DEFINE_PRIV(name, entry, prio, k_size)                        \
+    extern void entry(void);                                                   \
+    static U32 name##_k_stack[TSK_DEF_WORDS(k_size)] __attribute__((aligned(8))) = \
+        TSK_DEF_STACK(0, TSK_DEF_WORDS(k_size), entry);                        \
+    const RTX_TASK_DEF name __attribute__((section("rtx_tasks"), used)) = {    \
+        entry, name##_k_stack, NULL, (k_size), 0, (prio), 1                    \
+    }
+
+/**
+ * @brief: unprivileged task, the user stack carries MPU_STACK_PAD bytes
+ *         below it for the MPU guard like a heap allocated one
+ * @param: u_size, k_size, stack bytes, multiples of 8
+ */
+#define RTX_TASK_DEFINE_USR(name, entry, prio, u_size, k_size)                 \
+    extern void entry(void);                                                   \
+    static U32 name##_k_stack[TSK_DEF_WORDS(k_size)] __attribute__((aligned(8))) = \
+        { [0] = STACK_FILL };                                                  \
+    static U32 name##_u_stack[TSK_DEF_WORDS(MPU_STACK_PAD + (u_size))] __attribute__((aligned(8))) = \
+        TSK_DEF_STACK(TSK_DEF_WORDS(MPU_STACK_PAD),                            \
+                      TSK_DEF_WORDS(MPU_STACK_PAD + (u_size)), entry);         \
+    const RTX_TASK_DEF name __attribute__((section("rtx_tasks"), used)) = {    \
+        entry, name##_k_stack, name##_u_stack + TSK_DEF_WORDS(MPU_STACK_PAD),  \
+        (k_size), (u_size), (prio), 0                                          \
+    }
+
+#endif /* ! K_TASK_DEF_H_ */
@@ -0,0 +1,210 @@
+/**
+ * @file:   k_wait.c
+ * @brief:  wait queues and timeouts
+ * NOTE: Everything here runs with interrupts disabled, either inside an SVC
+ *       or inside the tick interrupt.
+ */
+
+#include <LPC17xx.h>
+#include "k_wait.h"
+#include "k_task.h"
+
+#ifdef DEBUG_0
+#include "printf.h"
+#endif /* DEBUG_0 */
+
+U32 g_wait_ticks = 0;
+TCB *g_timer_head = NULL;   /* tasks with a timeout, earliest deadline first */
+
+extern TCB *gp_current_task;
+extern TCB *ready_queue_head;
+
+/* lowest set bit of a 5 bit mask, i.e. the highest priority non-empty FIFO */
+static const U8 g_lowest_bit[1 << NUM_PRIO] = {
+    0, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+    4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+};
+
+void k_wait_init(WAIT_QUEUE_T *wq) {
+    int p;
+
+    for (p = 0; p < NUM_PRIO; p++) {
+        wq->head[p] = NULL;
+        wq->tail[p] = NULL;
+    }
+    wq->mask = 0;
+}
+
+int k_wait_empty(WAIT_QUEUE_T *wq) {
+    return wq->mask == 0;
+}
+
+TCB *k_wait_peek(WAIT_QUEUE_T *wq) {
+    if (wq->mask == 0) {
+        return NULL;
+    }
+    return wq->head[g_lowest_bit[wq->mask]];
+}
+
+static void fifo_append(WAIT_QUEUE_T *wq, TCB *task) {
+    U8 p = task->prio;
+
+    task->next = NULL;
+    task->wait_prev = wq->tail[p];
+    if (wq->tail[p] != NULL) {
+        wq->tail[p]->next = task;
+    } else {
+        wq->head[p] = task;
+    }
+    wq->tail[p] = task;
+    wq->mask |= 1 << p;
+}
+
+static void fifo_unlink(WAIT_QUEUE_T *wq, TCB *task) {
+    U8 p = task->prio;
+
+    if (task->wait_prev != NULL) {
+        task->wait_prev->next = task->next;
+    } else {
+        wq->head[p] = task->next;
+    }
+    if (task->next != NULL) {
+        task->next->wait_prev = task->wait_prev;
+    } else {
+        wq->tail[p] = task->wait_prev;
+    }
+    if (wq->head[p] == NULL) {
+        wq->mask &= ~(1 << p);
+    }
+    task->next = NULL;
+    task->wait_prev = NULL;
+}
+
+/* deadlines are compared as signed differences so the tick counter may wrap */
+static void timer_insert(TCB *task) {
+    TCB **pp = &g_timer_head;
+
+    while (*pp != NULL && (S32) ((*pp)->wait_until - task->wait_until) <= 0) {
+        pp = &(*pp)->timer_next;
+    }
+    task->timer_next = *pp;
+    *pp = task;
+    task->wait_timed = 1;
+}
+
+static void timer_remove(TCB *task) {
+    TCB **pp = &g_timer_head;
+
+    while (*pp != NULL && *pp != task) {
+        pp = &(*pp)->timer_next;
+    }
+    if (*pp != NULL) {
+        *pp = task->timer_next;
+    }
+    task->timer_next = NULL;
+    task->wait_timed = 0;
+}
+
+/**
+ * @brief: park a task on wq (NULL for a plain delay) with a timeout in ticks
+ * PRE: the task is off the ready queue
+ */
+void wait_enqueue(WAIT_QUEUE_T *wq, TCB *task, U32 timeout) {
+    task->wait_q = wq;
+    if (wq != NULL) {
+        fifo_append(wq, task);
+    }
+    if (timeout != WAIT_FOREVER) {
+        task->wait_until = g_wait_ticks + timeout;
+        timer_insert(task);
+    }
+}
+
+/**
+ * @brief: take a task off its wait queue and the timeout list
+ */
+void wait_remove(TCB *task) {
+    if (task->wait_q != NULL) {
+        fifo_unlink(task->wait_q, task);
+        task->wait_q = NULL;
+    }
+    if (task->wait_timed) {
+        timer_remove(task);
+    }
+}
+
+TCB *k_wait_wake_one(WAIT_QUEUE_T *wq, int ret) {
+    TCB *task = k_wait_peek(wq);
+
+    if (task != NULL) {
+        k_tsk_unblock(task, ret);
+    }
+    return task;
+}
+
+int k_wait_wake_all(WAIT_QUEUE_T *wq, int ret) {
+    int n = 0;
+
+    while (wq->mask != 0) {
+        k_tsk_unblock(wq->head[g_lowest_bit[wq->mask]], ret);
+        n++;
+    }
+    return n;
+}
+
+/**
+ * @brief: move a parked task to the FIFO of its new priority, at the back
+ */
+void k_wait_reprio(TCB *task, U8 prio) {
+    WAIT_QUEUE_T *wq = task->wait_q;
+
+    if (wq != NULL) {
+        fifo_unlink(wq, task);
+    }
+    task->prio = prio;
+    if (wq != NULL) {
+        fifo_append(wq, task);
+    }
+}
+
+void k_wait_tick_init(void) {
+    g_wait_ticks = 0;
+    SysTick_Config(SystemCoreClock / WAIT_TICK_HZ);
+}
+
+/**
+ * @brief: advance the tick count and time out every expired wait
+ * @return: 1 if a task that timed out outranks the running task
+ */
+int k_wait_tick(void) {
+    g_wait_ticks++;
+
+    while (g_timer_head != NULL && (S32) (g_timer_head->wait_until - g_wait_ticks) <= 0) {
+        k_tsk_unblock(g_timer_head, RTX_ERR);
+    }
+
+    return ready_queue_head != NULL && ready_queue_head->prio < gp_current_task->prio;
+}
+
+/* the host port (../host) has no vector table, it calls k_wait_tick itself */
+#ifndef HOST_PORT
+/**
+ * @brief: SysTick drives the timeouts. Same shape as UART0_IRQHandler: the C
+ *         part reports whether a switch is needed and the switch is forced here.
+ */
+__asm void SysTick_Handler(void)
+{
+    PRESERVE8
+    IMPORT k_wait_tick
+    IMPORT k_tsk_preempt
+    CPSID I
+    PUSH {r4-r11, lr}
+    BL k_wait_tick
+    CMP R0, #0
+    BEQ TICK_RESTORE     ; nothing woke up, or nothing that outranks the running task
+    BL k_tsk_preempt
+TICK_RESTORE
+    CPSIE I
+    POP {r4-r11, pc}
+}
+#endif /* ! HOST_PORT */
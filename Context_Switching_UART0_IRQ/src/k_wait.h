@@ -0,0 +1,51 @@
+/**
+ * @file:   k_wait.h
+ * @brief:  wait queues, the one blocking mechanism of the kernel
+ * NOTE: Mailboxes, memory waits, semaphores and delays all park the running
+ *       task on a WAIT_QUEUE_T through k_tsk_block() and make it ready again
+ *       through the wake functions below. A blocked task is never on the
+ *       ready queue, so TCB->next doubles as the wait queue link.
+ */
+
+#ifndef K_WAIT_H_
+#define K_WAIT_H_
+
+#include "k_rtx.h"
+
+/* ----- Definitions ----- */
+#define NUM_PRIO     (PRIO_NULL + 1)    /* HIGH..PRIO_NULL */
+#define WAIT_FOREVER 0xFFFFFFFF         /* timeout that never expires */
+
+#ifndef WAIT_TICK_HZ
+#define WAIT_TICK_HZ 1000               /* timeouts are counted in ticks of 1ms */
+#endif /* ! WAIT_TICK_HZ */
+
+/* ----- Types ----- */
+
+/* one FIFO per priority plus a bitmap of the non-empty ones, so both
+   queueing and picking the highest priority waiter take constant time */
+typedef struct wait_queue {
+    TCB *head[NUM_PRIO];
+    TCB *tail[NUM_PRIO];
+    U8  mask;               /* bit p set when head[p] != NULL */
+} WAIT_QUEUE_T;
+
+/* ----- Variables ----- */
+extern U32 g_wait_ticks;    /* ticks since k_wait_tick_init */
+
+/* ----- Functions ----- */
+void k_wait_init(WAIT_QUEUE_T *wq);
+int  k_wait_empty(WAIT_QUEUE_T *wq);
+TCB *k_wait_peek(WAIT_QUEUE_T *wq);                 /* highest priority waiter, not removed */
+TCB *k_wait_wake_one(WAIT_QUEUE_T *wq, int ret);    /* NULL if nobody waits */
+int  k_wait_wake_all(WAIT_QUEUE_T *wq, int ret);    /* returns the number woken */
+void k_wait_reprio(TCB *task, U8 prio);             /* priority change of a parked task */
+
+/* used by the scheduler in k_task.c */
+void wait_enqueue(WAIT_QUEUE_T *wq, TCB *task, U32 timeout);
+void wait_remove(TCB *task);
+
+void k_wait_tick_init(void);
+int  k_wait_tick(void);     /* from the tick interrupt, 1 if a woken task should preempt */
+
+#endif /* ! K_WAIT_H_ */
@@ -0,0 +1,217 @@
+/**
+ * @file:   kcd_parse.c
+ * @brief:  incremental command line parser of the KCD task
+ * NOTE: no RTX calls in here, the KCD task owns the parser and does the
+ *       echo and the dispatch based on what kcd_parse_char returns.
+ */
+
+#include "kcd_parse.h"
+
+#define KCD_CH_BS   0x08
+#define KCD_CH_DEL  0x7F
+#define KCD_CH_KILL 0x15    /* Ctrl-U */
+#define KCD_CH_ESC  0x1B
+#define KCD_CH_TAB  '\t'
+
+void kcd_parse_reset(KCD_PARSER_T *p)
+{
+    p->len = 0;
+    p->state = KCD_PS_IDLE;
+    p->cmd_len = 0;
+    p->argc = 0;
+    p->cmd_hash = KCD_HASH_INIT;
+    p->esc = 0;
+    p->line[0] = '\0';
+}
+
+/* remove the last character and step the token state back with it */
+static int kcd_parse_erase(KCD_PARSER_T *p)
+{
+    if (p->len == 0) {
+        kcd_parse_reset(p);     /* erased the '%' itself */
+        return KCD_PARSE_ERASED;
+    }
+
+    p->len--;
+    if (p->line[p->len] == '\0') {
+        /* a separator, back into the token before it */
+        p->state = p->argc == 0 ? KCD_PS_CMD : KCD_PS_ARG;
+    } else if (p->state == KCD_PS_ARG && p->len == p->argv[p->argc - 1]) {
+        p->argc--;
+        p->state = KCD_PS_SEP;
+    } else if (p->state == KCD_PS_CMD) {
+        p->cmd_hash = KCD_HASH_INIT;
+        for (U8 i = 0; i < p->len; i++) {
+            p->cmd_hash = KCD_HASH_STEP(p->cmd_hash, p->line[i]);
+        }
+    }
+    p->line[p->len] = '\0';
+
+    return KCD_PARSE_ERASED;
+}
+
+/**
+ * @brief: feed one typed character to the parser
+ * @return: KCD_PARSE_ result. After KCD_PARSE_DONE, line + 0 is the identifier
+ *          (cmd_len characters, hash cmd_hash) and line + argv[i] are the
+ *          arguments, all NUL terminated. They stay valid until the next '%'.
+ */
+int kcd_parse_char(KCD_PARSER_T *p, char c)
+{
+    /* arrow keys arrive as ESC [ A / ESC [ B, in or outside a command */
+    if (c == KCD_CH_ESC) {
+        p->esc = 1;
+        return KCD_PARSE_IGNORED;
+    }
+    if (p->esc == 1) {
+        p->esc = c == '[' ? 2 : 0;
+        return KCD_PARSE_IGNORED;
+    }
+    if (p->esc == 2) {
+        p->esc = 0;
+        if (c == 'A') {
+            return KCD_PARSE_HIST_UP;
+        }
+        return c == 'B' ? KCD_PARSE_HIST_DN : KCD_PARSE_IGNORED;
+    }
+
+    if (p->state == KCD_PS_IDLE) {
+        if (c != '%') {
+            return KCD_PARSE_IGNORED;
+        }
+        kcd_parse_reset(p);
+        p->state = KCD_PS_CMD;
+        return KCD_PARSE_ADDED;
+    }
+
+    if (c == KCD_CH_KILL) {
+        kcd_parse_reset(p);
+        return KCD_PARSE_KILLED;
+    }
+
+    if (c == '\r' || c == '\n') {
+        int ret = KCD_PARSE_DONE;
+
+        if (p->state == KCD_PS_CMD) {
+            p->cmd_len = p->len;
+        }
+        if (p->state == KCD_PS_SKIP || p->cmd_len == 0) {
+            ret = KCD_PARSE_ERROR;
+        }
+        p->line[p->len] = '\0';
+        p->state = KCD_PS_IDLE;
+        return ret;
+    }
+
+    if (p->state == KCD_PS_SKIP) {
+        return KCD_PARSE_IGNORED;
+    }
+
+    if (c == KCD_CH_BS || c == KCD_CH_DEL) {
+        return kcd_parse_erase(p);
+    }
+
+    if (c == KCD_CH_TAB) {
+        return p->state == KCD_PS_CMD ? KCD_PARSE_TAB : KCD_PARSE_IGNORED;
+    }
+
+    if (c == ' ') {
+        if (p->state == KCD_PS_SEP || (p->state == KCD_PS_CMD && p->len == 0)) {
+            return KCD_PARSE_IGNORED;       /* runs of blanks are one separator */
+        }
+        if (p->state == KCD_PS_CMD) {
+            p->cmd_len = p->len;
+        }
+        c = '\0';
+    } else if (c < ' ' || c > '~') {
+        return KCD_PARSE_IGNORED;
+    }
+
+    if (p->len >= KCD_LINE_MAX || (p->state == KCD_PS_SEP && p->argc == KCD_MAX_ARGS)) {
+        p->state = KCD_PS_SKIP;
+        return KCD_PARSE_IGNORED;
+    }
+
+    if (c == '\0') {
+        p->state = KCD_PS_SEP;
+    } else if (p->state == KCD_PS_CMD) {
+        p->cmd_hash = KCD_HASH_STEP(p->cmd_hash, c);
+    } else if (p->state == KCD_PS_SEP) {
+        p->argv[p->argc++] = p->len;
+        p->state = KCD_PS_ARG;
+    }
+
+    p->line[p->len++] = c;
+    p->line[p->len] = '\0';
+    return KCD_PARSE_ADDED;
+}
+
+/**
+ * @brief: start a new command and type text into it, used to recall a line
+ */
+void kcd_parse_load(KCD_PARSER_T *p, const char *text)
+{
+    kcd_parse_reset(p);
+    kcd_parse_char(p, '%');
+    while (*text != '\0') {
+        kcd_parse_char(p, *text++);
+    }
+}
+
+/**
+ * @brief: remember the line that just completed, unless it repeats the last one
+ */
+void kcd_hist_add(KCD_HISTORY_T *h, const KCD_PARSER_T *p)
+{
+    U8 last = (h->head + KCD_HIST_LINES - 1) % KCD_HIST_LINES;
+    char *dst = h->line[h->head];
+    U8 i;
+
+    h->pos = 0;
+    for (i = 0; i < p->len; i++) {
+        dst[i] = p->line[i] == '\0' ? ' ' : p->line[i];
+    }
+    dst[i] = '\0';
+
+    if (h->count > 0) {
+        const char *a = h->line[last];
+        const char *b = dst;
+        while (*a != '\0' && *a == *b) {
+            a++;
+            b++;
+        }
+        if (*a == *b) {
+            return;     /* same as the previous line */
+        }
+    }
+
+    h->head = (h->head + 1) % KCD_HIST_LINES;
+    if (h->count < KCD_HIST_LINES) {
+        h->count++;
+    }
+}
+
+/**
+ * @brief: move through the history
+ * @param: older, 1 for the up arrow, 0 for the down arrow
+ * @return: the line to show, "" when back past the newest line,
+ *          NULL if there is nothing further in that direction
+ */
+const char *kcd_hist_step(KCD_HISTORY_T *h, int older)
+{
+    if (older) {
+        if (h->pos >= h->count) {
+            return NULL;
+        }
+        h->pos++;
+    } else {
+        if (h->pos == 0) {
+            return NULL;
+        }
+        h->pos--;
+        if (h->pos == 0) {
+            return "";
+        }
+    }
+    return h->line[(h->head + KCD_HIST_LINES - h->pos) % KCD_HIST_LINES];
+}
@@ -0,0 +1,74 @@
+/**
+ * @file:   kcd_parse.h
+ * @brief:  incremental command line parser of the KCD task
+ * NOTE: kcd_parse_char is fed one KEY_IN byte at a time. Everything before a
+ *       '%' is ignored. After it the identifier and the arguments are split
+ *       while they are typed: a space is stored as '\0' and ends the current
+ *       token, so at the terminator the identifier and every argument are
+ *       already NUL terminated strings inside line and the identifier's
+ *       hash is known. Backspace/DEL removes the last character, Ctrl-U
+ *       kills the line, CR or LF ends it. The up/down arrow (ESC [ A/B)
+ *       and TAB are reported to the caller, which owns the history ring
+ *       and the command registry.
+ */
+
+#ifndef KCD_PARSE_H_
+#define KCD_PARSE_H_
+
+#include "common.h"
+
+/* ----- Definitions ----- */
+#define KCD_LINE_MAX   64   /* characters after the '%' */
+#define KCD_MAX_ARGS   8
+#define KCD_HIST_LINES 8    /* recent command lines kept for recall */
+
+/* FNV-1a, the registry in kcd_task.c hashes identifiers the same way */
+#define KCD_HASH_INIT         2166136261U
+#define KCD_HASH_STEP(h, c)   (((h) ^ (U8) (c)) * 16777619U)
+
+/* parser states */
+#define KCD_PS_IDLE    0    /* waiting for '%' */
+#define KCD_PS_CMD     1    /* reading the identifier */
+#define KCD_PS_SEP     2    /* between tokens */
+#define KCD_PS_ARG     3    /* reading an argument */
+#define KCD_PS_SKIP    4    /* line too long, waiting for the terminator */
+
+/* kcd_parse_char results, what the caller should echo or do */
+#define KCD_PARSE_IGNORED 0   /* outside a command, nothing to echo */
+#define KCD_PARSE_ADDED   1   /* the character joined the line, echo it */
+#define KCD_PARSE_ERASED  2   /* the last character was removed */
+#define KCD_PARSE_KILLED  3   /* the whole line was discarded */
+#define KCD_PARSE_DONE    4   /* a command is complete, see the parser fields */
+#define KCD_PARSE_ERROR   5   /* the terminated line was too long or empty */
+#define KCD_PARSE_HIST_UP 6   /* up arrow, recall an older line */
+#define KCD_PARSE_HIST_DN 7   /* down arrow, recall a newer line */
+#define KCD_PARSE_TAB     8   /* TAB while typing the identifier, complete it */
+
+/* ----- Types ----- */
+typedef struct kcd_parser {
+    char line[KCD_LINE_MAX + 1];  /* typed text, token separators stored as '\0' */
+    U8   len;                     /* characters in line */
+    U8   state;                   /* KCD_PS_ */
+    U8   cmd_len;                 /* identifier length, line[cmd_len] is '\0' after it */
+    U8   argc;
+    U8   argv[KCD_MAX_ARGS];      /* offsets of the arguments in line */
+    U32  cmd_hash;                /* KCD_HASH_STEP over the identifier so far */
+    U8   esc;                     /* progress through an ESC [ x sequence */
+} KCD_PARSER_T;
+
+typedef struct kcd_history {
+    char line[KCD_HIST_LINES][KCD_LINE_MAX + 1];  /* text after the '%', blanks as ' ' */
+    U8   head;                    /* slot the next line goes to, the oldest is overwritten */
+    U8   count;                   /* lines stored */
+    U8   pos;                     /* lines back from head while browsing, 0 = not browsing */
+} KCD_HISTORY_T;
+
+/* ----- Functions ----- */
+void kcd_parse_reset(KCD_PARSER_T *p);
+int  kcd_parse_char(KCD_PARSER_T *p, char c);
+void kcd_parse_load(KCD_PARSER_T *p, const char *text);     /* replace the line with text */
+
+void kcd_hist_add(KCD_HISTORY_T *h, const KCD_PARSER_T *p);
+const char *kcd_hist_step(KCD_HISTORY_T *h, int older);
+
+#endif /* ! KCD_PARSE_H_ */
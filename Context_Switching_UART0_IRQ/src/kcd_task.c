@@ -1,12 +1,226 @@
 /* The KCD Task Template File */
 #include "rtx.h"
 #include "kcd_task.h"
+#include "kcd_parse.h"
+#include "lcd_task.h"
+#include "console.h"
 #include "k_mem.h"
 #include "k_rtx.h"
+#include "printf.h"
 
+#define KCD_CYCLES_PER_MS 100000   /* CCLK is 100MHz, see system_LPC17xx.c */
+#define KCD_LINE_SIZE     96
+#define KCD_DISPLAY_TRIES 10       /* one tick apart while the display task pushes back */
 
-REGISTERED_CMD_T *registered_cmd_head = NULL; //head of linked list of registered tasks
-extern TCB g_tcbs[MAX_TASKS];
+REGISTERED_CMD_T *g_kcd_cmds = NULL; //registered commands, KCD_CMD_SLOTS entries
+
+/* kept out of the KCD user stack, the history alone is over 0x200 bytes */
+static KCD_PARSER_T g_kcd_parser;
+static KCD_HISTORY_T g_kcd_hist;
+
+/* the KCD's user stack is 0x100 bytes and its SVCs run kernel code on it,
+   so report lines and outgoing messages are kept here. The KCD sends one
+   message at a time, RTX_USER_DATA since it is unprivileged */
+static char g_kcd_line[KCD_LINE_SIZE];
+static U8 g_kcd_msg[sizeof(RTX_MSG_HDR) + KCD_LINE_SIZE] RTX_USER_DATA;
+
+/* snapshots for the %L reports, one SVC fills each, RTX_USER_DATA since
+   the KCD is unprivileged */
+static RTX_TASK_STATS g_kcd_tsk_stats[MAX_TASKS] RTX_USER_DATA;
+static RTX_MBX_STATS g_kcd_mbx_stats[MAX_TASKS] RTX_USER_DATA;
+
+/* identifiers handled by kcd_dispatch itself, offered by TAB completion too */
+static const char *const g_kcd_builtins[] = {"LT", "LC", "LM", "LD", "MT"};
+#define KCD_NUM_BUILTINS (sizeof(g_kcd_builtins) / sizeof(g_kcd_builtins[0]))
+
+/**
+ * @brief: send a null terminated string to the display task, retrying while
+ *         its mailbox is full so the echo is delayed rather than lost
+ * NOTE: at most KCD_LINE_SIZE characters are sent, the rest is cut off
+ */
+void kcd_display(char *str)
+{
+  size_t msg_hdr_size = sizeof(RTX_MSG_HDR);
+  size_t string_length = 0;
+  while(string_length < KCD_LINE_SIZE && str[string_length] != '\0')
+  {
+    string_length++;
+  }
+
+  U8 *buf = g_kcd_msg;
+  RTX_MSG_HDR *header = (void*)buf;
+  header->length = msg_hdr_size + string_length;
+  header->type = DISPLAY;
+  mem_cpy(buf + msg_hdr_size, str, string_length);
+
+  for(int i = 0; i < KCD_DISPLAY_TRIES && send_msg(TID_DISPLAY, buf) != RTX_OK; i++)
+  {
+    tsk_delay(1);
+  }
+}
+
+static const char *kcd_state_name(U8 state)
+{
+  switch(state)
+  {
+    case READY:     return "READY";
+    case RUNNING:   return "RUNNING";
+    case BLK_MEM:   return "BLK_MEM";
+    case BLK_MSG:   return "BLK_MSG";
+    case UART_INT:  return "UART_INT";
+    case BLK_DELAY: return "BLK_DLY";
+    case BLK_SEM:   return "BLK_SEM";
+    case BLK_MUT:   return "BLK_MUT";
+    case BLK_EVT:   return "BLK_EVT";
+    case NEW:       return "NEW";
+    default:        return "?";
+  }
+}
+
+/* high-water mark in percent of the stack, 0 for a task without that stack */
+static U32 kcd_stack_pct(U16 used, U16 size)
+{
+  return size ? (U32)used * 100 / size : 0;
+}
+
+/**
+ * @brief: %LT, one row per task from a single tsk_stats snapshot
+ */
+void kcd_list_tasks(void)
+{
+  RTX_TASK_STATS *stats = g_kcd_tsk_stats;
+  char *line = g_kcd_line;
+  U64 total_cycles = 0;
+
+  int num_tasks = tsk_stats(stats, MAX_TASKS);
+  if(num_tasks <= 0)
+  {
+    kcd_display("LT: no tasks\r\n");
+    return;
+  }
+
+  for(int i = 0; i < num_tasks; i++)
+  {
+    total_cycles += stats[i].run_cycles;
+  }
+
+  kcd_display("TID    STATE PRIO  CPU%  USTK HW       KSTK HW\r\n");
+  for(int i = 0; i < num_tasks; i++)
+  {
+    U32 permille = total_cycles ? (U32)(stats[i].run_cycles * 1000 / total_cycles) : 0;
+    sprintf(line, "%3d %8s %4d %3d.%d %5u %3u%% %5u %3u%%\r\n",
+            stats[i].tid, kcd_state_name(stats[i].state), stats[i].prio, permille / 10, permille % 10,
+            stats[i].u_stack_used, kcd_stack_pct(stats[i].u_stack_used, stats[i].u_stack_size),
+            stats[i].k_stack_used, kcd_stack_pct(stats[i].k_stack_used, stats[i].k_stack_size));
+    kcd_display(line);
+  }
+  if(num_tasks == MAX_TASKS)
+  {
+    kcd_display("(first MAX_TASKS tasks only)\r\n");
+  }
+}
+
+/**
+ * @brief: %LM, one row per mailbox from a single mbx_stats snapshot
+ */
+void kcd_list_mailboxes(void)
+{
+  RTX_MBX_STATS *stats = g_kcd_mbx_stats;
+  char *line = g_kcd_line;
+
+  int num_mbx = mbx_stats(stats, MAX_TASKS);
+  if(num_mbx <= 0)
+  {
+    kcd_display("LM: no mailboxes\r\n");
+    return;
+  }
+
+  kcd_display("TID CAPACITY   USED  FULL%  MSGS WAITERS\r\n");
+  for(int i = 0; i < num_mbx; i++)
+  {
+    U32 pct = stats[i].capacity ? stats[i].used * 100 / stats[i].capacity : 0;
+    sprintf(line, "%3d %8u %6u %5u%% %5u %7u\r\n",
+            stats[i].tid, stats[i].capacity, stats[i].used, pct,
+            stats[i].num_msgs, stats[i].num_waiters);
+    kcd_display(line);
+  }
+}
+
+/**
+ * @brief: %LD, display task counters and one row per console channel
+ */
+void kcd_list_display(void)
+{
+  DISPLAY_STATS_T st = g_display_stats;
+  CON_INFO_T info;
+  char *line = g_kcd_line;
+
+  sprintf(line, "msgs %u bytes %u stalls %u dropped %u bytes %u msgs\r\n",
+          st.msgs_out, st.bytes_out, st.stalls, st.bytes_dropped, st.msgs_dropped);
+  kcd_display(line);
+  kcd_display("CH OWNER PRIO PENDING  BYTES_OUT DROPPED TAG\r\n");
+  for(int ch = 0; ch < CON_CHANNELS; ch++)
+  {
+    if(con_info(ch, &info) != RTX_OK)
+    {
+      continue;
+    }
+    sprintf(line, "%2d %5d %4d %7u %10u %7u %s\r\n",
+            ch, info.owner, info.prio, info.pending, info.bytes_out, info.bytes_dropped, info.tag);
+    kcd_display(line);
+  }
+}
+
+/**
+ * @brief: %MT, drain the allocator trace over UART1 for host/mem_replay.c
+ */
+void kcd_mem_trace(void)
+{
+  char *line = g_kcd_line;
+
+  int num_recs = mem_trace_dump();
+  if(num_recs < 0)
+  {
+    kcd_display("MT: kernel built without MEM_TRACE\r\n");
+    return;
+  }
+  sprintf(line, "MT: %d records on UART1\r\n", num_recs);
+  kcd_display(line);
+}
+
+/**
+ * @brief: %LC, render per-task CPU usage from a single tsk_stats snapshot
+ */
+void kcd_list_cpu(void)
+{
+  RTX_TASK_STATS *stats = g_kcd_tsk_stats;
+  char *line = g_kcd_line;
+  U64 total_cycles = 0;
+
+  int num_tasks = tsk_stats(stats, MAX_TASKS);
+  if(num_tasks <= 0)
+  {
+    kcd_display("LC: no task statistics\r\n");
+    return;
+  }
+
+  for(int i = 0; i < num_tasks; i++)
+  {
+    total_cycles += stats[i].run_cycles;
+  }
+
+  kcd_display("TID PRIO STATE  CPU%  SWITCH    VOL  INVOL  BLK_MS  USTK/ SIZE KSTK/ SIZE\r\n");
+  for(int i = 0; i < num_tasks; i++)
+  {
+    U32 permille = total_cycles ? (U32)(stats[i].run_cycles * 1000 / total_cycles) : 0;
+    sprintf(line, "%3d %4d %5d %3d.%d %7u %6u %6u %7u %5u/%5u %4u/%5u\r\n",
+            stats[i].tid, stats[i].prio, stats[i].state, permille / 10, permille % 10,
+            stats[i].num_switches, stats[i].num_vol, stats[i].num_invol,
+            (U32)(stats[i].blk_cycles / KCD_CYCLES_PER_MS),
+            stats[i].u_stack_used, stats[i].u_stack_size, stats[i].k_stack_used, stats[i].k_stack_size);
+    kcd_display(line);
+  }
+}
 
 int str_cmp(const char *str1, const char *str2)
 {
@@ -20,157 +234,351 @@ int str_cmp(const char *str1, const char *str2)
     } while (s1 == s2);
     return (s1 != s2) ? -1 : 0;
 }
-void push_cmd(REGISTERED_CMD_T **registered_cmd_head, REGISTERED_CMD_T *new_cmd)
-{
-	if(registered_cmd_head == NULL)
-	{
-		*registered_cmd_head = new_cmd;
-		return;
-	}
-	
-	REGISTERED_CMD_T *existing_cmd = get_cmd(*registered_cmd_head, new_cmd -> cmd);
-	if(existing_cmd != NULL)
-	{
-		existing_cmd -> handler_tid = new_cmd -> handler_tid;
-	}
-	else
-	{
-		REGISTERED_CMD_T *tmp = *registered_cmd_head;
-		while(tmp -> next != NULL)
-		{
-			tmp = tmp -> next;
-		}
-		
-		tmp -> next = new_cmd;
-		new_cmd -> next = NULL;
-	}		
-}
-
-REGISTERED_CMD_T *get_cmd(REGISTERED_CMD_T *registered_cmd_head, char *cmd)
-{
-	REGISTERED_CMD_T *tmp = registered_cmd_head;
-	while(tmp != NULL)
-	{
-		if(str_cmp(tmp -> cmd, cmd) == 0)
-		{
-			return tmp;
-		}
-	}
-	
-	return NULL;
+/* FNV-1a over the identifier, the table index is the low bits */
+static U32 kcd_cmd_hash(const char *cmd, U32 len)
+{
+  U32 h = KCD_HASH_INIT;
+  for(U32 i = 0; i < len; i++)
+  {
+    h = KCD_HASH_STEP(h, cmd[i]);
+  }
+  return h;
+}
+
+static int kcd_cmd_equal(const REGISTERED_CMD_T *entry, const char *cmd, U32 len)
+{
+  for(U32 i = 0; i < len; i++)
+  {
+    if(entry->cmd[i] != cmd[i])
+    {
+      return 0;
+    }
+  }
+  return entry->cmd[len] == '\0';
+}
+
+/**
+ * @brief: slot holding cmd, or the free slot where it would go (linear probing)
+ * @return: NULL if cmd is not in the table and the table is full
+ */
+static REGISTERED_CMD_T *kcd_cmd_slot(REGISTERED_CMD_T *table, const char *cmd, U32 len, U32 hash)
+{
+  U32 idx = hash & (KCD_CMD_SLOTS - 1);
+
+  for(int n = 0; n < KCD_CMD_SLOTS; n++)
+  {
+    REGISTERED_CMD_T *entry = &table[idx];
+    if(entry->cmd[0] == '\0' || kcd_cmd_equal(entry, cmd, len))
+    {
+      return entry;
+    }
+    idx = (idx + 1) & (KCD_CMD_SLOTS - 1);
+  }
+  return NULL;
+}
+
+/**
+ * @brief: register cmd[0..len) for tid, a second registration replaces the handler
+ * @return: RTX_OK, RTX_ERR if the identifier is empty, too long or the table is full
+ */
+int kcd_cmd_register(REGISTERED_CMD_T *table, const char *cmd, U32 len, task_t tid)
+{
+  REGISTERED_CMD_T *entry;
+
+  if(len == 0 || len > KCD_CMD_MAX_LEN)
+  {
+    return RTX_ERR;
+  }
+
+  entry = kcd_cmd_slot(table, cmd, len, kcd_cmd_hash(cmd, len));
+  if(entry == NULL)
+  {
+    return RTX_ERR;
+  }
+
+  if(entry->cmd[0] == '\0')
+  {
+    mem_cpy(entry->cmd, (void *)cmd, len);
+    entry->cmd[len] = '\0';
+  }
+  entry->handler_tid = tid;
+  return RTX_OK;
+}
+
+/**
+ * @brief: look up cmd[0..len), cmd does not need to be NUL terminated
+ * @param: hash, KCD_HASH_STEP over cmd, the parser has it when the line ends
+ * @return: the registered entry, NULL if there is none
+ */
+REGISTERED_CMD_T *kcd_cmd_find(REGISTERED_CMD_T *table, const char *cmd, U32 len, U32 hash)
+{
+  REGISTERED_CMD_T *entry;
+
+  if(len == 0 || len > KCD_CMD_MAX_LEN)
+  {
+    return NULL;
+  }
+
+  entry = kcd_cmd_slot(table, cmd, len, hash);
+  return (entry != NULL && entry->cmd[0] != '\0') ? entry : NULL;
+}
+
+/**
+ * @brief: forward a parsed command line to its registered handler as KCD_CMD,
+ *         the identifier and arguments joined by single spaces
+ */
+static void kcd_forward(REGISTERED_CMD_T *cmd, KCD_PARSER_T *p)
+{
+  size_t msg_hdr_size = sizeof(RTX_MSG_HDR);
+  U8 *buf = g_kcd_msg;
+  RTX_MSG_HDR *header = (void*)buf;
+  char *text = (char *)buf + msg_hdr_size;
+
+  mem_cpy(text, p->line, p->len);
+  for(int i = 0; i < p->len; i++)
+  {
+    if(text[i] == '\0')
+    {
+      text[i] = ' ';
+    }
+  }
+  header->length = msg_hdr_size + p->len;
+  header->type = KCD_CMD;
+  send_msg(cmd->handler_tid, buf);
+}
+
+/**
+ * @brief: replace the line being typed with a recalled one and redraw it
+ * @param: text, history line, NULL if the arrow had nowhere to go
+ */
+static void kcd_recall(KCD_PARSER_T *p, const char *text)
+{
+  char *buf = g_kcd_line;
+
+  if(text == NULL)
+  {
+    kcd_display("\a");
+    return;
+  }
+
+  kcd_parse_load(p, text);
+  sprintf(buf, "\r\033[K%%%s", text);
+  kcd_display(buf);
+}
+
+/* length of the common prefix of the candidate so far and cand, stops at limit */
+static U32 kcd_common_len(const char *best, const char *cand, U32 limit)
+{
+  U32 n = 0;
+  while(n < limit && best[n] != '\0' && best[n] == cand[n])
+  {
+    n++;
+  }
+  return n;
+}
+
+static int kcd_has_prefix(const char *cand, const KCD_PARSER_T *p)
+{
+  for(U32 i = 0; i < p->len; i++)
+  {
+    if(cand[i] != p->line[i])
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * @brief: TAB, complete the identifier against the built-ins and the registry.
+ *         A single match is completed with a trailing space, several are
+ *         extended to their common prefix and listed when nothing was added.
+ */
+static void kcd_complete(KCD_PARSER_T *p)
+{
+  const char *best = NULL;
+  U32 best_len = 0;
+  int matches = 0;
+  char *buf = g_kcd_line;
+  U32 n = 0;
+
+  for(U32 i = 0; i < KCD_NUM_BUILTINS + KCD_CMD_SLOTS; i++)
+  {
+    const char *cand = i < KCD_NUM_BUILTINS ? g_kcd_builtins[i] : g_kcd_cmds[i - KCD_NUM_BUILTINS].cmd;
+    if(cand[0] == '\0' || !kcd_has_prefix(cand, p))
+    {
+      continue;
+    }
+    if(matches++ == 0)
+    {
+      best = cand;
+      for(best_len = 0; cand[best_len] != '\0'; best_len++);
+    }
+    else
+    {
+      best_len = kcd_common_len(best, cand, best_len);
+    }
+  }
+
+  if(matches == 0)
+  {
+    kcd_display("\a");
+    return;
+  }
+
+  /* type the completion through the parser so its hash and state follow */
+  for(U32 i = p->len; i < best_len; i++)
+  {
+    if(kcd_parse_char(p, best[i]) == KCD_PARSE_ADDED)
+    {
+      buf[n++] = best[i];
+    }
+  }
+  if(matches == 1 && kcd_parse_char(p, ' ') == KCD_PARSE_ADDED)
+  {
+    buf[n++] = ' ';
+  }
+
+  if(n > 0)
+  {
+    buf[n] = '\0';
+    kcd_display(buf);
+    return;
+  }
+
+  /* ambiguous and nothing more in common, list the candidates under the line */
+  kcd_display("\r\n");
+  for(U32 i = 0; i < KCD_NUM_BUILTINS + KCD_CMD_SLOTS; i++)
+  {
+    const char *cand = i < KCD_NUM_BUILTINS ? g_kcd_builtins[i] : g_kcd_cmds[i - KCD_NUM_BUILTINS].cmd;
+    if(cand[0] != '\0' && kcd_has_prefix(cand, p))
+    {
+      sprintf(buf, "%%%s  ", cand);
+      kcd_display(buf);
+    }
+  }
+  mem_cpy(buf + 3, p->line, p->len);
+  buf[0] = '\r';
+  buf[1] = '\n';
+  buf[2] = '%';
+  buf[p->len + 3] = '\0';
+  kcd_display(buf);
+}
+
+/**
+ * @brief: run a complete command, the identifier is matched once by its hash
+ */
+static void kcd_dispatch(KCD_PARSER_T *p)
+{
+  REGISTERED_CMD_T *cmd;
+
+  if(str_cmp(p->line, "LT") == 0)
+  {
+    kcd_list_tasks();
+  }
+  else if(str_cmp(p->line, "LC") == 0)
+  {
+    kcd_list_cpu();
+  }
+  else if(str_cmp(p->line, "LM") == 0)
+  {
+    kcd_list_mailboxes();
+  }
+  else if(str_cmp(p->line, "LD") == 0)
+  {
+    kcd_list_display();
+  }
+  else if(str_cmp(p->line, "MT") == 0)
+  {
+    kcd_mem_trace();
+  }
+  else if((cmd = kcd_cmd_find(g_kcd_cmds, p->line, p->cmd_len, p->cmd_hash)) != NULL)
+  {
+    kcd_forward(cmd, p);
+  }
+  else
+  {
+    kcd_display("Command cannot be processed.\r\n");
+  }
 }
 
 void kcd_task(void)
 {
   mbx_create(128); //TODO: Determine whether this is an appropriate size
   task_t sender_tid;
-  int command_specifier = 0;
-  char current_command[64];
-  int command_index = 0;
+  KCD_PARSER_T *parser = &g_kcd_parser;
+  char echo[2] = {0, 0};
   size_t msg_hdr_size = sizeof(RTX_MSG_HDR);
+
+  /* the whole registry in one block, registrations never allocate */
+  g_kcd_cmds = (REGISTERED_CMD_T *)mem_alloc(KCD_CMD_SLOTS * sizeof(REGISTERED_CMD_T));
+  if(g_kcd_cmds == NULL)
+  {
+    tsk_exit();
+  }
+  for(int i = 0; i < KCD_CMD_SLOTS; i++)
+  {
+    g_kcd_cmds[i].cmd[0] = '\0';
+  }
+  kcd_parse_reset(parser);
+  g_kcd_hist.head = 0;
+  g_kcd_hist.count = 0;
+  g_kcd_hist.pos = 0;
   
   while(1)
   {
-    U8 temp_buffer[msg_hdr_size + 3]; //ASSUMPTION: No cmd will be longer than 3 chars? (for KCD_REG)
+    U8 temp_buffer[msg_hdr_size + KCD_CMD_MAX_LEN];
     
-    if(recv_msg(&sender_tid, &temp_buffer , msg_hdr_size + 3) == 0)
+    if(recv_msg(&sender_tid, &temp_buffer , msg_hdr_size + KCD_CMD_MAX_LEN) == 0)
     {
+      RTX_MSG_HDR *msg = (void *)temp_buffer;
+
       /* Check the message type */
       
       //KCD_REG
-      if((U32)temp_buffer[4] == KCD_REG)
+      if(msg->type == KCD_REG)
       {
-        REGISTERED_CMD_T *new_cmd =(REGISTERED_CMD_T *)mem_alloc(sizeof(REGISTERED_CMD_T));
-        new_cmd -> handler_tid = sender_tid;
-        U32 string_length = ((U32)temp_buffer[0]) - msg_hdr_size;
-        new_cmd -> cmd = (char *)mem_alloc(sizeof(string_length));
-        mem_cpy(new_cmd -> cmd, temp_buffer + msg_hdr_size, string_length);
-        push_cmd(&registered_cmd_head, new_cmd);
+        U32 string_length = msg->length - msg_hdr_size;
+        kcd_cmd_register(g_kcd_cmds, (char *)temp_buffer + msg_hdr_size, string_length, sender_tid);
       }
 
-      //KEY_IN
-      else if((U32)temp_buffer[4] == KEY_IN)
+      //KEY_IN, one character per message, echoed as it is parsed
+      else if(msg->type == KEY_IN)
       {
-        if(command_specifier) //check if '%' was typed already
+        char c = temp_buffer[msg_hdr_size];
+
+        switch(kcd_parse_char(parser, c))
         {
-          current_command[command_index] = temp_buffer[msg_hdr_size]; //add typed char to current cmd string
-        
-          if(current_command[command_index] == '\n')
-          {
-              if(str_cmp(current_command, "LT") == 0)
-              {														
-                //1. echo command
-                char *message = "LT"; 
-                U8 buf[msg_hdr_size + 3];
-                RTX_MSG_HDR *header = (void*)buf;
-                header->length = msg_hdr_size + 3;
-                header->type = DISPLAY;
-                mem_cpy(buf + msg_hdr_size, message, 3);
-
-                send_msg((g_tcbs[TID_DISPLAY]).tid, buf);
-
-                //2. Send list of tids to LCD task
-                task_t tids[MAX_TASKS];
-                int num_tasks = tsk_ls(tids, MAX_TASKS);
-              }
-              else if(str_cmp(current_command, "LM") == 0)
-              {
-                //1. echo command
-                char *message = "LM"; 
-                U8 buf[msg_hdr_size + 3];
-                RTX_MSG_HDR *header = (void*)buf;
-                header->length = msg_hdr_size + 3;
-                header->type = DISPLAY;
-                mem_cpy(buf + msg_hdr_size, message, 3);
-
-                send_msg((g_tcbs[TID_DISPLAY]).tid, buf);
-
-                //2. Send list of tids to LCD task
-                task_t tids[MAX_TASKS];
-                int num_tasks = mbx_ls(tids, MAX_TASKS);
-              }
-              
-              REGISTERED_CMD_T *cmd = get_cmd(registered_cmd_head, current_command);
-              if(cmd != NULL) /* Registered command */
-              {
-                //1. Echo command
-                size_t string_length = command_index + 1;
-                U8 buf[msg_hdr_size + string_length];
-                RTX_MSG_HDR *header = (void*)buf;
-                header->length = msg_hdr_size + string_length;
-                header->type = DISPLAY;
-                mem_cpy(buf + msg_hdr_size, current_command, string_length);
-
-                send_msg((g_tcbs[TID_DISPLAY]).tid, buf);
-                
-                //2. Send to mailbox of registered task
-                header->type = KCD_CMD;
-                send_msg((g_tcbs[cmd->handler_tid]).tid, buf);
-              }
-              else /* unregistered command */
-              {
-                //Display error message in terminal
-                char *message = "Command cannot be processed."; 
-                size_t string_length = 29; //28 chars + new line
-                U8 buf[msg_hdr_size + string_length];
-                RTX_MSG_HDR *header = (void*)buf;
-                header->length = msg_hdr_size + string_length;
-                header->type = DISPLAY;
-                mem_cpy(buf + msg_hdr_size, current_command, string_length);
-                
-                send_msg((g_tcbs[TID_DISPLAY]).tid, buf);
-              }
-            }
-          }
-          else if(current_command[command_index] == '%')
-          {
-            command_index = 0; //reset command index if % was typed
-            command_specifier = 1;
-          }
-          else //wait for next character, cmd is not finished
-          {
-            command_index++;
-          }
+          case KCD_PARSE_ADDED:
+            echo[0] = c;
+            kcd_display(echo);
+            break;
+          case KCD_PARSE_ERASED:
+            kcd_display("\b \b");
+            break;
+          case KCD_PARSE_KILLED:
+            kcd_display("^U\r\n");
+            break;
+          case KCD_PARSE_DONE:
+            kcd_display("\r\n");
+            kcd_hist_add(&g_kcd_hist, parser);
+            kcd_dispatch(parser);
+            break;
+          case KCD_PARSE_ERROR:
+            kcd_display("\r\nCommand cannot be processed.\r\n");
+            break;
+          case KCD_PARSE_HIST_UP:
+            kcd_recall(parser, kcd_hist_step(&g_kcd_hist, 1));
+            break;
+          case KCD_PARSE_HIST_DN:
+            kcd_recall(parser, kcd_hist_step(&g_kcd_hist, 0));
+            break;
+          case KCD_PARSE_TAB:
+            kcd_complete(parser);
+            break;
+          default:
+            break;
+        }
       }
     }
   }
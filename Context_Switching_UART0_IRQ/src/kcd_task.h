@@ -2,15 +2,17 @@
 #define KCD_TASK_H_
 #include "rtx.h"
 
+/* command registry, an open-addressing hash table allocated once by kcd_task */
+#define KCD_CMD_MAX_LEN 15    /* longest command identifier, without the '%' */
+#define KCD_CMD_SLOTS   64    /* table size and command limit, a power of two */
+
 typedef struct registered_command {
-	char *cmd;
+	char cmd[KCD_CMD_MAX_LEN + 1];  /* NUL terminated, cmd[0] == '\0' in a free slot */
 	task_t handler_tid;
-	struct registered_command *next;
-}REGISTERED_CMD_T;
+} REGISTERED_CMD_T;
 
-void push_cmd(REGISTERED_CMD_T **registered_cmd_head, REGISTERED_CMD_T *new_cmd);
-//REGISTERED_CMD_T *pop_cmd(REGISTERED_CMD_T **registered_cmd_head);
-REGISTERED_CMD_T *get_cmd(REGISTERED_CMD_T *registered_cmd_head, char *cmd);
+int kcd_cmd_register(REGISTERED_CMD_T *table, const char *cmd, U32 len, task_t tid);
+REGISTERED_CMD_T *kcd_cmd_find(REGISTERED_CMD_T *table, const char *cmd, U32 len, U32 hash);
 
 int str_cmp(const char *str1, const char *str2);
 
@@ -1,34 +1,82 @@
-/* The LCD Display Task Template File */
+/**
+ * @file:   lcd_task.c
+ * @brief:  display task, copies DISPLAY messages into the console channels
+ * NOTE: A task's text goes to the channel it opened with CON_OPEN, or to the
+ *       default channel. The channel ring (console.c) is the batch: messages
+ *       are appended back to back while the transmitter runs and the THRE
+ *       interrupt drains them a FIFO at a time, so a burst goes out as one
+ *       stream.
+ *       When a ring is full the task stops receiving until it drains. Its
+ *       mailbox then fills and send_msg to the display task fails, which is
+ *       the back-pressure senders see. A message that still does not fit
+ *       after DISPLAY_STALL_TICKS is cut short and counted as dropped.
+ */
 
 #include "rtx.h"
-#include "uart_irq.h"
-#include "k_mem.h"
-#include <LPC17xx.h>
+#include "lcd_task.h"
+#include "console.h"
 
-extern U8 UART_buffer[128];
+DISPLAY_STATS_T g_display_stats;
+
+/* one message, static because this task runs on its kernel stack */
+static U8 g_display_msg[sizeof(RTX_MSG_HDR) + DISPLAY_MSG_MAX];
 
 void lcd_task(void)
 {
-    mbx_create(128); //TODO: Determine whether this is an appropriate size
     task_t sender_tid;
+    RTX_MSG_HDR *hdr = (void *)g_display_msg;
+
+    mbx_create(DISPLAY_MBX_SIZE);
 
     while(1)
     {
-			U8 temp_buffer[sizeof(RTX_MSG_HDR) + 32]; //TODO: is 32 bytes for msg big enough?
-        //copy contents to internal kernel buffer so UART can transmit
-        if(recv_msg(&sender_tid, &temp_buffer , 64) == 0)
+        if(recv_msg(&sender_tid, g_display_msg, sizeof(g_display_msg)) != RTX_OK)
+        {
+            g_display_stats.msgs_dropped++;     /* too long, the kernel discarded it */
+            continue;
+        }
+
+        U8 *text = g_display_msg + sizeof(RTX_MSG_HDR);
+        U32 len = hdr->length - sizeof(RTX_MSG_HDR);
+
+        if(hdr->type == CON_OPEN)
+        {
+            con_open(sender_tid, text[0], (char *)text + 1, len - 1);
+            continue;
+        }
+        if(hdr->type == CON_CLOSE)
         {
-            
-            if((U32)temp_buffer[4] == DISPLAY)
+            con_close(sender_tid);
+            continue;
+        }
+        if(hdr->type != DISPLAY)
+        {
+            g_display_stats.msgs_dropped++;
+            continue;
+        }
+
+        int ch = con_find(sender_tid);
+
+        g_display_stats.msgs_out++;
+        while(len > 0)
+        {
+            U32 n = con_put(ch, text, len);
+            text += n;
+            len -= n;
+            g_display_stats.bytes_out += n;
+            if(len == 0)
+            {
+                break;
+            }
+
+            /* ring full, wait for the transmitter instead of receiving more */
+            g_display_stats.stalls++;
+            if(evt_wait(EVT_UART0_TX_SPACE, EVT_ANY, DISPLAY_STALL_TICKS, NULL) != RTX_OK)
             {
-                //copy contents of buffer to internal kernel buffer for UART
-                mem_cpy(UART_buffer, &temp_buffer, (U32)temp_buffer);
-
-                //Enable UART Transmit interrupt
-                LPC_UART_TypeDef * pUart = (LPC_UART_TypeDef *) LPC_UART0;
-                pUart->IER ^= IER_THRE; //toggling THR
-    
-            }            
+                g_display_stats.bytes_dropped += len;
+                con_dropped(ch, len);
+                break;
+            }
         }
     }
 }
@@ -0,0 +1,20 @@
+#ifndef LCD_TASK_H_
+#define LCD_TASK_H_
+#include "rtx.h"
+
+#define DISPLAY_MBX_SIZE    0x200   /* mailbox of the display task */
+#define DISPLAY_MSG_MAX     0x80    /* longest DISPLAY text, longer messages are dropped */
+#define DISPLAY_STALL_TICKS 100     /* wait for ring space before dropping the rest */
+
+/* display task counters, written by the display task only */
+typedef struct display_stats {
+    U32 msgs_out;        /* DISPLAY messages queued for UART0 */
+    U32 bytes_out;       /* bytes queued for UART0 */
+    U32 bytes_dropped;   /* bytes of messages cut short by a stalled UART */
+    U32 msgs_dropped;    /* messages too long for DISPLAY_MSG_MAX or not DISPLAY */
+    U32 stalls;          /* times the transmit ring was full */
+} DISPLAY_STATS_T;
+
+extern DISPLAY_STATS_T g_display_stats;
+
+#endif /* LCD_TASK_H_ */
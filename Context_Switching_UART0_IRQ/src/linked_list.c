@@ -8,62 +8,6 @@
 #include "printf.h"
 #endif /* ! DEBUG_PRIO_Q */
 
-/**
- * Free TID Linked List
- */
-
-void push_tid(INT_LL_NODE_T **free_tid_head, INT_LL_NODE_T *new_tid) {
-    new_tid->next = *free_tid_head;
-    *free_tid_head = new_tid;
-}
-
-INT_LL_NODE_T *pop_tid(INT_LL_NODE_T **free_tid_head) {
-    if (*free_tid_head == NULL) {
-        return NULL;
-    }
-
-    INT_LL_NODE_T *temp_prev = NULL;
-    INT_LL_NODE_T *temp = *free_tid_head;
-    while ((*temp)->next != NULL) {
-        temp_prev = temp;
-        temp = temp->next;
-    }
-
-    if (temp_prev != NULL) {
-        temp_prev->next = NULL;
-    }
-
-    INT_LL_NODE_T *popped = *temp;
-    *free_tid_head = (*free_tid_head)->next;
-    return popped;
-}
-
-void print_free_tids(INT_LL_NODE_T *free_tid_head) {
-#ifdef DEBUG_TID_LL
-    printf("****************\n");
-    printf("Free TID List\n");
-
-    INT_LL_NODE_T *temp = free_tid_head;
-    while(temp != NULL) {
-        printf("%d\n", temp->tid);
-        temp = temp->next;
-    }
-    printf("****************\n");
-#endif /* DEBUG_TID_LL */
-}
-
-int tid_is_available(INT_LL_NODE_T *free_tid_head, int tid) {
-    INT_LL_NODE_T *temp = free_tid_head;
-    while(temp != NULL) {
-        if (temp->tid == tid) {
-            return 1;
-        }
-        temp = temp->next;
-    }
-
-    return 0;
-}
-
 /**
  * PRIORITY QUEUE
  */
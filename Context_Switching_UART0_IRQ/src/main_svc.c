@@ -8,7 +8,7 @@
  *       taken from http://www.sparetimelabs.com/tinyprintf/tinyprintf.php
  *       is configured to use UART0 to output when DEBUG_0 is defined.
  *       Check target option->C/C++ to see the DEBUG_0 definition.
- *       Note that init_printf(NULL, putc) must be called to initialize 
+ *       Note that init_printf(NULL, uart1_putc) must be called to initialize 
  *       the printf function.
  * IMPORTANT: This file will be replaced by another file in automted testing.
  */
@@ -17,6 +17,12 @@
 #include "rtx.h"
 #include "priv_tasks.h"
 #include "uart_polling.h"
+#ifdef STATIC_TASKS
+#include "k_task_def.h"
+#endif /* STATIC_TASKS */
+#ifdef SVC_BENCH
+#include "svc_bench.h"
+#endif /* SVC_BENCH */
 #ifdef DEBUG_0
 #include "printf.h"
 #endif /* DEBUG_0 */
@@ -31,6 +37,12 @@ extern void lcd_task(void);
 extern void kcd_task(void);
 extern void null_task(void);
 
+#ifdef STATIC_TASKS
+/* display and KCD tasks are part of the image, rtx_init only adds the two priv tasks */
+RTX_TASK_DEFINE_PRIV(g_lcd_task_def, lcd_task, HIGH, KERN_STACK_SIZE);
+RTX_TASK_DEFINE_USR(g_kcd_task_def, kcd_task, HIGH, 0x100, KERN_STACK_SIZE);
+#endif /* STATIC_TASKS */
+
 int set_fixed_tasks(RTX_TASK_INFO *tasks, int num_tasks){
 
     if (num_tasks !=3) {
@@ -39,16 +51,19 @@ int set_fixed_tasks(RTX_TASK_INFO *tasks, int num_tasks){
     
     tasks[0].ptask = &lcd_task;
     tasks[0].u_stack_size = 0x0;
+    tasks[0].k_stack_size = 0x0;    /* privileged, runs on KERN_STACK_SIZE */
     tasks[0].prio = HIGH;
     tasks[0].priv = 1;
     
     tasks[1].ptask = &kcd_task;
     tasks[1].u_stack_size = 0x100;
+    tasks[1].k_stack_size = 0x0;    /* IRQs run here, check k_stack_used in %LC before shrinking */
     tasks[1].prio = HIGH;
     tasks[1].priv = 0;
     
     tasks[2].ptask = &null_task;
     tasks[2].u_stack_size = 0x100;
+    tasks[2].k_stack_size = 0x0;
     tasks[2].prio = PRIO_NULL;
     tasks[2].priv = 0;
 
@@ -63,7 +78,7 @@ int main()
     __disable_irq();
     uart_init(1);  /* uart1 uses polling for output */
 #ifdef DEBUG_0
-    init_printf(NULL, putc);
+    init_printf(NULL, uart1_putc);
 #endif /* DEBUG_0 */
     __enable_irq();
 #ifdef DEBUG_0
@@ -74,10 +89,18 @@ int main()
     printf("Read PSP = 0x%x\r\n", __get_PSP());
 #endif /*DEBUG_0*/    
     /* sets task information */
+#ifdef SVC_BENCH
+    svc_bench_task_info(task_info, 2);
+#else
     set_task_info(task_info, 2);
+#endif /* SVC_BENCH */
+#ifdef STATIC_TASKS
+    rtx_init(32, FIRST_FIT, task_info, 2);
+#else
     set_fixed_tasks(task_info + 2, 3);  /* kcd, lcd, null tasks */
     /* start the RTX and built-in tasks */
     rtx_init(32, FIRST_FIT, task_info, 5); 
+#endif /* STATIC_TASKS */
     /* We should never reach here!!! */
     return RTX_ERR;  
 }
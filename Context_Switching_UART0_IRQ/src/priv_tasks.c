@@ -22,6 +22,7 @@
 void set_task_info(RTX_TASK_INFO *tasks, int num_tasks) {
     for (int i = 0; i < num_tasks; i++ ) {
         tasks[i].u_stack_size = 0x0;
+        tasks[i].k_stack_size = 0x0;    /* KERN_STACK_SIZE */
         tasks[i].prio = HIGH;
         tasks[i].priv = 1;
     }
@@ -8,73 +8,63 @@
 
 /*----- Includes -----*/
 #include "common.h"
+#include "common_ext.h"
 
-#define __SVC_0  __svc_indirect(0)
+/* Every call is a numbered SVC (see common_ext.h) with its arguments in
+   R0-R3, so at most four arguments. SVC_Handler dispatches through the
+   kernel's g_svc_table, user code never sees a kernel address.
+   A buffer an unprivileged task passes must be on its own stack, in a block
+   it allocated, in AHB SRAM, or a global declared RTX_USER_DATA (see
+   common_ext.h). Other globals are refused, they share the image with the
+   kernel's data. */
+#define __SVC(num) __svc(num)
 
-/* __SVC_0 can be put at the end of the function declaration */
 /* memory management */
-extern int k_mem_init(size_t blk_size, int algo);
-#define mem_init(blk_size, algo) _mem_init((U32)k_mem_init, blk_size, algo);
-extern int _mem_init(U32 p_func, size_t blk_size, int algo) __SVC_0;
+extern int   __SVC(SVC_MEM_INIT)          mem_init(size_t blk_size, int algo);
+extern void *__SVC(SVC_MEM_ALLOC)         mem_alloc(size_t size);    /* NULL while a task as urgent waits in BLK_MEM */
+extern int   __SVC(SVC_MEM_DEALLOC)       mem_dealloc(void *ptr);
+extern int   __SVC(SVC_MEM_COUNT_EXTFRAG) mem_count_extfrag(size_t size);
+extern void *__SVC(SVC_MEM_ALLOC_WAIT)    mem_alloc_wait(size_t size, U32 timeout);    /* blocks in BLK_MEM */
+extern int   __SVC(SVC_MEM_TRACE_DUMP)    mem_trace_dump(void);    /* MEM_TRACE kernels, "MT" lines on UART1 */
 
-extern void *k_mem_alloc(size_t size);
-#define mem_alloc(size) _mem_alloc((U32)k_mem_alloc, size);
-extern void *_mem_alloc(U32 p_func, size_t size) __SVC_0;
-
-extern int k_mem_dealloc(void *);
-#define mem_dealloc(ptr) _mem_dealloc((U32)k_mem_dealloc, ptr)
-extern int _mem_dealloc(U32 p_func, void *ptr) __SVC_0;
-
-extern int k_mem_count_extfrag(size_t size);
-#define mem_count_extfrag(size) _mem_count_extfrag((U32)k_mem_count_extfrag, size);
-extern int _mem_count_extfrag(U32 p_func, size_t size) __SVC_0;
-
-/* Note __SVC_0 can also be put in the front of the function name*/
 /*task manamgement */
-extern int k_rtx_init(size_t blk_size, int algo, RTX_TASK_INFO *tsk_info, int num_tasks);
-#define rtx_init(blk_size, algo, tsk_info, num_tasks) _rtx_init((U32)k_rtx_init, blk_size, algo, tsk_info, num_tasks)
-extern int __SVC_0 _rtx_init(U32 p_func, size_t blk_size, int algo, RTX_TASK_INFO *tsk_info, int num_tasks);
-
-extern int k_tsk_yield(void);
-#define tsk_yield() _tsk_yield((U32)k_tsk_yield)
-extern int __SVC_0 _tsk_yield(U32 p_func);
-
-extern int k_tsk_create(task_t *task, void (*task_entry)(void), U8 prio, U16 stack_size);
-#define tsk_create(task, task_entry, prio, stack_size) _tsk_create((U32)k_tsk_create, task, task_entry, prio, stack_size)
-extern int __SVC_0 _tsk_create(U32 p_func, task_t *task, void (*task_entry)(void), U8 prio, U16 stack_size);
-
-extern void k_tsk_exit(void);
-#define tsk_exit() _tsk_exit((U32)k_tsk_exit)
-extern void __SVC_0 _tsk_exit(U32 p_func);
-
-extern int k_tsk_set_prio(task_t task_id, U8 prio);
-#define tsk_set_prio(task_id, prio) _tsk_set_prio((U32)k_tsk_set_prio, task_id, prio)
-extern int __SVC_0 _tsk_set_prio(U32 p_func, task_t task_id, U8 prio);
-
-extern int k_tsk_get(task_t task_id, RTX_TASK_INFO *buffer);
-#define tsk_get(task_id, buffer) _tsk_get((U32)k_tsk_get, task_id, buffer)
-extern int __SVC_0 _tsk_get(U32 p_func, task_t task_id, RTX_TASK_INFO *buffer);
-
-extern int k_tsk_ls(task_t *buf, int count);
-#define tsk_ls(buf, count) _tsk_ls((U32)k_tsk_ls, buf, count);
-extern int __SVC_0 _tsk_ls(U32 p_func, task_t *buf, int count);
-
-
+extern int   __SVC(SVC_RTX_INIT)     rtx_init(size_t blk_size, int algo, RTX_TASK_INFO *tsk_info, int num_tasks);
+extern int   __SVC(SVC_RTX_INIT_CFG) rtx_init_cfg(const RTX_CONFIG *cfg, RTX_TASK_INFO *tsk_info, int num_tasks);
+extern int   __SVC(SVC_TSK_YIELD)    tsk_yield(void);
+extern int   __SVC(SVC_TSK_CREATE)   tsk_create(task_t *task, void (*task_entry)(void), U8 prio, U16 stack_size);
+extern int   __SVC(SVC_TSK_CREATE_EX) tsk_create_ex(task_t *task, const RTX_TASK_INFO *info);    /* ptask, prio, u/k_stack_size */
+extern void  __SVC(SVC_TSK_EXIT)     tsk_exit(void);
+extern int   __SVC(SVC_TSK_SET_PRIO) tsk_set_prio(task_t task_id, U8 prio);
+extern int   __SVC(SVC_TSK_GET)      tsk_get(task_t task_id, RTX_TASK_INFO *buffer);
+extern int   __SVC(SVC_TSK_LS)       tsk_ls(task_t *buf, int count);
+extern int   __SVC(SVC_TSK_STATS)    tsk_stats(RTX_TASK_STATS *buf, int count);
+extern int   __SVC(SVC_TSK_DELAY)    tsk_delay(U32 ticks);
 
 /* message passing */
-extern int k_mbx_create(size_t size);
-#define mbx_create(size) _mbx_create((U32)k_mbx_create, size)
-extern int __SVC_0 _mbx_create(U32 p_func, size_t size);
-
-extern int k_send_msg(task_t tid, const void* buf);
-#define send_msg(tid, buf) _send_msg((U32)k_send_msg, tid, buf)
-extern int __SVC_0 _send_msg(U32 p_func, task_t tid, const void *buf);
-
-extern int k_recv_msg(task_t *tid, void *buf, size_t len);
-#define recv_msg(tid, buf, len) _recv_msg((U32)k_recv_msg, tid, buf, len)
-extern int __SVC_0 _recv_msg(U32 p_func, task_t *tid, void *buf, size_t len);
-
-extern int k_mbx_ls(task_t *buf, int count);
-#define mbx_ls(buf, count) _mbx_ls((U32)k_mbx_ls, buf, count);
-extern int __SVC_0 _mbx_ls(U32 p_func, task_t *buf, int count);
+extern int   __SVC(SVC_MBX_CREATE)   mbx_create(size_t size);
+extern int   __SVC(SVC_SEND_MSG)     send_msg(task_t tid, const void *buf);
+extern int   __SVC(SVC_RECV_MSG)     recv_msg(task_t *tid, void *buf, size_t len);
+extern int   __SVC(SVC_MBX_LS)       mbx_ls(task_t *buf, int count);
+extern int   __SVC(SVC_MBX_STATS)    mbx_stats(RTX_MBX_STATS *buf, int count);
+
+/* semaphores and mutexes, timeouts in ticks: 0 only tries, WAIT_FOREVER blocks */
+extern int   __SVC(SVC_SEM_CREATE)   sem_create(sem_t *sem, U32 count);
+extern int   __SVC(SVC_SEM_WAIT)     sem_wait(sem_t sem, U32 timeout);
+extern int   __SVC(SVC_SEM_POST)     sem_post(sem_t sem);
+extern int   __SVC(SVC_SEM_DELETE)   sem_delete(sem_t sem);
+extern int   __SVC(SVC_MTX_CREATE)   mtx_create(mtx_t *mtx);
+extern int   __SVC(SVC_MTX_LOCK)     mtx_lock(mtx_t mtx, U32 timeout);    /* priority inheritance */
+extern int   __SVC(SVC_MTX_UNLOCK)   mtx_unlock(mtx_t mtx);
+extern int   __SVC(SVC_MTX_DELETE)   mtx_delete(mtx_t mtx);
+
+/* event flags, 32 per task */
+extern int   __SVC(SVC_EVT_SET)      evt_set(task_t tid, U32 flags);
+extern int   __SVC(SVC_EVT_CLEAR)    evt_clear(U32 flags);
+extern int   __SVC(SVC_EVT_WAIT)     evt_wait(U32 flags, U8 opt, U32 timeout, U32 *got);
+
+/* task-local storage of the running task, plain memory accesses without an SVC.
+   slot < TLS_SLOTS. Slots start at 0 when a task is created. */
+extern U32 g_tls[TLS_SLOTS];
+#define tls_get(slot)      (g_tls[(slot)])
+#define tls_set(slot, val) (g_tls[(slot)] = (U32) (val))
 #endif // !_RTX_H_
@@ -0,0 +1,76 @@
+/**
+ * @file:   svc_bench.c
+ * @brief:  SVC and context-switch benchmark, build with SVC_BENCH defined
+ * NOTE: main_svc.c starts bench_task1 and bench_task2 in place of the two
+ *       priv_tasks.c tasks. bench_task1 times BENCH_ROUNDS kernel calls that
+ *       never switch (tsk_get) and BENCH_ROUNDS yield round trips with
+ *       bench_task2, each round trip being two switches, and prints cycles
+ *       per call and per switch on UART1. Cycles come from DWT->CYCCNT,
+ *       which is why both tasks are privileged. The loop overhead is
+ *       included, it is a few cycles per round.
+ *       Set host_clock.c's HOST_CLK_SVC and HOST_CLK_SWITCH costs from them.
+ */
+
+#ifdef SVC_BENCH
+
+#include <LPC17xx.h>
+#include "uart_polling.h"
+#include "printf.h"
+#include "svc_bench.h"
+
+/**
+ * @brief: fill the tasks array with the two benchmark tasks
+ * @param: tasks, an array of RTX_TASK_INFO elements
+ */
+void svc_bench_task_info(RTX_TASK_INFO *tasks, int num_tasks) {
+    for (int i = 0; i < num_tasks; i++) {
+        tasks[i].u_stack_size = 0x0;
+        tasks[i].k_stack_size = 0x0;    /* KERN_STACK_SIZE */
+        tasks[i].prio = HIGH;
+        tasks[i].priv = 1;
+    }
+    tasks[0].ptask = &bench_task1;
+    tasks[1].ptask = &bench_task2;
+}
+
+void bench_task1(void)
+{
+    RTX_TASK_INFO task_info;
+    char line[64];
+    U32 t0;
+    U32 get_cycles;
+    U32 yield_cycles;
+    int i;
+
+    tsk_yield();    /* let bench_task2 reach its loop first */
+
+    t0 = DWT->CYCCNT;
+    for (i = 0; i < BENCH_ROUNDS; i++) {
+        tsk_get(1, &task_info);
+    }
+    get_cycles = DWT->CYCCNT - t0;
+
+    t0 = DWT->CYCCNT;
+    for (i = 0; i < BENCH_ROUNDS; i++) {
+        tsk_yield();
+    }
+    yield_cycles = DWT->CYCCNT - t0;
+
+    sprintf(line, "tsk_get: %u cycles/call\n\r", get_cycles / BENCH_ROUNDS);
+    uart1_put_string(line);
+    sprintf(line, "switch:  %u cycles/switch\n\r", yield_cycles / (2 * BENCH_ROUNDS));
+    uart1_put_string(line);
+
+    while (1) {
+        tsk_yield();
+    }
+}
+
+void bench_task2(void)
+{
+    while (1) {
+        tsk_yield();
+    }
+}
+
+#endif /* SVC_BENCH */
@@ -0,0 +1,16 @@
+/**
+ * @file:   svc_bench.h
+ * @brief:  SVC and context-switch benchmark tasks, built with SVC_BENCH
+ */
+
+#ifndef SVC_BENCH_H_
+#define SVC_BENCH_H_
+#include "rtx.h"
+
+#define BENCH_ROUNDS 1000   /* iterations per measurement */
+
+void svc_bench_task_info(RTX_TASK_INFO *tasks, int num_tasks);
+void bench_task1(void);
+void bench_task2(void);
+
+#endif /* SVC_BENCH_H_ */
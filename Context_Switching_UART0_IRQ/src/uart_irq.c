@@ -9,20 +9,17 @@
 #include "uart_irq.h"
 #include "uart_polling.h"
 #include "rtx.h"
+#include "console.h"
+#include "k_msg.h"
 #ifdef DEBUG_0
 #include "printf.h"
 #endif
 
-
-uint8_t g_buffer[]= "You Typed a Q\n\r";
-uint8_t *gp_buffer = g_buffer;
-uint8_t g_send_char = 0;
 uint8_t g_char_in;
-uint8_t g_char_out;
 
-extern uint32_t g_switch_flag;
+uint32_t g_switch_flag = 0;     /* set by c_UART0_IRQHandler when a switch is due */
 
-extern int k_tsk_yield(void);
+extern int k_tsk_preempt(void);
 /**
  * @brief: initialize the n_uart
  * NOTES: It only supports UART0. It can be easily extended to support UART1 IRQ.
@@ -155,6 +152,8 @@ int uart_irq_init(int n_uart) {
 }
 
 
+/* the host port (../host) has no vector table, it calls c_UART0_IRQHandler itself */
+#ifndef HOST_PORT
 /**
  * @brief: use CMSIS ISR for UART0 IRQ Handler
  * NOTE: This example shows how to save/restore all registers rather than just
@@ -166,7 +165,7 @@ __asm void UART0_IRQHandler(void)
 {
     PRESERVE8
     IMPORT c_UART0_IRQHandler
-    IMPORT k_tsk_yield
+    IMPORT k_tsk_preempt
     CPSID I
     PUSH{r4-r11, lr}
     BL c_UART0_IRQHandler
@@ -175,11 +174,13 @@ __asm void UART0_IRQHandler(void)
     MOV R5, #0     
     CMP R4, R5
     BEQ  RESTORE    ; if g_switch_flag == 0, then restore the task that was interrupted
-    BL k_tsk_yield  ; otherwise (i.e g_switch_flag == 1, then switch to the other task)
+    BL k_tsk_preempt ; otherwise (i.e g_switch_flag == 1, then switch to the other task)
 RESTORE
     CPSIE I
     POP{r4-r11, pc}
 } 
+#endif /* ! HOST_PORT */
+
 /**
  * @brief: c UART0 IRQ Handler
  */
@@ -188,6 +189,8 @@ void c_UART0_IRQHandler(void)
     uint8_t IIR_IntId;        // Interrupt ID from IIR          
     LPC_UART_TypeDef *pUart = (LPC_UART_TypeDef *)LPC_UART0;
     
+    g_switch_flag = 0;
+
 #ifdef DEBUG_0
     uart1_put_string("Entering c_UART0_IRQHandler\n\r");
 #endif // DEBUG_0
@@ -202,9 +205,6 @@ void c_UART0_IRQHandler(void)
         uart1_put_char(g_char_in);
         uart1_put_string("\n\r");
 #endif // DEBUG_0
-        g_buffer[12] = g_char_in; // nasty hack
-        g_send_char = 1;
-        
         /* setting the g_continue_flag */
         if ( g_char_in == 's' ) {
             g_switch_flag = 1; 
@@ -219,35 +219,16 @@ void c_UART0_IRQHandler(void)
         header->length = msg_hdr_size + 1;
         header->type = KEY_IN;
         buf[msg_hdr_size] = g_char_in;
-        
-       //TO DO: Do we need to add sender_tid (TID_UART0_IRQ) with the message?
-       send_msg(TID_KCD, buf);
+
+        /* an IRQ handler cannot take the send_msg SVC, the kernel call is direct */
+        if (k_send_msg_isr(TID_KCD, buf)) {
+            g_switch_flag = 1;
+        }
 				
     } else if (IIR_IntId & IIR_THRE) {
-    /* THRE Interrupt, transmit holding register becomes empty */
+    /* THRE Interrupt, the transmit FIFO is empty, the console refills it */
+        g_switch_flag = con_tx_isr();
 
-        if (*gp_buffer != '\0' ) {
-            g_char_out = *gp_buffer;
-#ifdef DEBUG_0
-            //uart1_put_string("Writing a char = ");
-            //uart1_put_char(g_char_out);
-            //uart1_put_string("\n\r");
-            
-            // you could use the printf instead
-            printf("Writing a char = %c \n\r", g_char_out);
-#endif // DEBUG_0            
-            pUart->THR = g_char_out;
-            gp_buffer++;
-        } else {
-#ifdef DEBUG_0
-            uart1_put_string("Finish writing. Turning off IER_THRE\n\r");
-#endif // DEBUG_0
-            pUart->IER ^= IER_THRE; // toggle the IER_THRE bit 
-            pUart->THR = '\0';
-            g_send_char = 0;
-            gp_buffer = g_buffer;        
-        }
-          
     } else {  /* not implemented yet */
 #ifdef DEBUG_0
         uart1_put_string("Should not get here!\n\r");
@@ -128,10 +128,10 @@ int uart_put_string(int n_uart, char *s)
  * @brief call back function for printf
  * NOTE: first paramter p is not used for now. UART1 used.
  */
-void putc(void *p, char c)
+void uart1_putc(void *p, char c)
 {
   if ( p != NULL ) {
-    uart1_put_string("putc: first parameter needs to be NULL");
+    uart1_put_string("uart1_putc: first parameter needs to be NULL");
   } else {
       uart1_put_char(c);
   }
@@ -24,6 +24,6 @@ int uart_init(int n_uart);      /* initialize the n_uart       */
 int uart_get_char(int n_uart);  /* read a char from the n_uart */
 int uart_put_char(int n_uart, char c);   /* write a char   to n_uart */
 int uart_put_string(int n_uart, char *s);/* write a string to n_uart */
-void putc(void *p, char c);     /* call back function for printf, use uart1 */
+void uart1_putc(void *p, char c);   /* call back function for printf, use uart1 */
 
 #endif /* ! UART_POLLING_H_ */
@@ -16,10 +16,11 @@
 #endif /* DEBUG_0 */
 
 /* the following arrays can also be dynamic allocated 
-   They do not have to be global buffers. 
+   They do not have to be global buffers. task2 is unprivileged, the
+   kernel only accepts its globals if they are RTX_USER_DATA.
  */
-U8 g_buf1[256];
-U8 g_buf2[256];
+U8 g_buf1[256] RTX_USER_DATA;
+U8 g_buf2[256] RTX_USER_DATA;
 task_t g_tasks[MAX_TASKS];
 
 /**
@@ -33,6 +34,7 @@ task_t g_tasks[MAX_TASKS];
 int set_usr_task_info(RTX_TASK_INFO *tasks, int num_tasks) {
     for (int i = 0; i < num_tasks; i++ ) {
         tasks[i].u_stack_size = 0x0;
+        tasks[i].k_stack_size = 0x0;    /* KERN_STACK_SIZE */
         tasks[i].prio = HIGH;
         tasks[i].priv = 1;
     }